@@ -0,0 +1,130 @@
+#include "common/TimeProfiler.h"
+#include "rasterizer/TriangleRasterizer.h"
+
+#include <algorithm>
+#include <array>
+#include <chrono>
+#include <cmath>
+#include <cstdio>
+#include <random>
+#include <string>
+#include <vector>
+
+using namespace cg;
+
+namespace {
+constexpr int screenWidth = 1024;
+constexpr int screenHeight = 768;
+
+// Keeps the nearest depth per pixel, roughly the work a depth tested painter does per fragment
+class DepthPainter {
+public:
+    DepthPainter() : depths_(screenWidth * screenHeight, 1.0f) {}
+
+    void paintFragment(const FragmentData& frag) {
+        float& depth = depths_[frag.y * screenWidth + frag.x];
+        depth = std::min(depth, frag.z);
+        ++fragments_;
+    }
+    int width() const { return screenWidth; }
+    int height() const { return screenHeight; }
+
+    unsigned long long fragments() const { return fragments_; }
+
+private:
+    std::vector<float> depths_;
+    unsigned long long fragments_ = 0;
+};
+
+struct SizeClass {
+    std::string name;
+    // Legs of the triangle, before it's rotated randomly
+    float width;
+    float height;
+    int triangleCount;
+};
+
+std::vector<std::array<Point, 3>> generateTriangles(const SizeClass& sizeClass, std::mt19937& generator) {
+    std::uniform_real_distribution<float> unit(0.0f, 1.0f);
+    std::vector<std::array<Point, 3>> triangles;
+    triangles.reserve(sizeClass.triangleCount);
+    for (int i = 0; i < sizeClass.triangleCount; ++i) {
+        Point origin{unit(generator) * screenWidth, unit(generator) * screenHeight, unit(generator)};
+        float angle = unit(generator) * 6.2831853f;
+        glm::vec2 u(std::cos(angle), std::sin(angle));
+        glm::vec2 v(-u.y, u.x);
+        Point p2 = origin + Point(u * sizeClass.width, unit(generator));
+        Point p3 = origin + Point(v * sizeClass.height, unit(generator));
+        triangles.push_back({origin, p2, p3});
+    }
+    return triangles;
+}
+
+struct Measurement {
+    double nsPerTriangle;
+    unsigned long long fragments;
+};
+
+enum class Traversal { PerPixel, Blocks };
+
+Measurement measure(const std::vector<std::array<Point, 3>>& triangles, Traversal traversal) {
+    constexpr int repetitions = 5;
+    std::array<glm::vec3, 3> normals = {};
+    std::array<glm::vec3, 3> globalPoints = {};
+    std::array<float, 3> invertedW = {1, 1, 1};
+
+    std::vector<double> times;
+    unsigned long long fragments = 0;
+    // The first round warms up caches and isn't counted
+    for (int repetition = 0; repetition <= repetitions; ++repetition) {
+        DepthPainter painter;
+        TimeProfiler<std::chrono::steady_clock, std::chrono::nanoseconds> profiler;
+        for (const std::array<Point, 3>& points : triangles) {
+            if (traversal == Traversal::PerPixel) {
+                TriangleRasterizer::rasterizePerPixel({points[0], points[1], points[2]},
+                                                      {globalPoints[0], globalPoints[1], globalPoints[2]},
+                                                      {normals[0], normals[1], normals[2]}, invertedW, painter,
+                                                      PixelRect{0, 0, screenWidth, screenHeight});
+            } else {
+                TriangleRasterizer::rasterize({points[0], points[1], points[2]},
+                                              {globalPoints[0], globalPoints[1], globalPoints[2]},
+                                              {normals[0], normals[1], normals[2]}, invertedW, painter);
+            }
+        }
+        double time = static_cast<double>(profiler.time().count());
+        if (repetition > 0) {
+            times.push_back(time / static_cast<double>(triangles.size()));
+        }
+        fragments = painter.fragments();
+    }
+    std::sort(times.begin(), times.end());
+    return Measurement{times[times.size() / 2], fragments};
+}
+} // namespace
+
+// Median time per triangle of TriangleRasterizer::rasterize() against the per pixel loop, for triangles of several
+// sizes on a 1024x768 screen
+int main() {
+    std::vector<SizeClass> sizeClasses = {
+        {"tiny (1x1)", 1.0f, 1.0f, 200000},   {"small (4x4)", 4.0f, 4.0f, 200000},
+        {"medium (16x16)", 16.0f, 16.0f, 50000}, {"large (64x64)", 64.0f, 64.0f, 5000},
+        {"huge (256x256)", 256.0f, 256.0f, 500}, {"sliver (200x1)", 200.0f, 1.0f, 20000},
+    };
+
+    std::mt19937 generator(42);
+    bool allMatch = true;
+    std::printf("%-16s %14s %14s %9s %14s\n", "size", "per pixel ns", "blocks ns", "speedup", "fragments");
+    for (const SizeClass& sizeClass : sizeClasses) {
+        std::vector<std::array<Point, 3>> triangles = generateTriangles(sizeClass, generator);
+        Measurement perPixel = measure(triangles, Traversal::PerPixel);
+        Measurement blocks = measure(triangles, Traversal::Blocks);
+
+        std::printf("%-16s %14.1f %14.1f %8.2fx %14llu\n", sizeClass.name.c_str(), perPixel.nsPerTriangle,
+                    blocks.nsPerTriangle, perPixel.nsPerTriangle / blocks.nsPerTriangle, blocks.fragments);
+        if (blocks.fragments != perPixel.fragments) {
+            std::printf("  fragment count differs, per pixel drew %llu\n", perPixel.fragments);
+            allMatch = false;
+        }
+    }
+    return allMatch ? 0 : 1;
+}
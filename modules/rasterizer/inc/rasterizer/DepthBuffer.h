@@ -1,26 +1,57 @@
 #pragma once
 
+#include "rasterizer/PixelRect.h"
+
 #include <span>
 #include <vector>
 
 #include <new>
 
 namespace cg {
+// Besides the depth of every pixel, keeps the farthest depth of each coarseTileSize x coarseTileSize tile up to date
+// as pixels are written (hierarchical Z). That tells whether anything at a given depth could still be drawn into an
+// area without reading its pixels.
 class DepthBuffer {
 public:
     static constexpr float farthest = -1.0f;
+    static constexpr int coarseTileSize = 8;
 
     DepthBuffer(int width, int height);
 
     bool updateIfNearer(int x, int y, float newDepth);
+    // For shading after a depth pre-pass: true for the first fragment exactly at the pixel's depth. The pixel is then
+    // moved one float nearer, so fragments at the same depth after it fail and every pixel is shaded once, by the same
+    // fragment that would have won without the pre-pass.
+    bool claimIfEqual(int x, int y, float depth);
     int width() { return width_; }
     int height() { return height_; }
     void clear();
+    // Only clears `rect`. Other threads may use the rest of the buffer meanwhile if `rect` is aligned to coarse tiles.
+    void clear(const PixelRect& rect);
     float depthAtPixel(int x, int y) { return buffer_[y * width_ + x]; }
 
+    // True if no depth up to `depth` could be written anywhere in `rect`, because every pixel of the tiles it touches
+    // is at least as near already. False for NaN.
+    bool isOccluded(const PixelRect& rect, float depth) const;
+    // Farthest depth of the tile with pixel (x, y)
+    float farthestInTile(int x, int y) const { return coarse_[coarseIndex(x, y)].farthest; }
+
 private:
+    struct CoarseTile {
+        float farthest;
+        // Pixels of the tile at the farthest depth, the tile is rescanned when the last of them gets nearer
+        int farthestCount;
+    };
+
+    int coarseIndex(int x, int y) const { return (y / coarseTileSize) * coarseColumns_ + x / coarseTileSize; }
+    // `depth` has to be nearer than the pixel's
+    void setNearer(int x, int y, float depth);
+    void rescanTile(int x, int y);
+
     int width_;
     int height_;
     std::vector<float> buffer_;
+    int coarseColumns_;
+    std::vector<CoarseTile> coarse_;
 };
 } // namespace cg
@@ -0,0 +1,109 @@
+#pragma once
+
+#if defined(__SSE2__) || defined(_M_X64) || (defined(_M_IX86_FP) && _M_IX86_FP >= 2)
+#define CG_FLOAT4_SSE 1
+#include <emmintrin.h>
+#else
+#define CG_FLOAT4_SSE 0
+#endif
+
+#include <array>
+
+namespace cg {
+// Four floats processed together, with SSE2 where available and a plain loop otherwise. Each lane gives bit for bit
+// the result of the same scalar operation, so code written with it can be checked against a scalar version.
+class Float4 {
+public:
+    // Comparison result, one bit per lane. Like scalar comparisons, lanes holding NaN compare false.
+    class Mask {
+    public:
+        static Mask fromBits(unsigned bits) { return Mask(bits & 0b1111); }
+
+        friend Mask operator&(Mask lhs, Mask rhs) { return Mask(lhs.bits_ & rhs.bits_); }
+        friend Mask operator|(Mask lhs, Mask rhs) { return Mask(lhs.bits_ | rhs.bits_); }
+        // Bit i is set if lane i is
+        unsigned bits() const { return bits_; }
+        bool all() const { return bits_ == 0b1111; }
+
+    private:
+        explicit Mask(unsigned bits) : bits_(bits) {}
+
+        unsigned bits_;
+    };
+
+#if CG_FLOAT4_SSE
+    // All lanes set to `value`
+    Float4(float value) : lanes_(_mm_set1_ps(value)) {}
+    Float4(float lane0, float lane1, float lane2, float lane3) : lanes_(_mm_setr_ps(lane0, lane1, lane2, lane3)) {}
+
+    float operator[](int lane) const { return toArray()[lane]; }
+    std::array<float, 4> toArray() const {
+        alignas(16) std::array<float, 4> values;
+        _mm_store_ps(values.data(), lanes_);
+        return values;
+    }
+
+    friend Float4 operator+(Float4 lhs, Float4 rhs) { return Float4(_mm_add_ps(lhs.lanes_, rhs.lanes_)); }
+    friend Float4 operator*(Float4 lhs, Float4 rhs) { return Float4(_mm_mul_ps(lhs.lanes_, rhs.lanes_)); }
+    friend Mask operator>=(Float4 lhs, Float4 rhs) { return toMask(_mm_cmpge_ps(lhs.lanes_, rhs.lanes_)); }
+    friend Mask operator>(Float4 lhs, Float4 rhs) { return toMask(_mm_cmpgt_ps(lhs.lanes_, rhs.lanes_)); }
+    friend Mask operator<(Float4 lhs, Float4 rhs) { return toMask(_mm_cmplt_ps(lhs.lanes_, rhs.lanes_)); }
+
+private:
+    explicit Float4(__m128 lanes) : lanes_(lanes) {}
+
+    static Mask toMask(__m128 comparison) { return Mask::fromBits(static_cast<unsigned>(_mm_movemask_ps(comparison))); }
+
+    __m128 lanes_;
+#else
+    Float4(float value) : lanes_{value, value, value, value} {}
+    Float4(float lane0, float lane1, float lane2, float lane3) : lanes_{lane0, lane1, lane2, lane3} {}
+
+    float operator[](int lane) const { return lanes_[lane]; }
+    std::array<float, 4> toArray() const { return lanes_; }
+
+    friend Float4 operator+(Float4 lhs, Float4 rhs) {
+        return apply(lhs, rhs, [](float l, float r) {
+            return l + r;
+        });
+    }
+    friend Float4 operator*(Float4 lhs, Float4 rhs) {
+        return apply(lhs, rhs, [](float l, float r) {
+            return l * r;
+        });
+    }
+    friend Mask operator>=(Float4 lhs, Float4 rhs) {
+        return compare(lhs, rhs, [](float l, float r) {
+            return l >= r;
+        });
+    }
+    friend Mask operator>(Float4 lhs, Float4 rhs) {
+        return compare(lhs, rhs, [](float l, float r) {
+            return l > r;
+        });
+    }
+    friend Mask operator<(Float4 lhs, Float4 rhs) {
+        return compare(lhs, rhs, [](float l, float r) {
+            return l < r;
+        });
+    }
+
+private:
+    template <typename Op>
+    static Float4 apply(Float4 lhs, Float4 rhs, Op op) {
+        return Float4(op(lhs.lanes_[0], rhs.lanes_[0]), op(lhs.lanes_[1], rhs.lanes_[1]),
+                      op(lhs.lanes_[2], rhs.lanes_[2]), op(lhs.lanes_[3], rhs.lanes_[3]));
+    }
+    template <typename Op>
+    static Mask compare(Float4 lhs, Float4 rhs, Op op) {
+        unsigned bits = 0;
+        for (int lane = 0; lane < 4; ++lane) {
+            bits |= op(lhs.lanes_[lane], rhs.lanes_[lane]) ? 1u << lane : 0u;
+        }
+        return Mask::fromBits(bits);
+    }
+
+    std::array<float, 4> lanes_;
+#endif
+};
+} // namespace cg
@@ -0,0 +1,45 @@
+#pragma once
+
+#include "core/BasicTypes.h"
+#include "rasterizer/DepthBuffer.h"
+#include "rasterizer/PixelRect.h"
+
+#include "glm/vec3.hpp"
+
+#include <cstdint>
+#include <limits>
+#include <vector>
+
+namespace cg {
+// What deferred shading needs of the nearest fragment of every pixel: depth, normal, global position and the index of
+// the shape it belongs to. Each attribute is a plane of its own, so the depth test only touches the depth.
+class GBuffer {
+public:
+    // Shape index of pixels nothing was drawn to
+    static constexpr uint32_t noShape = std::numeric_limits<uint32_t>::max();
+
+    GBuffer(int width, int height);
+
+    int width() const { return width_; }
+    int height() const { return height_; }
+    DepthBuffer& depth() { return depth_; }
+
+    // Stores the fragment if it's nearer than what the pixel holds
+    bool updateIfNearer(int x, int y, float depth, const glm::vec3& normal, const Point& position, uint32_t shapeIndex);
+    uint32_t shapeAtPixel(int x, int y) const { return shapes_[y * width_ + x]; }
+    const glm::vec3& normalAtPixel(int x, int y) const { return normals_[y * width_ + x]; }
+    const Point& positionAtPixel(int x, int y) const { return positions_[y * width_ + x]; }
+
+    // Normals and positions are only read where a shape was drawn, so they aren't cleared
+    void clear();
+    void clear(const PixelRect& rect);
+
+private:
+    int width_;
+    int height_;
+    DepthBuffer depth_;
+    std::vector<glm::vec3> normals_;
+    std::vector<Point> positions_;
+    std::vector<uint32_t> shapes_;
+};
+} // namespace cg
@@ -0,0 +1,14 @@
+#pragma once
+
+namespace cg {
+// Pixels with minX <= x < maxX and minY <= y < maxY, empty if either max isn't above its min
+struct PixelRect {
+    int minX;
+    int minY;
+    int maxX;
+    int maxY;
+
+    bool empty() const { return minX >= maxX || minY >= maxY; }
+    bool operator==(const PixelRect&) const = default;
+};
+} // namespace cg
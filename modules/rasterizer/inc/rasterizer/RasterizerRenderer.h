@@ -20,6 +20,18 @@ class Camera;
 
 class RasterizerRenderer {
 public:
+    // Skips triangles and pixel blocks that are hidden behind what was already drawn, see DepthBuffer. On by default,
+    // turning it off only makes sense to measure what it saves.
+    void setOcclusionCulling(bool enabled) { occlusionCulling_ = enabled; }
+    bool occlusionCulling() const { return occlusionCulling_; }
+    // What occlusion culling skipped in the last frame
+    const OcclusionCounters& occlusionCounters() const { return occlusionCounters_; }
+    // Rasterizes all shapes into the depth buffer first, then shades only the fragments at the final depth, so every
+    // pixel is lit once. Pays off when a lot of what's drawn gets covered later, otherwise it rasterizes twice for
+    // nothing. Off by default.
+    void setDepthPrepass(bool enabled) { depthPrepass_ = enabled; }
+    bool depthPrepass() const { return depthPrepass_; }
+
     void renderScene(Scene& scene, Screen auto& screen) {
         const Camera& camera = scene.camera();
         BackFaceCuller bfCuller(camera.position());
@@ -32,31 +44,52 @@ public:
             depthBuffer->clear();
         }
         glm::mat4 toScreenMatrix = camera.viewportTransform() * camera.projectionTransform() * camera.cameraTransform();
+        occlusionCounters_ = OcclusionCounters();
 
-        for (Shape* shape : scene.shapes()) {
-            const RasterizerShaders& shaders = static_cast<const RasterizerShaders&>(shape->shaderGroup());
-            MeshData shapeMesh = shaders.shapeShader().generateMesh(*shape);
-            meshToGlobalSpace(shapeMesh, *shape);
-            MeshData culledMesh = cullBackFaceTriangles(shapeMesh, bfCuller);
-            MeshData finalMesh = clipper.clip(culledMesh);
-            std::vector<Point> verticesGlobal;
-            verticesGlobal.reserve(finalMesh.vertices().size());
-            verticesGlobal.assign_range(finalMesh.vertices());
-
-            std::vector<float> invertedW = verticesToScreenSpace(toScreenMatrix, finalMesh);
-            FragPainter fragPainter(screen.paintPixels(), *depthBuffer, scene, *shape);
-            rasterizeMesh(finalMesh, verticesGlobal, invertedW, fragPainter);
+        if (!depthPrepass_) {
+            for (Shape* shape : scene.shapes()) {
+                ScreenGeometry geometry = toScreenGeometry(*shape, bfCuller, clipper, toScreenMatrix);
+                FragPainter fragPainter(screen.paintPixels(), *depthBuffer, scene, *shape, occlusionCulling_, false);
+                rasterizeMesh(geometry, fragPainter);
+            }
+            return;
+        }
+
+        // Geometry is kept for the shading pass
+        std::vector<Shape*> shapes = scene.shapes();
+        std::vector<ScreenGeometry> geometries;
+        geometries.reserve(shapes.size());
+        DepthPainter depthPainter(*depthBuffer, occlusionCulling_);
+        for (Shape* shape : shapes) {
+            geometries.push_back(toScreenGeometry(*shape, bfCuller, clipper, toScreenMatrix));
+            rasterizeMesh(geometries.back(), depthPainter);
+        }
+        for (size_t i = 0; i < shapes.size(); ++i) {
+            FragPainter fragPainter(screen.paintPixels(), *depthBuffer, scene, *shapes[i], occlusionCulling_, true);
+            rasterizeMesh(geometries[i], fragPainter);
         }
     }
 
 private:
+    // A shape's triangles after the geometry stage, ready to be rasterized
+    struct ScreenGeometry {
+        MeshData mesh;
+        // Vertices before the screen transform, for lighting
+        std::vector<Point> globalVertices;
+        std::vector<float> invertedW;
+    };
+
+    // After a depth pre-pass, only fragments at the depth it left are painted
     template <PixelPainter Painter>
     class FragPainter {
     public:
-        FragPainter(Painter&& painter, DepthBuffer& depthBuffer, const Scene& scene, const Shape& shape)
-            : painter_(std::move(painter)), depthBuffer_(depthBuffer), scene_(scene), shape_(shape) {}
+        FragPainter(Painter&& painter, DepthBuffer& depthBuffer, const Scene& scene, const Shape& shape,
+                    bool occlusionCulling, bool afterDepthPrepass)
+            : painter_(std::move(painter)), depthBuffer_(depthBuffer), scene_(scene), shape_(shape),
+              occlusionCulling_(occlusionCulling), afterDepthPrepass_(afterDepthPrepass) {}
         void paintFragment(const FragmentData& frag) {
-            bool shouldPaint = depthBuffer_.updateIfNearer(frag.x, frag.y, frag.z);
+            bool shouldPaint = afterDepthPrepass_ ? depthBuffer_.claimIfEqual(frag.x, frag.y, frag.z)
+                                                  : depthBuffer_.updateIfNearer(frag.x, frag.y, frag.z);
             if (!shouldPaint) {
                 return;
             }
@@ -70,6 +103,9 @@ private:
             pixelColor += scene_.ambientLight() * shape_.ambientReflectance();
             painter_.paint(frag.y, frag.x, pixelColor);
         }
+        bool isOccluded(const PixelRect& rect, float depth) const {
+            return occlusionCulling_ && depthBuffer_.isOccluded(rect, depth);
+        }
         int width() { return painter_.width(); }
         int height() { return painter_.height(); }
 
@@ -78,20 +114,46 @@ private:
         DepthBuffer& depthBuffer_;
         const Scene& scene_;
         const Shape& shape_;
+        bool occlusionCulling_;
+        bool afterDepthPrepass_;
     };
 
+    // Only fills the depth buffer, for the depth pre-pass
+    class DepthPainter {
+    public:
+        static constexpr bool depthOnly = true;
+
+        DepthPainter(DepthBuffer& depthBuffer, bool occlusionCulling)
+            : depthBuffer_(depthBuffer), occlusionCulling_(occlusionCulling) {}
+        void paintFragment(const FragmentData& frag) { depthBuffer_.updateIfNearer(frag.x, frag.y, frag.z); }
+        bool isOccluded(const PixelRect& rect, float depth) const {
+            return occlusionCulling_ && depthBuffer_.isOccluded(rect, depth);
+        }
+        int width() { return depthBuffer_.width(); }
+        int height() { return depthBuffer_.height(); }
+
+    private:
+        DepthBuffer& depthBuffer_;
+        bool occlusionCulling_;
+    };
+    static_assert(DepthOnlyPainter<DepthPainter>, "DepthPainter does not fulfill the DepthOnlyPainter concept.");
+
+    ScreenGeometry toScreenGeometry(Shape& shape, const BackFaceCuller& bfCuller, Clipper& clipper,
+                                    const glm::mat4& toScreenMatrix);
+
     void meshToGlobalSpace(MeshData& mesh, const Shape& shape);
     MeshData cullBackFaceTriangles(MeshData& mesh, const BackFaceCuller& culler);
     std::vector<float> verticesToScreenSpace(const glm::mat4& toScreenMatrix, MeshData& mesh);
 
-    template <typename PixelPainter>
-    void rasterizeMesh(const MeshData& mesh, const std::vector<Point>& verticesGlobal, std::vector<float> invertedW,
-                       FragPainter<PixelPainter>& fragPainter) {
-        const auto& vertices = mesh.vertices();
-        const auto& normals = mesh.vertexNormals();
+    template <typename Painter>
+    void rasterizeMesh(const ScreenGeometry& geometry, Painter& fragPainter) {
+        const auto& vertices = geometry.mesh.vertices();
+        const auto& normals = geometry.mesh.vertexNormals();
+        const auto& verticesGlobal = geometry.globalVertices;
+        const auto& invertedW = geometry.invertedW;
 
-        for (const auto& triangle : mesh.triangles()) {
-            TriangleRasterizer::rasterize(
+        for (const auto& triangle : geometry.mesh.triangles()) {
+            occlusionCounters_ += TriangleRasterizer::rasterize(
                 {vertices[triangle[0].vertex], vertices[triangle[1].vertex], vertices[triangle[2].vertex]},
                 {verticesGlobal[triangle[0].vertex], verticesGlobal[triangle[1].vertex],
                  verticesGlobal[triangle[2].vertex]},
@@ -103,6 +165,9 @@ private:
     }
 
     std::unique_ptr<DepthBuffer> depthBuffer;
+    bool occlusionCulling_ = true;
+    bool depthPrepass_ = false;
+    OcclusionCounters occlusionCounters_;
 };
 
 static_assert(Renderer<RasterizerRenderer>, "RasterizerRenderer does not fulfill the Renderer concept.");
@@ -7,16 +7,28 @@
 #include "rasterizer/BackFaceCuller.h"
 #include "rasterizer/Clipper.h"
 #include "rasterizer/DepthBuffer.h"
+#include "rasterizer/GBuffer.h"
 #include "rasterizer/MemoryColorBuffer.h"
 #include "rasterizer/RasterizerShaders.h"
 #include "rasterizer/TriangleRasterizer.h"
 #include "renderer/Renderer.h"
+#include "task/CoTask.h"
+#include "task/RecordedGraph.h"
+#include "task/TaskArena.h"
 #include "task/TaskGraph.h"
 #include "task/ThreadPool.h"
+#include "task/WorkerLocal.h"
 
 #include "glm/mat4x4.hpp"
 
 #include <algorithm>
+#include <cstdint>
+#include <memory>
+#include <optional>
+#include <type_traits>
+#include <typeindex>
+#include <typeinfo>
+#include <utility>
 #include <vector>
 
 namespace cg {
@@ -24,123 +36,289 @@ class Camera;
 
 class RasterizerRendererParallel {
 public:
+    enum class Mode : uint8_t {
+        // After the geometry stage, triangles are binned into screen tiles, and each tile is rasterized by one thread
+        // into tile sized depth and color buffers that stay in cache. Memory and the final pass over the pixels don't
+        // grow with the number of threads, and the image doesn't depend on how work was split between them.
+        Tiled,
+        // Every thread rasterizes into full screen depth and color buffers of its own, which are combined at the end
+        ThreadBuffers,
+        // Binned into tiles like Tiled, but rasterizing only keeps the nearest fragment of each pixel in a screen sized
+        // GBuffer, without lighting it. A separate pass then shades every covered pixel once, so fragments that end up
+        // hidden don't cost a lighting loop. Pays off with many lights and a lot of overdraw.
+        Deferred
+    };
+    // Side of the square screen tiles of Mode::Tiled and Mode::Deferred. The depth and color of a tile take 64 KiB,
+    // which fits in L2.
+    static constexpr int tileSize = 64;
+
+    // Renders on ThreadPool::defaultPool()
+    RasterizerRendererParallel() : threadPool_(&ThreadPool::defaultPool()) {}
+    // The pool has to outlive the renderer. Per-thread buffers are sized for its participants.
+    explicit RasterizerRendererParallel(ThreadPool& threadPool) : threadPool_(&threadPool) {}
+    // Renders on a pool of its own, e.g. to pin workers, per-worker buffers are then allocated on the node of their
+    // worker
+    explicit RasterizerRendererParallel(const ThreadPool::Options& poolOptions)
+        : ownedPool_(std::make_unique<ThreadPool>(poolOptions)), threadPool_(ownedPool_.get()) {}
+
+    // Takes effect with the next frame
+    void setMode(Mode mode) { mode_ = mode; }
+    Mode mode() const { return mode_; }
+
+    // Skips triangles and pixel blocks that are hidden behind what was already drawn into the same depth buffer, see
+    // DepthBuffer. On by default, turning it off only makes sense to measure what it saves.
+    void setOcclusionCulling(bool enabled) { occlusionCulling_ = enabled; }
+    bool occlusionCulling() const { return occlusionCulling_; }
+    // What occlusion culling skipped in the last frame, summed over all threads
+    const OcclusionCounters& occlusionCounters() const { return occlusionCounters_; }
+    // In Mode::Tiled, each tile is first rasterized depth only, then shaded where fragments match the final depth, so
+    // every pixel is lit once. Pays off with a lot of overdraw. Mode::ThreadBuffers ignores it, since threads would
+    // rasterize different triangles in each pass, and so does Mode::Deferred, which shades every pixel once anyway. Off
+    // by default.
+    void setDepthPrepass(bool enabled) { depthPrepass_ = enabled; }
+    bool depthPrepass() const { return depthPrepass_; }
+    // Holds the state of each frame's tasks, once it has grown to the size of a frame it stops allocating
+    const TaskArena& frameArena() const { return frameArena_; }
+
     void renderScene(Scene& scene, Screen auto& screen) {
         const Camera& camera = scene.camera();
         BackFaceCuller bfCuller(camera.position());
-        FrustumIntersect frustumIntersect(scene.camera().frustumPoints());
-        std::vector<Clipper> clippers(threadPool_.threadCount(),
-                                      Clipper(frustumIntersect, FrustumIntersect::Near | FrustumIntersect::Far));
+        // Assigned in place, so the clippers kept from previous frames see this frame's frustum
+        frustumIntersect_ = FrustumIntersect(camera.frustumPoints());
         prepareBuffers(screen.width(), screen.height());
         glm::mat4 toScreenMatrix = camera.viewportTransform() * camera.projectionTransform() * camera.cameraTransform();
 
-        TaskSequence renderSequence;
+        // The graph only depends on the shapes, everything that changes between frames is passed in as params
+        using ScreenType = std::remove_reference_t<decltype(screen)>;
+        if (!std::ranges::equal(std::as_const(scene).shapes(), recordedShapes_, {}, &std::unique_ptr<Shape>::get) ||
+            recordedScreenType_ != typeid(ScreenType) || recordedMode_ != mode_) {
+            recordFrameGraph<ScreenType>(scene.shapes());
+        }
 
-        TaskBatch bufferClearBatch;
-        for (unsigned i = 0; i < depthBuffers_.size(); ++i) {
-            bufferClearBatch.addWork([this, i]() {
-                depthBuffers_[i].clear();
+        // Nothing from the previous frame is in use anymore
+        frameArena_.reset();
+        frameGraph_.startAndWait(*threadPool_, FrameParams{&scene, &screen, &bfCuller, &toScreenMatrix});
+        occlusionCounters_ =
+            threadOcclusionCounters_.combine(OcclusionCounters(), [](OcclusionCounters sum, OcclusionCounters local) {
+                return sum += local;
             });
+    }
+
+private:
+    struct FrameParams {
+        Scene* scene;
+        // Points to the screen type the graph was recorded for
+        void* screen;
+        const BackFaceCuller* bfCuller;
+        const glm::mat4* toScreenMatrix;
+    };
+
+    // A shape's triangles after the geometry stage, ready to be rasterized
+    struct ScreenGeometry {
+        MeshData mesh;
+        // Vertices before the screen transform, for lighting
+        std::vector<Point> globalVertices;
+        std::vector<float> invertedW;
+    };
+
+    // Geometry of a shape in a tiled frame, kept until the shape's tiles are rasterized
+    struct BinnedShape {
+        ScreenGeometry geometry;
+        // Indices of the triangles whose bounds touch each tile, in triangle order. The vectors keep their capacity
+        // between frames.
+        std::vector<std::vector<uint32_t>> tileTriangles;
+    };
+
+    template <typename ScreenType>
+    void recordFrameGraph(std::vector<Shape*> shapes) {
+        switch (mode_) {
+        case Mode::Tiled:
+            frameGraph_ = recordTiledFrame<ScreenType>(shapes);
+            break;
+        case Mode::ThreadBuffers:
+            frameGraph_ = recordThreadBuffersFrame<ScreenType>(shapes);
+            break;
+        case Mode::Deferred:
+            frameGraph_ = recordDeferredFrame<ScreenType>(shapes);
+            break;
         }
-        for (unsigned i = 0; i < colorBuffers_.size(); ++i) {
-            bufferClearBatch.addWork([this, i]() {
-                colorBuffers_[i].clear();
+        recordedShapes_ = std::move(shapes);
+        recordedScreenType_ = typeid(ScreenType);
+        recordedMode_ = mode_;
+    }
+
+    RecordedBatch<FrameParams> recordBinBatch(const std::vector<Shape*>& shapes) {
+        binnedShapes_.resize(shapes.size());
+        RecordedBatch<FrameParams> binBatch;
+        binBatch.setLabel("bin shape");
+        for (size_t i = 0; i < shapes.size(); ++i) {
+            binBatch.addWork([this, shape = shapes[i], i](const FrameParams& params) {
+                binShape(*shape, params, binnedShapes_[i]);
             });
         }
-        renderSequence.addWork(std::move(bufferClearBatch));
-
-        TaskBatch shapesBatch;
-        for (Shape* shape : scene.shapes()) {
-            TaskSequence perShapeSteps;
-            auto tempData = std::make_unique<ShapeTempData>();
+        return binBatch;
+    }
 
-            perShapeSteps.addWork([this, tempData = tempData.get(), &bfCuller, &clippers, &toScreenMatrix, shape]() {
-                auto threadIndex = ThreadPool::threadIndex();
+    template <typename ScreenType>
+    RecordedSequence<FrameParams> recordTiledFrame(const std::vector<Shape*>& shapes) {
+        RecordedSequence<FrameParams> frameGraph;
+        frameGraph.addWork(recordBinBatch(shapes));
 
-                const RasterizerShaders& shaders = static_cast<const RasterizerShaders&>(shape->shaderGroup());
-                MeshData shapeMesh = shaders.shapeShader().generateMesh(*shape);
+        frameGraph.addDynamicWork([this](const FrameParams& params) {
+            ScreenType& screen = *static_cast<ScreenType*>(params.screen);
+            const Scene& scene = *params.scene;
+            auto tileLoop = parallelFor(
+                IndexRange(0, tileColumns_ * tileRows_),
+                [this, &screen, &scene](IndexRange<int> tiles) {
+                    for (int tile = tiles.begin; tile < tiles.end; ++tile) {
+                        rasterizeTile(tile, screen, scene);
+                    }
+                },
+                frameArena_);
+            tileLoop.setLabel("rasterize tiles");
+            return tileLoop;
+        });
+        return frameGraph;
+    }
 
-                meshToGlobalSpace(shapeMesh, *shape);
+    template <typename ScreenType>
+    RecordedSequence<FrameParams> recordDeferredFrame(const std::vector<Shape*>& shapes) {
+        RecordedSequence<FrameParams> frameGraph;
+        frameGraph.addWork(recordBinBatch(shapes));
 
-                MeshData culledMesh = cullBackFaceTriangles(shapeMesh, bfCuller);
-                MeshData clippedMesh = clippers[threadIndex].clip(culledMesh);
+        frameGraph.addDynamicWork([this](const FrameParams&) {
+            auto tileLoop = parallelFor(
+                IndexRange(0, tileColumns_ * tileRows_),
+                [this](IndexRange<int> tiles) {
+                    for (int tile = tiles.begin; tile < tiles.end; ++tile) {
+                        rasterizeTileToGBuffer(tile);
+                    }
+                },
+                frameArena_);
+            tileLoop.setLabel("rasterize tiles");
+            return tileLoop;
+        });
 
-                tempData->globalVertices.assign_range(clippedMesh.vertices());
+        frameGraph.addDynamicWork([this](const FrameParams& params) {
+            ScreenType& screen = *static_cast<ScreenType*>(params.screen);
+            const Scene& scene = *params.scene;
+            auto shadeLoop = parallelFor(
+                IndexRange(0, screen.height()),
+                [this, &screen, &scene](IndexRange<int> rows) {
+                    shadeRows(rows.begin, rows.size(), scene, screen.paintPixels());
+                },
+                frameArena_);
+            shadeLoop.setLabel("shade pixels");
+            return shadeLoop;
+        });
+        return frameGraph;
+    }
 
-                tempData->invertedW = verticesToScreenSpace(toScreenMatrix, clippedMesh);
-                tempData->screenMesh = std::move(clippedMesh);
-            });
+    template <typename ScreenType>
+    RecordedSequence<FrameParams> recordThreadBuffersFrame(const std::vector<Shape*>& shapes) {
+        RecordedSequence<FrameParams> frameGraph;
 
-            perShapeSteps.addDynamicWork([this, shape, tempData = tempData.get(), &scene, &screen]() {
-                TaskBatch triangleRasterBatch;
-                auto triangles = tempData->screenMesh.triangles();
-                for (auto i = 0; i < triangles.size(); i += maxTrianglesPerTask) {
-                    unsigned trianglesPerTask =
-                        std::min(static_cast<unsigned>(triangles.size() - i), maxTrianglesPerTask);
-                    auto taskTriangles = std::span(triangles.begin() + i, trianglesPerTask);
-
-                    triangleRasterBatch.addWork([this, shape, tempData, taskTriangles, &scene, &screen]() {
-                        auto threadIndex = ThreadPool::threadIndex();
-                        if (threadIndex == 0) {
-                            FragmentPainter painter(screen.paintPixels(), depthBuffers_[threadIndex], scene, *shape);
-                            rasterizeTriangles(taskTriangles, tempData->screenMesh, tempData->globalVertices,
-                                               tempData->invertedW, painter);
-                        } else {
-                            FragmentPainter painter(colorBuffers_[threadIndex - 1].paintPixels(),
-                                                    depthBuffers_[threadIndex], scene, *shape);
-                            rasterizeTriangles(taskTriangles, tempData->screenMesh, tempData->globalVertices,
-                                               tempData->invertedW, painter);
-                        }
-                    });
+        RecordedBatch<FrameParams> bufferClearBatch;
+        bufferClearBatch.setLabel("clear buffers");
+        // Workers that were parked while the buffers were created have none, they create them when they first draw
+        for (unsigned i = 0; i < threadPool_->participantCount(); ++i) {
+            bufferClearBatch.addWork([this, i]() {
+                if (ThreadBuffers* buffers = threadBuffers_.get(static_cast<ThreadPool::ThreadIndex>(i))) {
+                    buffers->clear();
                 }
-                return triangleRasterBatch;
-            });
-
-            perShapeSteps.addWork([tempData = std::move(tempData)]() {
-                // This task is just to keep the data alive until all tasks using it are done
             });
-
-            shapesBatch.addWork(std::move(perShapeSteps));
         }
-        renderSequence.addWork(std::move(shapesBatch));
+        frameGraph.addWork(std::move(bufferClearBatch));
 
-        TaskBatch colorCombineBatch;
-        for (int row = 0; row < screen.height(); row += maxRowsPerTask) {
-            unsigned rowsPerTask = std::min(static_cast<unsigned>(screen.height() - row), maxRowsPerTask);
-            colorCombineBatch.addWork([this, startRow = row, rowsPerTask, &screen]() {
-                combineColorBuffers(startRow, rowsPerTask, screen.paintPixels());
+        RecordedBatch<FrameParams> shapesBatch;
+        for (Shape* shape : shapes) {
+            shapesBatch.addDynamicWork([this, shape](const FrameParams& params) {
+                CoTask<> shapeTask = renderShape<ScreenType>(*shape, params);
+                shapeTask.setLabel("prepare shape");
+                return shapeTask;
             });
         }
-        renderSequence.addWork(std::move(colorCombineBatch));
+        frameGraph.addWork(std::move(shapesBatch));
 
-        renderSequence.startAndWait(threadPool_);
+        frameGraph.addDynamicWork([this](const FrameParams& params) {
+            ScreenType& screen = *static_cast<ScreenType*>(params.screen);
+            auto combineLoop = parallelFor(
+                IndexRange(0, screen.height()),
+                [this, &screen](IndexRange<int> rows) {
+                    combineColorBuffers(rows.begin, rows.size(), screen.paintPixels());
+                },
+                frameArena_);
+            combineLoop.setLabel("combine buffers");
+            return combineLoop;
+        });
+        return frameGraph;
     }
 
-private:
-    struct ShapeTempData {
-        std::vector<Point> globalVertices;
-        std::vector<float> invertedW;
-        MeshData screenMesh;
-    };
+    // The shape's meshes only live in the coroutine frame, which stays alive while its triangles are rasterized
+    template <typename ScreenType>
+    CoTask<> renderShape(Shape& shape, FrameParams params) {
+        ScreenGeometry geometry = toScreenGeometry(shape, params);
 
+        Scene& scene = *params.scene;
+        ScreenType& screen = *static_cast<ScreenType*>(params.screen);
+        auto triangles = geometry.mesh.triangles();
+        auto rasterizeLoop = parallelFor(
+            IndexRange<size_t>(0, triangles.size()),
+            [this, &shape, triangles, &geometry, &scene, &screen](IndexRange<size_t> range) {
+                auto taskTriangles = triangles.subspan(range.begin, range.size());
+                ThreadBuffers& buffers = threadBuffers_.local();
+                if (!buffers.color.has_value()) {
+                    FragmentPainter painter(screen.paintPixels(), buffers.depth, scene, shape, occlusionCulling_,
+                                            false);
+                    rasterizeTriangles(taskTriangles, geometry, painter);
+                } else {
+                    FragmentPainter painter(buffers.color->paintPixels(), buffers.depth, scene, shape,
+                                            occlusionCulling_, false);
+                    rasterizeTriangles(taskTriangles, geometry, painter);
+                }
+            },
+            frameArena_);
+        rasterizeLoop.setLabel("rasterize triangles");
+        co_await std::move(rasterizeLoop);
+    }
+
+    static Color shadeFragment(const Scene& scene, const Shape& shape, const glm::vec3& normal, const Point& pos3d) {
+        glm::vec3 unitViewDir = glm::normalize(scene.camera().position() - pos3d);
+        Color pixelColor;
+        for (const auto& light : scene.lights()) {
+            auto lightDistance = light->distanceFrom(pos3d);
+            Color reflectedLight = shape.material().reflect(normal, unitViewDir, lightDistance.unitDirection);
+            pixelColor += reflectedLight * light->illuminate(pos3d, normal);
+        }
+        pixelColor += scene.ambientLight() * shape.ambientReflectance();
+        return pixelColor;
+    }
+
+    // Fragments are painted at their screen position minus the origin, so a buffer can cover just part of the screen.
+    // After a depth pre-pass, only fragments at the depth it left are painted.
     template <PixelPainter Painter>
     class FragmentPainter {
     public:
-        FragmentPainter(Painter&& painter, DepthBuffer& depthBuffer, const Scene& scene, const Shape& shape)
-            : painter_(std::move(painter)), depthBuffer_(depthBuffer), scene_(scene), shape_(shape) {}
+        FragmentPainter(Painter&& painter, DepthBuffer& depthBuffer, const Scene& scene, const Shape& shape,
+                        bool occlusionCulling, bool afterDepthPrepass, int originX = 0, int originY = 0)
+            : painter_(std::move(painter)), depthBuffer_(depthBuffer), scene_(scene), shape_(shape),
+              occlusionCulling_(occlusionCulling), afterDepthPrepass_(afterDepthPrepass), originX_(originX),
+              originY_(originY) {}
         void paintFragment(const FragmentData& frag) {
-            bool shouldPaint = depthBuffer_.updateIfNearer(frag.x, frag.y, frag.z);
+            int x = frag.x - originX_;
+            int y = frag.y - originY_;
+            bool shouldPaint = afterDepthPrepass_ ? depthBuffer_.claimIfEqual(x, y, frag.z)
+                                                  : depthBuffer_.updateIfNearer(x, y, frag.z);
             if (!shouldPaint) {
                 return;
             }
-            glm::vec3 unitViewDir = glm::normalize(scene_.camera().position() - frag.pos3d);
-            Color pixelColor;
-            for (const auto& light : scene_.lights()) {
-                auto lightDistance = light->distanceFrom(frag.pos3d);
-                Color reflectedLight = shape_.material().reflect(frag.normal, unitViewDir, lightDistance.unitDirection);
-                pixelColor += reflectedLight * light->illuminate(frag.pos3d, frag.normal);
-            }
-            pixelColor += scene_.ambientLight() * shape_.ambientReflectance();
-            painter_.paint(frag.y, frag.x, pixelColor);
+            painter_.paint(y, x, shadeFragment(scene_, shape_, frag.normal, frag.pos3d));
+        }
+        bool isOccluded(const PixelRect& rect, float depth) const {
+            return occlusionCulling_ &&
+                   depthBuffer_.isOccluded(PixelRect{rect.minX - originX_, rect.minY - originY_, rect.maxX - originX_,
+                                                     rect.maxY - originY_},
+                                           depth);
         }
         int width() { return painter_.width(); }
         int height() { return painter_.height(); }
@@ -150,61 +328,243 @@ private:
         DepthBuffer& depthBuffer_;
         const Scene& scene_;
         const Shape& shape_;
+        bool occlusionCulling_;
+        bool afterDepthPrepass_;
+        int originX_;
+        int originY_;
     };
 
+    // Only fills the depth buffer of a tile, for the depth pre-pass
+    class DepthPainter {
+    public:
+        static constexpr bool depthOnly = true;
+
+        DepthPainter(DepthBuffer& depthBuffer, bool occlusionCulling, int originX, int originY)
+            : depthBuffer_(depthBuffer), occlusionCulling_(occlusionCulling), originX_(originX), originY_(originY) {}
+        void paintFragment(const FragmentData& frag) {
+            depthBuffer_.updateIfNearer(frag.x - originX_, frag.y - originY_, frag.z);
+        }
+        bool isOccluded(const PixelRect& rect, float depth) const {
+            return occlusionCulling_ &&
+                   depthBuffer_.isOccluded(PixelRect{rect.minX - originX_, rect.minY - originY_, rect.maxX - originX_,
+                                                     rect.maxY - originY_},
+                                           depth);
+        }
+        int width() { return depthBuffer_.width(); }
+        int height() { return depthBuffer_.height(); }
+
+    private:
+        DepthBuffer& depthBuffer_;
+        bool occlusionCulling_;
+        int originX_;
+        int originY_;
+    };
+
+    // Keeps the nearest fragment of every pixel in the GBuffer, for Mode::Deferred
+    class GBufferPainter {
+    public:
+        GBufferPainter(GBuffer& gBuffer, uint32_t shapeIndex, bool occlusionCulling)
+            : gBuffer_(gBuffer), shapeIndex_(shapeIndex), occlusionCulling_(occlusionCulling) {}
+        void paintFragment(const FragmentData& frag) {
+            gBuffer_.updateIfNearer(frag.x, frag.y, frag.z, frag.normal, frag.pos3d, shapeIndex_);
+        }
+        bool isOccluded(const PixelRect& rect, float depth) const {
+            return occlusionCulling_ && gBuffer_.depth().isOccluded(rect, depth);
+        }
+        int width() { return gBuffer_.width(); }
+        int height() { return gBuffer_.height(); }
+
+    private:
+        GBuffer& gBuffer_;
+        uint32_t shapeIndex_;
+        bool occlusionCulling_;
+    };
+
+    // Thread 0 paints to the screen directly, so only the other threads have a color buffer
+    struct ThreadBuffers {
+        DepthBuffer depth;
+        std::optional<MemoryColorBuffer> color;
+
+        void clear();
+    };
+
+    // Buffers one thread rasterizes a tile into, tile sized whatever the screen size
+    struct TileBuffers {
+        DepthBuffer depth{tileSize, tileSize};
+        MemoryColorBuffer color{tileSize, tileSize};
+    };
+
+    ThreadBuffers createThreadBuffers(ThreadPool::ThreadIndex threadIndex) const;
     void prepareBuffers(int width, int height);
+    ScreenGeometry toScreenGeometry(Shape& shape, const FrameParams& params);
+    void binShape(Shape& shape, const FrameParams& params, BinnedShape& binned);
+    PixelRect tileRect(int tile) const;
     void meshToGlobalSpace(MeshData& mesh, const Shape& shape);
     MeshData cullBackFaceTriangles(MeshData& mesh, const BackFaceCuller& culler);
     std::vector<float> verticesToScreenSpace(const glm::mat4& toScreenMatrix, MeshData& mesh);
 
+    template <typename Painter>
+    OcclusionCounters rasterizeTriangle(const TriangleData& triangle, const ScreenGeometry& geometry,
+                                        Painter& fragPainter, const PixelRect& clipRect) {
+        const auto& vertices = geometry.mesh.vertices();
+        const auto& normals = geometry.mesh.vertexNormals();
+        const auto& globalVertices = geometry.globalVertices;
+        const auto& invertedW = geometry.invertedW;
+        return TriangleRasterizer::rasterize(
+            {vertices[triangle[0].vertex], vertices[triangle[1].vertex], vertices[triangle[2].vertex]},
+            {globalVertices[triangle[0].vertex], globalVertices[triangle[1].vertex],
+             globalVertices[triangle[2].vertex]},
+            {normals[triangle[0].vertexNormal], normals[triangle[1].vertexNormal], normals[triangle[2].vertexNormal]},
+            {invertedW[triangle[0].vertex], invertedW[triangle[1].vertex], invertedW[triangle[2].vertex]},
+            fragPainter, clipRect);
+    }
+
     template <PixelPainter Painter>
-    void rasterizeTriangles(std::span<const TriangleData> triangles, const MeshData& mesh,
-                            const std::vector<Point>& globalVertices, std::vector<float> invertedW,
+    void rasterizeTriangles(std::span<const TriangleData> triangles, const ScreenGeometry& geometry,
                             FragmentPainter<Painter>& fragPainter) {
-        const auto& vertices = mesh.vertices();
-        const auto& normals = mesh.vertexNormals();
-
+        PixelRect screenRect{0, 0, fragPainter.width(), fragPainter.height()};
+        OcclusionCounters counters;
         for (const auto& triangle : triangles) {
-            TriangleRasterizer::rasterize(
-                {vertices[triangle[0].vertex], vertices[triangle[1].vertex], vertices[triangle[2].vertex]},
-                {globalVertices[triangle[0].vertex], globalVertices[triangle[1].vertex],
-                 globalVertices[triangle[2].vertex]},
-                {normals[triangle[0].vertexNormal], normals[triangle[1].vertexNormal],
-                 normals[triangle[2].vertexNormal]},
-                {invertedW[triangle[0].vertex], invertedW[triangle[1].vertex], invertedW[triangle[2].vertex]},
-                fragPainter);
+            counters += rasterizeTriangle(triangle, geometry, fragPainter, screenRect);
+        }
+        threadOcclusionCounters_.local() += counters;
+    }
+
+    template <typename Painter>
+    OcclusionCounters rasterizeBinnedTriangles(const BinnedShape& binned, int tile, Painter& fragPainter,
+                                               const PixelRect& clipRect) {
+        OcclusionCounters counters;
+        auto triangles = binned.geometry.mesh.triangles();
+        for (uint32_t triangleIndex : binned.tileTriangles[tile]) {
+            counters += rasterizeTriangle(triangles[triangleIndex], binned.geometry, fragPainter, clipRect);
+        }
+        return counters;
+    }
+
+    // Rasterizes the binned triangles of every shape, in shape order, into this thread's tile buffers, then writes the
+    // covered pixels to the screen. Tiles don't overlap, so no other thread touches these pixels.
+    template <typename ScreenType>
+    void rasterizeTile(int tile, ScreenType& screen, const Scene& scene) {
+        PixelRect rect = tileRect(tile);
+        TileBuffers& buffers = tileBuffers_.local();
+        // Color is only read where depth was written, so it doesn't need clearing
+        buffers.depth.clear();
+        OcclusionCounters counters;
+        if (depthPrepass_) {
+            DepthPainter depthPainter(buffers.depth, occlusionCulling_, rect.minX, rect.minY);
+            for (const BinnedShape& binned : binnedShapes_) {
+                counters += rasterizeBinnedTriangles(binned, tile, depthPainter, rect);
+            }
+        }
+        for (size_t i = 0; i < binnedShapes_.size(); ++i) {
+            if (binnedShapes_[i].tileTriangles[tile].empty()) {
+                continue;
+            }
+            FragmentPainter painter(buffers.color.paintPixels(), buffers.depth, scene, *recordedShapes_[i],
+                                    occlusionCulling_, depthPrepass_, rect.minX, rect.minY);
+            counters += rasterizeBinnedTriangles(binnedShapes_[i], tile, painter, rect);
+        }
+        threadOcclusionCounters_.local() += counters;
+
+        auto screenPainter = screen.paintPixels();
+        for (int row = rect.minY; row < rect.maxY; ++row) {
+            for (int col = rect.minX; col < rect.maxX; ++col) {
+                if (buffers.depth.depthAtPixel(col - rect.minX, row - rect.minY) != DepthBuffer::farthest) {
+                    screenPainter.paint(row, col, buffers.color.colorAtPixel(row - rect.minY, col - rect.minX));
+                }
+            }
+        }
+    }
+
+    // Tiles don't overlap, so threads write to separate parts of the GBuffer, coarse depth tiles included
+    void rasterizeTileToGBuffer(int tile) {
+        PixelRect rect = tileRect(tile);
+        gBuffer_->clear(rect);
+        OcclusionCounters counters;
+        for (size_t i = 0; i < binnedShapes_.size(); ++i) {
+            GBufferPainter painter(*gBuffer_, static_cast<uint32_t>(i), occlusionCulling_);
+            counters += rasterizeBinnedTriangles(binnedShapes_[i], tile, painter, rect);
+        }
+        threadOcclusionCounters_.local() += counters;
+    }
+
+    template <PixelPainter Painter>
+    void shadeRows(int startRow, int rowCount, const Scene& scene, Painter painter) {
+        for (int row = startRow; row < startRow + rowCount; ++row) {
+            for (int col = 0; col < gBuffer_->width(); ++col) {
+                uint32_t shapeIndex = gBuffer_->shapeAtPixel(col, row);
+                if (shapeIndex != GBuffer::noShape) {
+                    painter.paint(row, col,
+                                  shadeFragment(scene, *recordedShapes_[shapeIndex], gBuffer_->normalAtPixel(col, row),
+                                                gBuffer_->positionAtPixel(col, row)));
+                }
+            }
         }
     }
 
     template <PixelPainter Painter>
     void combineColorBuffers(int startRow, int rowCount, Painter painter) {
+        // Threads that never drew this frame may not have buffers, e.g. workers that were parked
+        std::vector<ThreadBuffers*> buffers;
+        for (unsigned i = 0; i < threadPool_->participantCount(); ++i) {
+            if (ThreadBuffers* threadBuffers = threadBuffers_.get(static_cast<ThreadPool::ThreadIndex>(i))) {
+                buffers.push_back(threadBuffers);
+            }
+        }
         for (int row = startRow; row < startRow + rowCount; ++row) {
             for (int col = 0; col < painter.width(); ++col) {
-                int pixelIndex = row * painter.width() + col;
-                int indexOfNearest = 0;
-                float nearestDepth = depthBuffers_[indexOfNearest].depthAtPixel(col, row);
-                for (int i = 1; i < depthBuffers_.size(); ++i) {
-                    float currBufferDepth = depthBuffers_[i].depthAtPixel(col, row);
+                ThreadBuffers* nearest = nullptr;
+                float nearestDepth = DepthBuffer::farthest;
+                for (ThreadBuffers* threadBuffers : buffers) {
+                    float currBufferDepth = threadBuffers->depth.depthAtPixel(col, row);
                     if (currBufferDepth > nearestDepth) {
                         nearestDepth = currBufferDepth;
-                        indexOfNearest = i;
+                        nearest = threadBuffers;
                     }
                 }
-                // Write something to output only if thread index of nearest wasn't 0, since that's the thread that was
+                // Write something to output only if the nearest wasn't thread 0's, since that's the thread that was
                 // writing to the target buffer.
-                if (indexOfNearest != 0) {
-                    painter.paint(row, col, colorBuffers_[indexOfNearest - 1].colorAtPixel(row, col));
+                if (nearest != nullptr && nearest->color.has_value()) {
+                    painter.paint(row, col, nearest->color->colorAtPixel(row, col));
                 }
             }
         }
     }
 
-    static constexpr unsigned maxTrianglesPerTask = 3;
-    static constexpr unsigned maxRowsPerTask = 20;
+    // Declared before the pool, so it outlives tasks the pool is still finishing
+    TaskArena frameArena_;
+    // Only set if the renderer was given options for a pool of its own
+    std::unique_ptr<ThreadPool> ownedPool_;
+    ThreadPool* threadPool_;
+    Mode mode_ = Mode::Tiled;
+    int bufferWidth_ = 0;
+    int bufferHeight_ = 0;
+    Mode bufferMode_ = Mode::Tiled;
+    WorkerLocal<ThreadBuffers> threadBuffers_{*threadPool_, [this](ThreadPool::ThreadIndex threadIndex) {
+                                                  return createThreadBuffers(threadIndex);
+                                              }};
+    int tileColumns_ = 0;
+    int tileRows_ = 0;
+    WorkerLocal<TileBuffers> tileBuffers_{*threadPool_};
+    // Only in Mode::Deferred
+    std::optional<GBuffer> gBuffer_;
+    std::vector<BinnedShape> binnedShapes_;
+    bool occlusionCulling_ = true;
+    bool depthPrepass_ = false;
+    WorkerLocal<OcclusionCounters> threadOcclusionCounters_{*threadPool_};
+    // Set at the start of every frame
+    std::optional<FrustumIntersect> frustumIntersect_;
+    WorkerLocal<Clipper> clippers_{*threadPool_, [this]() {
+                                       return Clipper(*frustumIntersect_,
+                                                      FrustumIntersect::Near | FrustumIntersect::Far);
+                                   }};
+    OcclusionCounters occlusionCounters_;
 
-    ThreadPool threadPool_;
-    std::vector<MemoryColorBuffer> colorBuffers_;
-    std::vector<DepthBuffer> depthBuffers_;
+    RecordedSequence<FrameParams> frameGraph_;
+    std::vector<Shape*> recordedShapes_;
+    // Compared by value, type_info addresses can differ for the same type across shared libraries
+    std::type_index recordedScreenType_ = typeid(void);
+    Mode recordedMode_ = Mode::Tiled;
 };
 
 static_assert(Renderer<RasterizerRendererParallel>,
@@ -2,13 +2,19 @@
 
 #include "core/BasicTypes.h"
 #include "core/LineEquation2d.h"
+#include "rasterizer/Float4.h"
+#include "rasterizer/PixelRect.h"
 
 #include "glm/geometric.hpp"
 
 #include <algorithm>
 #include <array>
+#include <bit>
+#include <cmath>
 #include <concepts>
+#include <cstdint>
 #include <functional>
+#include <limits>
 
 namespace cg {
 struct FragmentData {
@@ -26,77 +32,333 @@ concept FragmentPainter = requires(T painter, const FragmentData& fragmentData)
     { painter.height() } -> std::convertible_to<int>;
 };
 
+// A painter that knows the depth it already holds, so the rasterizer can skip triangles and pixel blocks that would
+// lose every depth test. isOccluded(rect, depth) has to return true only if no fragment up to `depth` would be painted
+// anywhere in `rect`.
+template <typename T>
+concept OccludingPainter = FragmentPainter<T> && requires(T painter, const PixelRect& rect, float depth) {
+    { painter.isOccluded(rect, depth) } -> std::same_as<bool>;
+};
+
+// A painter that only needs the position and depth of fragments, e.g. for a depth pre-pass. The normal and pos3d of
+// the fragments it gets aren't interpolated. Depths are computed the same way as for other painters, so they can be
+// compared for equality later.
+template <typename T>
+concept DepthOnlyPainter = FragmentPainter<T> && requires { requires T::depthOnly; };
+
+// What rasterize() skipped because the painter reported it occluded
+struct OcclusionCounters {
+    uint64_t trianglesRejected = 0;
+    uint64_t blocksRejected = 0;
+
+    OcclusionCounters& operator+=(const OcclusionCounters& other) {
+        trianglesRejected += other.trianglesRejected;
+        blocksRejected += other.blocksRejected;
+        return *this;
+    }
+};
+
 class TriangleRasterizer {
 public:
+    // Side of the square pixel blocks rasterize() tests at once
+    static constexpr int blockSize = 4;
+
     TriangleRasterizer() = delete;
 
     template <FragmentPainter Painter>
-    static void rasterize(std::array<std::reference_wrapper<const Point>, 3> homogenizedScreenPoints,
-                          std::array<std::reference_wrapper<const glm::vec3>, 3> pos3ds,
-                          std::array<std::reference_wrapper<const glm::vec3>, 3> normals,
-                          const std::array<float, 3>& invertedW, Painter& fragmentPainter) {
-        const Point& p1 = homogenizedScreenPoints[0];
-        const Point& p2 = homogenizedScreenPoints[1];
-        const Point& p3 = homogenizedScreenPoints[2];
-        glm::vec3 dividedN1 = normals[0].get() * invertedW[0];
-        glm::vec3 dividedN2 = normals[1].get() * invertedW[1];
-        glm::vec3 dividedN3 = normals[2].get() * invertedW[2];
-
-        int minX = std::max(static_cast<int>(std::min({p1.x, p2.x, p3.x})), 0);
-        int maxX = std::min(static_cast<int>(std::max({p1.x, p2.x, p3.x})) + 1, fragmentPainter.width());
-        int minY = std::max(static_cast<int>(std::min({p1.y, p2.y, p3.y})), 0);
-        int maxY = std::min(static_cast<int>(std::max({p1.y, p2.y, p3.y})) + 1, fragmentPainter.height());
-
-        LineEquation2d line12(p1, p2);
-        LineEquation2d line23(p2, p3);
-        LineEquation2d line31(p3, p1);
-
-        float fAlpha = line23.eval(p1);
-        float fBeta = line31.eval(p2);
-        float fGamma = line12.eval(p3);
-
-        // TODO: test incremental algorithm
-        for (int y = minY; y < maxY; ++y) {
-            for (int x = minX; x < maxX; ++x) {
+    static OcclusionCounters rasterize(std::array<std::reference_wrapper<const Point>, 3> homogenizedScreenPoints,
+                                       std::array<std::reference_wrapper<const glm::vec3>, 3> pos3ds,
+                                       std::array<std::reference_wrapper<const glm::vec3>, 3> normals,
+                                       const std::array<float, 3>& invertedW, Painter& fragmentPainter) {
+        return rasterize(homogenizedScreenPoints, pos3ds, normals, invertedW, fragmentPainter,
+                         PixelRect{0, 0, fragmentPainter.width(), fragmentPainter.height()});
+    }
+
+    // Only pixels inside `clipRect` are painted, e.g. to rasterize one screen tile at a time.
+    //
+    // The bounding box is walked in blocks of blockSize x blockSize pixels. Blocks that are outside one of the edges,
+    // judging by their corners, are skipped, and blocks inside all of them are painted without testing each pixel.
+    // Other blocks test a row of pixels at a time with Float4. Edge values are evaluated from the line equation for
+    // every pixel rather than accumulated from step to step, so they are bit for bit those of rasterizePerPixel(), and
+    // two triangles sharing an edge still never both paint a pixel on it. Triangles no larger than 2x2 blocks skip the
+    // block setup and test each pixel.
+    //
+    // With an OccludingPainter, the triangle is first tested as a whole against the depth in its bounding box, then
+    // every block it touches. Depths are compared with room for float error, so nothing that would have been painted is
+    // skipped.
+    template <FragmentPainter Painter>
+    static OcclusionCounters rasterize(std::array<std::reference_wrapper<const Point>, 3> homogenizedScreenPoints,
+                                       std::array<std::reference_wrapper<const glm::vec3>, 3> pos3ds,
+                                       std::array<std::reference_wrapper<const glm::vec3>, 3> normals,
+                                       const std::array<float, 3>& invertedW, Painter& fragmentPainter,
+                                       const PixelRect& clipRect) {
+        OcclusionCounters counters;
+        Triangle triangle(homogenizedScreenPoints, pos3ds, normals, invertedW);
+        PixelRect bounds = pixelBounds(triangle.p1, triangle.p2, triangle.p3, clipRect);
+        if (bounds.empty()) {
+            return counters;
+        }
+        float depthError = 0;
+        float nearestDepth = 0;
+        if constexpr (OccludingPainter<Painter>) {
+            depthError = depthErrorBound(triangle, bounds);
+            nearestDepth = std::max({triangle.p1.z, triangle.p2.z, triangle.p3.z}) + depthError;
+            if (fragmentPainter.isOccluded(bounds, nearestDepth)) {
+                ++counters.trianglesRejected;
+                return counters;
+            }
+        }
+        // Setting up the edges costs more than it saves on a few pixels
+        if (bounds.maxX - bounds.minX <= 2 * blockSize && bounds.maxY - bounds.minY <= 2 * blockSize) {
+            rasterizePixels(triangle, bounds, fragmentPainter);
+            return counters;
+        }
+
+        // In the order of the barycentric coordinate they give: alpha, beta, gamma
+        std::array<Edge, 3> edges = {Edge(triangle.line23, triangle.inverseFAlpha, bounds),
+                                     Edge(triangle.line31, triangle.inverseFBeta, bounds),
+                                     Edge(triangle.line12, triangle.inverseFGamma, bounds)};
+        // Blocks are aligned to multiples of blockSize, so each one falls in a single tile of a coarse depth buffer
+        for (int blockY = bounds.minY - bounds.minY % blockSize; blockY < bounds.maxY; blockY += blockSize) {
+            for (int blockX = bounds.minX - bounds.minX % blockSize; blockX < bounds.maxX; blockX += blockSize) {
+                BlockCoverage coverage = classifyBlock(edges, blockX, blockY);
+                if (coverage == BlockCoverage::Outside) {
+                    continue;
+                }
+                PixelRect blockRect{std::max(blockX, bounds.minX), std::max(blockY, bounds.minY),
+                                    std::min(blockX + blockSize, bounds.maxX),
+                                    std::min(blockY + blockSize, bounds.maxY)};
+                if constexpr (OccludingPainter<Painter>) {
+                    float blockNearestDepth = nearestDepthInBlock(triangle, edges, blockX, blockY, depthError);
+                    if (fragmentPainter.isOccluded(blockRect, std::min(blockNearestDepth, nearestDepth))) {
+                        ++counters.blocksRejected;
+                        continue;
+                    }
+                }
+                Float4::Mask columnsInBounds = Float4::Mask::fromBits(((1u << (blockRect.maxX - blockX)) - 1) &
+                                                                      ~((1u << (blockRect.minX - blockX)) - 1));
+                Float4 xs(static_cast<float>(blockX), static_cast<float>(blockX + 1), static_cast<float>(blockX + 2),
+                          static_cast<float>(blockX + 3));
+                for (int y = blockRect.minY; y < blockRect.maxY; ++y) {
+                    float fpy = static_cast<float>(y);
+                    Float4 alpha = edges[0].barycentric(xs, fpy);
+                    Float4 beta = edges[1].barycentric(xs, fpy);
+                    Float4 gamma = edges[2].barycentric(xs, fpy);
+                    Float4::Mask covered = columnsInBounds;
+                    if (coverage == BlockCoverage::Partial) {
+                        covered = covered & edges[0].covers(alpha) & edges[1].covers(beta) & edges[2].covers(gamma);
+                    }
+                    if (covered.bits() == 0) {
+                        continue;
+                    }
+                    std::array<float, 4> alphas = alpha.toArray();
+                    std::array<float, 4> betas = beta.toArray();
+                    std::array<float, 4> gammas = gamma.toArray();
+                    for (unsigned lanes = covered.bits(); lanes != 0; lanes &= lanes - 1) {
+                        int lane = std::countr_zero(lanes);
+                        paintFragment(triangle, blockX + lane, y, alphas[lane], betas[lane], gammas[lane],
+                                      fragmentPainter);
+                    }
+                }
+            }
+        }
+        return counters;
+    }
+
+    // Tests every pixel of the bounding box on its own. Paints the same fragments as rasterize(), it's kept as the
+    // reference rasterize() is tested and benchmarked against.
+    template <FragmentPainter Painter>
+    static void rasterizePerPixel(std::array<std::reference_wrapper<const Point>, 3> homogenizedScreenPoints,
+                                  std::array<std::reference_wrapper<const glm::vec3>, 3> pos3ds,
+                                  std::array<std::reference_wrapper<const glm::vec3>, 3> normals,
+                                  const std::array<float, 3>& invertedW, Painter& fragmentPainter,
+                                  const PixelRect& clipRect) {
+        Triangle triangle(homogenizedScreenPoints, pos3ds, normals, invertedW);
+        rasterizePixels(triangle, pixelBounds(triangle.p1, triangle.p2, triangle.p3, clipRect), fragmentPainter);
+    }
+
+    // Pixels the triangle can cover within `clipRect`, the same ones rasterize() visits
+    static PixelRect pixelBounds(const Point& p1, const Point& p2, const Point& p3, const PixelRect& clipRect) {
+        return PixelRect{std::max(static_cast<int>(std::min({p1.x, p2.x, p3.x})), clipRect.minX),
+                         std::max(static_cast<int>(std::min({p1.y, p2.y, p3.y})), clipRect.minY),
+                         std::min(static_cast<int>(std::max({p1.x, p2.x, p3.x})) + 1, clipRect.maxX),
+                         std::min(static_cast<int>(std::max({p1.y, p2.y, p3.y})) + 1, clipRect.maxY)};
+    }
+
+private:
+    // Everything about the triangle that is the same for all of its pixels
+    struct Triangle {
+        Triangle(std::array<std::reference_wrapper<const Point>, 3> homogenizedScreenPoints,
+                 std::array<std::reference_wrapper<const glm::vec3>, 3> pos3ds_,
+                 std::array<std::reference_wrapper<const glm::vec3>, 3> normals,
+                 const std::array<float, 3>& invertedW_)
+            : p1(homogenizedScreenPoints[0]), p2(homogenizedScreenPoints[1]), p3(homogenizedScreenPoints[2]),
+              pos3ds(pos3ds_), invertedW(invertedW_), dividedN1(normals[0].get() * invertedW[0]),
+              dividedN2(normals[1].get() * invertedW[1]), dividedN3(normals[2].get() * invertedW[2]), line12(p1, p2),
+              line23(p2, p3), line31(p3, p1), inverseFAlpha(1 / line23.eval(p1)),
+              inverseFBeta(1 / line31.eval(p2)), inverseFGamma(1 / line12.eval(p3)) {}
+
+        const Point& p1;
+        const Point& p2;
+        const Point& p3;
+        std::array<std::reference_wrapper<const glm::vec3>, 3> pos3ds;
+        const std::array<float, 3>& invertedW;
+        glm::vec3 dividedN1;
+        glm::vec3 dividedN2;
+        glm::vec3 dividedN3;
+        LineEquation2d line12;
+        LineEquation2d line23;
+        LineEquation2d line31;
+        // Inverse of the edge value at the opposite vertex, multiplying by it gives the barycentric coordinate
+        float inverseFAlpha;
+        float inverseFBeta;
+        float inverseFGamma;
+    };
+
+    // Tests the pixels of `bounds` one by one
+    template <FragmentPainter Painter>
+    static void rasterizePixels(const Triangle& triangle, const PixelRect& bounds, Painter& fragmentPainter) {
+        for (int y = bounds.minY; y < bounds.maxY; ++y) {
+            for (int x = bounds.minX; x < bounds.maxX; ++x) {
                 float fpx = static_cast<float>(x);
                 float fpy = static_cast<float>(y);
 
-                float alpha = line23.eval(fpx, fpy) / fAlpha;
+                float alpha = triangle.line23.eval(fpx, fpy) * triangle.inverseFAlpha;
                 // Checks for alpha, beta and gamma below are intentionally formed like this instead of alpha < 0 so NaN
                 // values would fail the check as well
                 if (!(alpha >= 0)) {
                     continue;
                 }
-                float beta = line31.eval(fpx, fpy) / fBeta;
+                float beta = triangle.line31.eval(fpx, fpy) * triangle.inverseFBeta;
                 if (!(beta >= 0)) {
                     continue;
                 }
-                float gamma = line12.eval(fpx, fpy) / fGamma;
+                float gamma = triangle.line12.eval(fpx, fpy) * triangle.inverseFGamma;
                 if (!(gamma >= 0)) {
                     continue;
                 }
 
-                if ((alpha > 0 || shouldDrawWhenOnEdge(line23)) && (beta > 0 || shouldDrawWhenOnEdge(line31)) &&
-                    (gamma > 0 || shouldDrawWhenOnEdge(line12))) {
-                    FragmentData fragmentData;
-                    fragmentData.x = x;
-                    fragmentData.y = y;
-                    float fragInvW = alpha * invertedW[0] + beta * invertedW[1] + gamma * invertedW[2];
-                    fragmentData.pos3d =
-                        (alpha * invertedW[0] * pos3ds[0].get() + beta * invertedW[1] * pos3ds[1].get() +
-                         gamma * invertedW[2] * pos3ds[2].get()) /
-                        fragInvW;
-                    fragmentData.z = alpha * p1.z + beta * p2.z + gamma * p3.z;
-                    fragmentData.normal =
-                        glm::normalize((alpha * dividedN1 + beta * dividedN2 + gamma * dividedN3) / fragInvW);
-
-                    fragmentPainter.paintFragment(fragmentData);
+                if ((alpha > 0 || shouldDrawWhenOnEdge(triangle.line23)) &&
+                    (beta > 0 || shouldDrawWhenOnEdge(triangle.line31)) &&
+                    (gamma > 0 || shouldDrawWhenOnEdge(triangle.line12))) {
+                    paintFragment(triangle, x, y, alpha, beta, gamma, fragmentPainter);
                 }
             }
         }
     }
 
-private:
+    enum class BlockCoverage : uint8_t { Outside, Partial, Inside };
+
+    // One edge of the triangle, set up to give the barycentric coordinate of the vertex opposite to it
+    struct Edge {
+        // Block corners have to be farther than the float error from the edge to decide for the whole block, so every
+        // pixel of it would get the same answer
+        Edge(const LineEquation2d& line_, float inverseOppositeValue_, const PixelRect& bounds)
+            : line(line_), inverseOppositeValue(inverseOppositeValue_), drawOnEdge(shouldDrawWhenOnEdge(line_)),
+              blockMargin(barycentricErrorBound(line_, inverseOppositeValue_, bounds)) {}
+
+        // Same operations in the same order as LineEquation2d::eval(), so lanes match the scalar values exactly
+        Float4 barycentric(Float4 xs, float y) const {
+            return (Float4(line.a()) * xs + Float4(line.b() * y) + Float4(line.c())) * Float4(inverseOppositeValue);
+        }
+        Float4 barycentric(Float4 xs, Float4 ys) const {
+            return (Float4(line.a()) * xs + Float4(line.b()) * ys + Float4(line.c())) * Float4(inverseOppositeValue);
+        }
+        // Pixels on the edge itself only belong to the triangle if the fill rule says so
+        Float4::Mask covers(Float4 barycentric) const {
+            return drawOnEdge ? barycentric >= Float4(0.0f) : barycentric > Float4(0.0f);
+        }
+
+        LineEquation2d line;
+        float inverseOppositeValue;
+        bool drawOnEdge;
+        float blockMargin;
+    };
+    // Relative to the largest term of an edge value, far above float rounding error
+    static constexpr float blockMarginScale = 1e-5f;
+    // Added to every depth bound, for the rounding of the depth interpolation itself
+    static constexpr float depthMargin = 1e-5f;
+
+    // Float error of an edge value is a few ulps of its largest term. Bounds, with a wide margin, how far the
+    // barycentric coordinate it gives can be off for pixels in or next to `bounds`.
+    static float barycentricErrorBound(const LineEquation2d& line, float inverseOppositeValue,
+                                       const PixelRect& bounds) {
+        float largestTerms = std::abs(line.a()) * static_cast<float>(bounds.maxX + blockSize) +
+                             std::abs(line.b()) * static_cast<float>(bounds.maxY + blockSize) + std::abs(line.c());
+        return largestTerms * std::abs(inverseOppositeValue) * blockMarginScale;
+    }
+
+    // How far an interpolated depth can be off. Infinite or NaN for degenerate triangles, which then never count as
+    // occluded.
+    static float depthErrorBound(const Triangle& triangle, const PixelRect& bounds) {
+        float barycentricError = barycentricErrorBound(triangle.line23, triangle.inverseFAlpha, bounds) +
+                                 barycentricErrorBound(triangle.line31, triangle.inverseFBeta, bounds) +
+                                 barycentricErrorBound(triangle.line12, triangle.inverseFGamma, bounds);
+        float largestDepth = std::max({std::abs(triangle.p1.z), std::abs(triangle.p2.z), std::abs(triangle.p3.z)});
+        // Twice the bound, since a depth is compared against another interpolated one, or the triangle's vertices
+        return 2 * (barycentricError * largestDepth + depthMargin);
+    }
+
+    // Nearest depth the triangle can have in the block. Depth is linear over the screen, so it's largest at one of the
+    // block's corners.
+    static float nearestDepthInBlock(const Triangle& triangle, const std::array<Edge, 3>& edges, int blockX, int blockY,
+                                     float depthError) {
+        Float4 cornerXs(static_cast<float>(blockX), static_cast<float>(blockX + blockSize - 1),
+                        static_cast<float>(blockX), static_cast<float>(blockX + blockSize - 1));
+        Float4 cornerYs(static_cast<float>(blockY), static_cast<float>(blockY),
+                        static_cast<float>(blockY + blockSize - 1), static_cast<float>(blockY + blockSize - 1));
+        Float4 depths = edges[0].barycentric(cornerXs, cornerYs) * Float4(triangle.p1.z) +
+                        edges[1].barycentric(cornerXs, cornerYs) * Float4(triangle.p2.z) +
+                        edges[2].barycentric(cornerXs, cornerYs) * Float4(triangle.p3.z);
+        std::array<float, 4> cornerDepths = depths.toArray();
+        float nearest = std::max({cornerDepths[0], cornerDepths[1], cornerDepths[2], cornerDepths[3]}) + depthError;
+        // NaN corners would be dropped by std::max
+        return (depths < Float4(std::numeric_limits<float>::infinity())).all() ? nearest
+                                                                               : std::numeric_limits<float>::infinity();
+    }
+
+    // Degenerate triangles give infinite or NaN margins and values, which makes every block Partial, so they are left
+    // to the per-pixel tests
+    static BlockCoverage classifyBlock(const std::array<Edge, 3>& edges, int blockX, int blockY) {
+        Float4 cornerXs(static_cast<float>(blockX), static_cast<float>(blockX + blockSize - 1),
+                        static_cast<float>(blockX), static_cast<float>(blockX + blockSize - 1));
+        Float4 cornerYs(static_cast<float>(blockY), static_cast<float>(blockY),
+                        static_cast<float>(blockY + blockSize - 1), static_cast<float>(blockY + blockSize - 1));
+        bool inside = true;
+        for (const Edge& edge : edges) {
+            Float4 corners = edge.barycentric(cornerXs, cornerYs);
+            // The edge value is linear, so if all corners are outside, so is the rest of the block
+            if ((corners < Float4(-edge.blockMargin)).all()) {
+                return BlockCoverage::Outside;
+            }
+            inside = inside && (corners > Float4(edge.blockMargin)).all();
+        }
+        return inside ? BlockCoverage::Inside : BlockCoverage::Partial;
+    }
+
+    template <FragmentPainter Painter>
+    static void paintFragment(const Triangle& triangle, int x, int y, float alpha, float beta, float gamma,
+                              Painter& fragmentPainter) {
+        const auto& invertedW = triangle.invertedW;
+        FragmentData fragmentData;
+        fragmentData.x = x;
+        fragmentData.y = y;
+        fragmentData.z = alpha * triangle.p1.z + beta * triangle.p2.z + gamma * triangle.p3.z;
+        if constexpr (DepthOnlyPainter<Painter>) {
+            fragmentPainter.paintFragment(fragmentData);
+            return;
+        }
+        float fragInvW = alpha * invertedW[0] + beta * invertedW[1] + gamma * invertedW[2];
+        fragmentData.pos3d = (alpha * invertedW[0] * triangle.pos3ds[0].get() +
+                              beta * invertedW[1] * triangle.pos3ds[1].get() +
+                              gamma * invertedW[2] * triangle.pos3ds[2].get()) /
+                             fragInvW;
+        fragmentData.normal = glm::normalize(
+            (alpha * triangle.dividedN1 + beta * triangle.dividedN2 + gamma * triangle.dividedN3) / fragInvW);
+
+        fragmentPainter.paintFragment(fragmentData);
+    }
+
     static bool shouldDrawWhenOnEdge(const LineEquation2d& edgeLine) {
         // Draw if edge is either a "left" (a > 0) or "top" (a == 0 && b < 0) edge of the triangle
         return (edgeLine.a() > 0) || (edgeLine.a() == 0 && edgeLine.b() < 0);
@@ -2,23 +2,105 @@
 
 #include <algorithm>
 #include <cassert>
+#include <cmath>
 
 namespace cg {
-DepthBuffer::DepthBuffer(int width, int height) : width_(width), height_(height), buffer_(width_ * height_, farthest) {
+DepthBuffer::DepthBuffer(int width, int height)
+    : width_(width), height_(height), buffer_(width_ * height_, farthest),
+      coarseColumns_((width_ + coarseTileSize - 1) / coarseTileSize),
+      coarse_(static_cast<size_t>(coarseColumns_) * ((height_ + coarseTileSize - 1) / coarseTileSize)) {
     assert(width_ > 0);
     assert(height_ > 0);
+    clear();
 }
 
 bool DepthBuffer::updateIfNearer(int x, int y, float newDepth) {
     assert(newDepth > -1.0f && newDepth < 1.0f);
-    float& depthPixel = buffer_[y * width_ + x];
-    if (newDepth > depthPixel) {
-        depthPixel = newDepth;
+    if (newDepth > buffer_[y * width_ + x]) {
+        setNearer(x, y, newDepth);
         return true;
     }
     return false;
 }
 
-void DepthBuffer::clear() { std::fill(buffer_.begin(), buffer_.end(), farthest); }
+bool DepthBuffer::claimIfEqual(int x, int y, float depth) {
+    if (buffer_[y * width_ + x] != depth) {
+        return false;
+    }
+    // Can reach 1, which is still nearer than any fragment
+    setNearer(x, y, std::nextafter(depth, 1.0f));
+    return true;
+}
+
+void DepthBuffer::clear() {
+    std::fill(buffer_.begin(), buffer_.end(), farthest);
+    for (int y = 0; y < height_; y += coarseTileSize) {
+        for (int x = 0; x < width_; x += coarseTileSize) {
+            // Tiles on the right and bottom edges can be partial
+            int pixelCount = (std::min(x + coarseTileSize, width_) - x) * (std::min(y + coarseTileSize, height_) - y);
+            coarse_[coarseIndex(x, y)] = CoarseTile{farthest, pixelCount};
+        }
+    }
+}
+
+void DepthBuffer::clear(const PixelRect& rect) {
+    assert(rect.minX >= 0 && rect.minY >= 0 && rect.maxX <= width_ && rect.maxY <= height_);
+    if (rect.empty()) {
+        return;
+    }
+    for (int y = rect.minY; y < rect.maxY; ++y) {
+        std::fill_n(buffer_.begin() + y * width_ + rect.minX, rect.maxX - rect.minX, farthest);
+    }
+    // Tiles only partly inside the rect keep some of their depths
+    for (int y = rect.minY - rect.minY % coarseTileSize; y < rect.maxY; y += coarseTileSize) {
+        for (int x = rect.minX - rect.minX % coarseTileSize; x < rect.maxX; x += coarseTileSize) {
+            rescanTile(x, y);
+        }
+    }
+}
+
+bool DepthBuffer::isOccluded(const PixelRect& rect, float depth) const {
+    assert(rect.minX >= 0 && rect.minY >= 0 && rect.maxX <= width_ && rect.maxY <= height_ && !rect.empty());
+    int lastColumn = (rect.maxX - 1) / coarseTileSize;
+    int lastRow = (rect.maxY - 1) / coarseTileSize;
+    for (int row = rect.minY / coarseTileSize; row <= lastRow; ++row) {
+        for (int column = rect.minX / coarseTileSize; column <= lastColumn; ++column) {
+            // Written so that NaN fails it
+            if (!(coarse_[row * coarseColumns_ + column].farthest >= depth)) {
+                return false;
+            }
+        }
+    }
+    return true;
+}
+
+void DepthBuffer::setNearer(int x, int y, float depth) {
+    float& depthPixel = buffer_[y * width_ + x];
+    CoarseTile& tile = coarse_[coarseIndex(x, y)];
+    bool wasFarthest = depthPixel == tile.farthest;
+    depthPixel = depth;
+    if (wasFarthest && --tile.farthestCount == 0) {
+        rescanTile(x, y);
+    }
+}
+
+void DepthBuffer::rescanTile(int x, int y) {
+    int minX = x - x % coarseTileSize;
+    int minY = y - y % coarseTileSize;
+    int maxX = std::min(minX + coarseTileSize, width_);
+    int maxY = std::min(minY + coarseTileSize, height_);
+    CoarseTile tile{buffer_[minY * width_ + minX], 0};
+    for (int row = minY; row < maxY; ++row) {
+        for (int col = minX; col < maxX; ++col) {
+            float depth = buffer_[row * width_ + col];
+            if (depth < tile.farthest) {
+                tile = CoarseTile{depth, 1};
+            } else if (depth == tile.farthest) {
+                ++tile.farthestCount;
+            }
+        }
+    }
+    coarse_[coarseIndex(x, y)] = tile;
+}
 
 } // namespace cg
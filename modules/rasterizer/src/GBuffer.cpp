@@ -0,0 +1,35 @@
+#include "rasterizer/GBuffer.h"
+
+#include <algorithm>
+#include <cassert>
+
+namespace cg {
+GBuffer::GBuffer(int width, int height)
+    : width_(width), height_(height), depth_(width, height), normals_(width_ * height_), positions_(width_ * height_),
+      shapes_(width_ * height_, noShape) {}
+
+bool GBuffer::updateIfNearer(int x, int y, float depth, const glm::vec3& normal, const Point& position,
+                             uint32_t shapeIndex) {
+    if (!depth_.updateIfNearer(x, y, depth)) {
+        return false;
+    }
+    int index = y * width_ + x;
+    normals_[index] = normal;
+    positions_[index] = position;
+    shapes_[index] = shapeIndex;
+    return true;
+}
+
+void GBuffer::clear() {
+    depth_.clear();
+    std::fill(shapes_.begin(), shapes_.end(), noShape);
+}
+
+void GBuffer::clear(const PixelRect& rect) {
+    assert(rect.minX >= 0 && rect.minY >= 0 && rect.maxX <= width_ && rect.maxY <= height_);
+    depth_.clear(rect);
+    for (int y = rect.minY; y < rect.maxY; ++y) {
+        std::fill_n(shapes_.begin() + y * width_ + rect.minX, rect.maxX - rect.minX, noShape);
+    }
+}
+} // namespace cg
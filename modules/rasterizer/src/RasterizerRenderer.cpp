@@ -4,6 +4,22 @@
 
 namespace cg {
 
+RasterizerRenderer::ScreenGeometry RasterizerRenderer::toScreenGeometry(Shape& shape, const BackFaceCuller& bfCuller,
+                                                                        Clipper& clipper,
+                                                                        const glm::mat4& toScreenMatrix) {
+    const RasterizerShaders& shaders = static_cast<const RasterizerShaders&>(shape.shaderGroup());
+    MeshData shapeMesh = shaders.shapeShader().generateMesh(shape);
+    meshToGlobalSpace(shapeMesh, shape);
+    MeshData culledMesh = cullBackFaceTriangles(shapeMesh, bfCuller);
+    ScreenGeometry geometry;
+    geometry.mesh = clipper.clip(culledMesh);
+    geometry.globalVertices.reserve(geometry.mesh.vertices().size());
+    geometry.globalVertices.assign_range(geometry.mesh.vertices());
+
+    geometry.invertedW = verticesToScreenSpace(toScreenMatrix, geometry.mesh);
+    return geometry;
+}
+
 void RasterizerRenderer::meshToGlobalSpace(MeshData& mesh, const Shape& shape) {
     const auto& toGlobalMatrix = shape.toGlobalFrameMatrix();
     for (Point& vertex : mesh.vertices()) {
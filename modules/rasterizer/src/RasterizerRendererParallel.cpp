@@ -3,20 +3,99 @@
 #include "core/Camera.h"
 
 namespace cg {
+void RasterizerRendererParallel::ThreadBuffers::clear() {
+    depth.clear();
+    if (color.has_value()) {
+        color->clear();
+    }
+}
+
+RasterizerRendererParallel::ThreadBuffers
+RasterizerRendererParallel::createThreadBuffers(ThreadPool::ThreadIndex threadIndex) const {
+    ThreadBuffers buffers{DepthBuffer(bufferWidth_, bufferHeight_), std::nullopt};
+    if (threadIndex > 0) {
+        buffers.color.emplace(bufferWidth_, bufferHeight_);
+    }
+    return buffers;
+}
+
 void RasterizerRendererParallel::prepareBuffers(int targetWidth, int targetHeight) {
-    if (colorBuffers_.empty() || colorBuffers_[0].width() != targetWidth || colorBuffers_[0].height() != targetHeight) {
-        colorBuffers_.clear();
-        depthBuffers_.clear();
-        for (unsigned i = 0; i < threadPool_.threadCount(); ++i) {
-            depthBuffers_.emplace_back(targetWidth, targetHeight);
+    if (targetWidth == bufferWidth_ && targetHeight == bufferHeight_ && mode_ == bufferMode_) {
+        return;
+    }
+    bufferWidth_ = targetWidth;
+    bufferHeight_ = targetHeight;
+    bufferMode_ = mode_;
+    // Buffers of the other modes would only take up memory
+    threadBuffers_.clear();
+    if (mode_ != Mode::Deferred) {
+        gBuffer_.reset();
+    }
+    if (mode_ != Mode::Tiled) {
+        tileBuffers_.clear();
+    }
+    if (mode_ == Mode::Tiled || mode_ == Mode::Deferred) {
+        // Tile buffers don't depend on the screen size, only the number of tiles does
+        tileColumns_ = (targetWidth + tileSize - 1) / tileSize;
+        tileRows_ = (targetHeight + tileSize - 1) / tileSize;
+        if (mode_ == Mode::Deferred) {
+            gBuffer_.emplace(targetWidth, targetHeight);
+        }
+        return;
+    }
+    // Buffers are filled on creation, so letting each worker create its own places them on the worker's NUMA node when
+    // workers are pinned
+    threadBuffers_.createOnWorkers();
+}
+
+RasterizerRendererParallel::ScreenGeometry RasterizerRendererParallel::toScreenGeometry(Shape& shape,
+                                                                                        const FrameParams& params) {
+    const RasterizerShaders& shaders = static_cast<const RasterizerShaders&>(shape.shaderGroup());
+    MeshData shapeMesh = shaders.shapeShader().generateMesh(shape);
+
+    meshToGlobalSpace(shapeMesh, shape);
+
+    MeshData culledMesh = cullBackFaceTriangles(shapeMesh, *params.bfCuller);
+    ScreenGeometry geometry;
+    geometry.mesh = clippers_.local().clip(culledMesh);
+
+    geometry.globalVertices.assign(geometry.mesh.vertices().begin(), geometry.mesh.vertices().end());
+    geometry.invertedW = verticesToScreenSpace(*params.toScreenMatrix, geometry.mesh);
+    return geometry;
+}
+
+void RasterizerRendererParallel::binShape(Shape& shape, const FrameParams& params, BinnedShape& binned) {
+    binned.geometry = toScreenGeometry(shape, params);
+    binned.tileTriangles.resize(static_cast<size_t>(tileColumns_) * tileRows_);
+    for (std::vector<uint32_t>& triangleIndices : binned.tileTriangles) {
+        triangleIndices.clear();
+    }
+
+    const auto& vertices = binned.geometry.mesh.vertices();
+    auto triangles = binned.geometry.mesh.triangles();
+    PixelRect screenRect{0, 0, bufferWidth_, bufferHeight_};
+    for (size_t i = 0; i < triangles.size(); ++i) {
+        const TriangleData& triangle = triangles[i];
+        // Same bounds the rasterizer uses, so a triangle is in every tile it can paint a pixel of
+        PixelRect bounds = TriangleRasterizer::pixelBounds(vertices[triangle[0].vertex], vertices[triangle[1].vertex],
+                                                           vertices[triangle[2].vertex], screenRect);
+        if (bounds.empty()) {
+            continue;
         }
-        // Create one less color buffer since thread 0 writes to target directly
-        for (unsigned i = 0; i < threadPool_.threadCount() - 1; ++i) {
-            colorBuffers_.emplace_back(targetWidth, targetHeight);
+        for (int tileRow = bounds.minY / tileSize; tileRow <= (bounds.maxY - 1) / tileSize; ++tileRow) {
+            for (int tileColumn = bounds.minX / tileSize; tileColumn <= (bounds.maxX - 1) / tileSize; ++tileColumn) {
+                binned.tileTriangles[tileRow * tileColumns_ + tileColumn].push_back(static_cast<uint32_t>(i));
+            }
         }
     }
 }
 
+PixelRect RasterizerRendererParallel::tileRect(int tile) const {
+    int minX = (tile % tileColumns_) * tileSize;
+    int minY = (tile / tileColumns_) * tileSize;
+    return PixelRect{minX, minY, std::min(minX + tileSize, bufferWidth_), std::min(minY + tileSize, bufferHeight_)};
+}
+
 void RasterizerRendererParallel::meshToGlobalSpace(MeshData& mesh, const Shape& shape) {
     const auto& toGlobalMatrix = shape.toGlobalFrameMatrix();
     for (Point& vertex : mesh.vertices()) {
@@ -2,6 +2,8 @@
 
 #include "gtest/gtest.h"
 
+#include <limits>
+
 using namespace cg;
 
 TEST(DepthBufferTest, updateIfNearer_bothCases_shouldReturnExpected) {
@@ -18,6 +20,18 @@ TEST(DepthBufferTest, updateIfNearer_bothCases_shouldReturnExpected) {
     EXPECT_TRUE(isUpdated);
 }
 
+TEST(DepthBufferTest, claimIfEqual_shouldClaimOnlyFirstFragmentAtStoredDepth) {
+    DepthBuffer buff(10, 10);
+    buff.updateIfNearer(5, 5, 0.3f);
+
+    EXPECT_FALSE(buff.claimIfEqual(5, 5, 0.2f));
+    EXPECT_TRUE(buff.claimIfEqual(5, 5, 0.3f));
+    EXPECT_FALSE(buff.claimIfEqual(5, 5, 0.3f));
+    EXPECT_GT(buff.depthAtPixel(5, 5), 0.3f);
+    EXPECT_LT(buff.depthAtPixel(5, 5), 0.30001f);
+    EXPECT_FALSE(buff.claimIfEqual(4, 5, 0.3f));
+}
+
 TEST(DepthBufferTest, depthAtPixel_shouldReturnExpected) {
     constexpr float depth = 0.1f;
     DepthBuffer buff(10, 10);
@@ -27,3 +41,77 @@ TEST(DepthBufferTest, depthAtPixel_shouldReturnExpected) {
 
     EXPECT_EQ(buff.depthAtPixel(5, 5), depth);
 }
+
+namespace {
+void fillRect(DepthBuffer& buffer, const PixelRect& rect, float depth) {
+    for (int y = rect.minY; y < rect.maxY; ++y) {
+        for (int x = rect.minX; x < rect.maxX; ++x) {
+            buffer.updateIfNearer(x, y, depth);
+        }
+    }
+}
+} // namespace
+
+TEST(DepthBufferTest, farthestInTile_shouldFollowUpdates) {
+    DepthBuffer buff(20, 10);
+    EXPECT_EQ(buff.farthestInTile(3, 3), DepthBuffer::farthest);
+
+    // All of the first tile but one pixel
+    fillRect(buff, PixelRect{0, 0, 8, 7}, 0.2f);
+    fillRect(buff, PixelRect{0, 7, 7, 8}, 0.2f);
+    EXPECT_EQ(buff.farthestInTile(3, 3), DepthBuffer::farthest);
+    buff.updateIfNearer(7, 7, 0.5f);
+    EXPECT_EQ(buff.farthestInTile(3, 3), 0.2f);
+    buff.updateIfNearer(2, 2, 0.9f);
+    EXPECT_EQ(buff.farthestInTile(3, 3), 0.2f);
+    fillRect(buff, PixelRect{0, 0, 8, 8}, 0.6f);
+    EXPECT_EQ(buff.farthestInTile(3, 3), 0.6f);
+    EXPECT_EQ(buff.farthestInTile(8, 0), DepthBuffer::farthest);
+
+    // Partial tile in the corner, 4x2 pixels
+    fillRect(buff, PixelRect{16, 8, 20, 10}, 0.3f);
+    EXPECT_EQ(buff.farthestInTile(19, 9), 0.3f);
+
+    buff.clear();
+    EXPECT_EQ(buff.farthestInTile(3, 3), DepthBuffer::farthest);
+    EXPECT_EQ(buff.farthestInTile(19, 9), DepthBuffer::farthest);
+}
+
+TEST(DepthBufferTest, isOccluded_shouldCompareWithFarthestOfTouchedTiles) {
+    DepthBuffer buff(16, 16);
+    PixelRect insideFirstTile{2, 2, 5, 5};
+    EXPECT_FALSE(buff.isOccluded(insideFirstTile, -0.5f));
+
+    fillRect(buff, PixelRect{0, 0, 8, 8}, 0.5f);
+    EXPECT_TRUE(buff.isOccluded(insideFirstTile, 0.4f));
+    // A fragment at the same depth isn't painted either
+    EXPECT_TRUE(buff.isOccluded(insideFirstTile, 0.5f));
+    EXPECT_FALSE(buff.isOccluded(insideFirstTile, 0.6f));
+    EXPECT_FALSE(buff.isOccluded(insideFirstTile, std::numeric_limits<float>::quiet_NaN()));
+    // Reaches into the second tile, which is empty
+    EXPECT_FALSE(buff.isOccluded(PixelRect{2, 2, 9, 5}, 0.4f));
+
+    fillRect(buff, PixelRect{8, 0, 16, 8}, 0.7f);
+    EXPECT_TRUE(buff.isOccluded(PixelRect{2, 2, 9, 5}, 0.4f));
+    EXPECT_FALSE(buff.isOccluded(PixelRect{2, 2, 9, 5}, 0.6f));
+    EXPECT_TRUE(buff.isOccluded(PixelRect{9, 2, 16, 8}, 0.6f));
+}
+
+TEST(DepthBufferTest, clearRect_shouldKeepFarthestOfPartlyClearedTiles) {
+    DepthBuffer buff(16, 16);
+    fillRect(buff, PixelRect{0, 0, 16, 16}, 0.5f);
+    buff.updateIfNearer(1, 1, 0.8f);
+
+    buff.clear(PixelRect{4, 4, 16, 16});
+    EXPECT_EQ(buff.depthAtPixel(1, 1), 0.8f);
+    EXPECT_EQ(buff.depthAtPixel(3, 3), 0.5f);
+    EXPECT_EQ(buff.depthAtPixel(4, 4), DepthBuffer::farthest);
+    EXPECT_EQ(buff.farthestInTile(0, 0), DepthBuffer::farthest);
+    EXPECT_EQ(buff.farthestInTile(8, 8), DepthBuffer::farthest);
+
+    // Writing to the cleared pixels brings the first tile back to what's left outside the rect
+    fillRect(buff, PixelRect{4, 4, 8, 8}, 0.6f);
+    fillRect(buff, PixelRect{4, 0, 8, 4}, 0.6f);
+    fillRect(buff, PixelRect{0, 4, 4, 8}, 0.6f);
+    EXPECT_EQ(buff.farthestInTile(0, 0), 0.5f);
+}
@@ -0,0 +1,61 @@
+#include "rasterizer/Float4.h"
+
+#include "gtest/gtest.h"
+
+#include <limits>
+
+using namespace cg;
+
+TEST(Float4Test, constructor_shouldSetLanes) {
+    Float4 broadcast(2.5f);
+    Float4 lanes(1, 2, 3, 4);
+
+    for (int lane = 0; lane < 4; ++lane) {
+        EXPECT_EQ(broadcast[lane], 2.5f);
+        EXPECT_EQ(lanes[lane], static_cast<float>(lane + 1));
+    }
+    EXPECT_EQ(lanes.toArray(), (std::array<float, 4>{1, 2, 3, 4}));
+}
+
+TEST(Float4Test, arithmetic_shouldMatchScalarPerLane) {
+    std::array<float, 4> lhs = {0.1f, -3.7f, 1e20f, 7.0f / 3.0f};
+    std::array<float, 4> rhs = {0.2f, 1.3f, -1e-20f, 3.0f};
+    Float4 a(lhs[0], lhs[1], lhs[2], lhs[3]);
+    Float4 b(rhs[0], rhs[1], rhs[2], rhs[3]);
+
+    Float4 sum = a + b;
+    Float4 product = a * b;
+    Float4 combined = a * b + Float4(0.3f);
+    for (int lane = 0; lane < 4; ++lane) {
+        EXPECT_EQ(sum[lane], lhs[lane] + rhs[lane]);
+        EXPECT_EQ(product[lane], lhs[lane] * rhs[lane]);
+        float expected = lhs[lane] * rhs[lane];
+        EXPECT_EQ(combined[lane], expected + 0.3f);
+    }
+}
+
+TEST(Float4Test, comparisons_shouldSetOneBitPerLane) {
+    Float4 values(-1, 0, 1, 2);
+
+    EXPECT_EQ((values >= Float4(0)).bits(), 0b1110u);
+    EXPECT_EQ((values > Float4(0)).bits(), 0b1100u);
+    EXPECT_EQ((values < Float4(1)).bits(), 0b0011u);
+    EXPECT_TRUE((values > Float4(-2)).all());
+    EXPECT_EQ(((values >= Float4(0)) & (values < Float4(2))).bits(), 0b0110u);
+    EXPECT_EQ(((values < Float4(0)) | (values > Float4(1))).bits(), 0b1001u);
+}
+
+TEST(Float4Test, comparisons_nan_shouldBeFalse) {
+    float nan = std::numeric_limits<float>::quiet_NaN();
+    Float4 values(nan, 1, nan, -1);
+
+    EXPECT_EQ((values >= Float4(0)).bits(), 0b0010u);
+    EXPECT_EQ((values > Float4(0)).bits(), 0b0010u);
+    EXPECT_EQ((values < Float4(0)).bits(), 0b1000u);
+}
+
+TEST(Float4Test, mask_fromBits_shouldKeepFourLanes) {
+    EXPECT_EQ(Float4::Mask::fromBits(0xffu).bits(), 0b1111u);
+    EXPECT_TRUE(Float4::Mask::fromBits(0b1111u).all());
+    EXPECT_FALSE(Float4::Mask::fromBits(0b0111u).all());
+}
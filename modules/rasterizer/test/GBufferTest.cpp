@@ -0,0 +1,57 @@
+#include "rasterizer/GBuffer.h"
+
+#include "gtest/gtest.h"
+
+using namespace cg;
+
+TEST(GBufferTest, constructor_shouldHaveNoShapes) {
+    GBuffer buff(10, 6);
+    EXPECT_EQ(buff.width(), 10);
+    EXPECT_EQ(buff.height(), 6);
+    for (int y = 0; y < buff.height(); ++y) {
+        for (int x = 0; x < buff.width(); ++x) {
+            EXPECT_EQ(buff.shapeAtPixel(x, y), GBuffer::noShape) << "x: " << x << ", y: " << y;
+        }
+    }
+}
+
+TEST(GBufferTest, updateIfNearer_shouldKeepNearestFragment) {
+    GBuffer buff(10, 6);
+
+    EXPECT_TRUE(buff.updateIfNearer(3, 2, 0.2f, glm::vec3(0, 1, 0), Point(1, 2, 3), 4));
+    EXPECT_FALSE(buff.updateIfNearer(3, 2, 0.1f, glm::vec3(1, 0, 0), Point(4, 5, 6), 7));
+    EXPECT_EQ(buff.depth().depthAtPixel(3, 2), 0.2f);
+    EXPECT_EQ(buff.normalAtPixel(3, 2), glm::vec3(0, 1, 0));
+    EXPECT_EQ(buff.positionAtPixel(3, 2), Point(1, 2, 3));
+    EXPECT_EQ(buff.shapeAtPixel(3, 2), 4u);
+
+    EXPECT_TRUE(buff.updateIfNearer(3, 2, 0.3f, glm::vec3(1, 0, 0), Point(4, 5, 6), 7));
+    EXPECT_EQ(buff.normalAtPixel(3, 2), glm::vec3(1, 0, 0));
+    EXPECT_EQ(buff.positionAtPixel(3, 2), Point(4, 5, 6));
+    EXPECT_EQ(buff.shapeAtPixel(3, 2), 7u);
+}
+
+TEST(GBufferTest, clearRect_shouldOnlyClearRect) {
+    GBuffer buff(16, 8);
+    for (int y = 0; y < buff.height(); ++y) {
+        for (int x = 0; x < buff.width(); ++x) {
+            buff.updateIfNearer(x, y, 0.5f, glm::vec3(0, 0, 1), Point(0, 0, 0), 1);
+        }
+    }
+
+    buff.clear(PixelRect{8, 0, 16, 8});
+    for (int y = 0; y < buff.height(); ++y) {
+        for (int x = 0; x < buff.width(); ++x) {
+            bool cleared = x >= 8;
+            EXPECT_EQ(buff.shapeAtPixel(x, y), cleared ? GBuffer::noShape : 1u) << "x: " << x << ", y: " << y;
+            EXPECT_EQ(buff.depth().depthAtPixel(x, y), cleared ? DepthBuffer::farthest : 0.5f)
+                << "x: " << x << ", y: " << y;
+        }
+    }
+    EXPECT_EQ(buff.depth().farthestInTile(0, 0), 0.5f);
+    EXPECT_EQ(buff.depth().farthestInTile(8, 0), DepthBuffer::farthest);
+
+    buff.clear();
+    EXPECT_EQ(buff.shapeAtPixel(0, 0), GBuffer::noShape);
+    EXPECT_EQ(buff.depth().depthAtPixel(0, 0), DepthBuffer::farthest);
+}
@@ -0,0 +1,134 @@
+#include "rasterizer/RasterizerRendererParallel.h"
+
+#include "rasterizer/MemoryColorBuffer.h"
+
+#include "TestScene.h"
+
+#include "gtest/gtest.h"
+
+#include <memory>
+
+using namespace cg;
+using namespace cg::test_scene;
+
+namespace {
+MemoryColorBuffer render(RasterizerRendererParallel& renderer, Scene& scene) {
+    MemoryColorBuffer screen(screenWidth, screenHeight);
+    renderer.renderScene(scene, screen);
+    return screen;
+}
+} // namespace
+
+TEST(RasterizerRendererParallelTest, tiled_shouldDrawSameImageAsThreadBuffers) {
+    Scene scene;
+    buildScene(scene);
+    ThreadPool threadPool(4);
+    RasterizerRendererParallel renderer(threadPool);
+
+    renderer.setMode(RasterizerRendererParallel::Mode::ThreadBuffers);
+    MemoryColorBuffer threadBuffersImage = render(renderer, scene);
+    renderer.setMode(RasterizerRendererParallel::Mode::Tiled);
+    MemoryColorBuffer tiledImage = render(renderer, scene);
+
+    EXPECT_GT(paintedPixelCount(tiledImage), 0u);
+    expectSameImage(tiledImage, threadBuffersImage);
+}
+
+TEST(RasterizerRendererParallelTest, tiled_repeatedFrames_shouldDrawSameImage) {
+    Scene scene;
+    buildScene(scene);
+    ThreadPool threadPool(3);
+    RasterizerRendererParallel renderer(threadPool);
+
+    MemoryColorBuffer first = render(renderer, scene);
+    MemoryColorBuffer second = render(renderer, scene);
+
+    expectSameImage(second, first);
+}
+
+TEST(RasterizerRendererParallelTest, repeatedFrames_shouldNotAllocateTaskState) {
+    Scene scene;
+    buildScene(scene);
+    ThreadPool threadPool(3);
+    RasterizerRendererParallel renderer(threadPool);
+    MemoryColorBuffer screen(screenWidth, screenHeight);
+
+    for (RasterizerRendererParallel::Mode mode :
+         {RasterizerRendererParallel::Mode::Tiled, RasterizerRendererParallel::Mode::ThreadBuffers,
+          RasterizerRendererParallel::Mode::Deferred}) {
+        renderer.setMode(mode);
+        renderer.renderScene(scene, screen);
+        size_t chunkAllocations = renderer.frameArena().chunkAllocationCount();
+        size_t taskHeapAllocations = Task::heapAllocationCount();
+        renderer.renderScene(scene, screen);
+
+        EXPECT_EQ(renderer.frameArena().chunkAllocationCount(), chunkAllocations);
+        EXPECT_EQ(Task::heapAllocationCount(), taskHeapAllocations);
+    }
+}
+
+TEST(RasterizerRendererParallelTest, occlusionCulling_shouldDrawSameImageAndCountRejections) {
+    Scene scene;
+    buildScene(scene);
+    ThreadPool threadPool(2);
+    RasterizerRendererParallel renderer(threadPool);
+
+    for (RasterizerRendererParallel::Mode mode :
+         {RasterizerRendererParallel::Mode::Tiled, RasterizerRendererParallel::Mode::ThreadBuffers}) {
+        renderer.setMode(mode);
+        renderer.setOcclusionCulling(false);
+        MemoryColorBuffer withoutCulling = render(renderer, scene);
+        EXPECT_EQ(renderer.occlusionCounters().trianglesRejected, 0u);
+        EXPECT_EQ(renderer.occlusionCounters().blocksRejected, 0u);
+
+        renderer.setOcclusionCulling(true);
+        MemoryColorBuffer withCulling = render(renderer, scene);
+        // Tiles draw the floor after the spheres, which hide part of it. With thread buffers, shapes are drawn in
+        // parallel, so what's rejected depends on timing.
+        if (mode == RasterizerRendererParallel::Mode::Tiled) {
+            EXPECT_GT(renderer.occlusionCounters().blocksRejected, 0u);
+        }
+        expectSameImage(withCulling, withoutCulling);
+    }
+}
+
+TEST(RasterizerRendererParallelTest, deferred_shouldDrawSameImageAsTiled) {
+    Scene scene;
+    buildScene(scene);
+    auto light = std::make_unique<PointLight>(100 * Color::white());
+    light->setPosition(Point(4, 3, -4));
+    scene.addLight(std::move(light));
+    ThreadPool threadPool(3);
+    RasterizerRendererParallel renderer(threadPool);
+
+    MemoryColorBuffer tiledImage = render(renderer, scene);
+    renderer.setMode(RasterizerRendererParallel::Mode::Deferred);
+    MemoryColorBuffer deferredImage = render(renderer, scene);
+    // Buffers are reused in the next frame
+    MemoryColorBuffer secondDeferredImage = render(renderer, scene);
+
+    EXPECT_GT(paintedPixelCount(deferredImage), 0u);
+    EXPECT_GT(renderer.occlusionCounters().blocksRejected, 0u);
+    expectSameImage(deferredImage, tiledImage);
+    expectSameImage(secondDeferredImage, tiledImage);
+}
+
+TEST(RasterizerRendererParallelTest, depthPrepass_shouldDrawSameImage) {
+    Scene scene;
+    buildScene(scene);
+    ThreadPool threadPool(3);
+    RasterizerRendererParallel renderer(threadPool);
+
+    for (RasterizerRendererParallel::Mode mode :
+         {RasterizerRendererParallel::Mode::Tiled, RasterizerRendererParallel::Mode::ThreadBuffers,
+          RasterizerRendererParallel::Mode::Deferred}) {
+        renderer.setMode(mode);
+        renderer.setDepthPrepass(false);
+        MemoryColorBuffer withoutPrepass = render(renderer, scene);
+        renderer.setDepthPrepass(true);
+        MemoryColorBuffer withPrepass = render(renderer, scene);
+
+        EXPECT_GT(paintedPixelCount(withPrepass), 0u);
+        expectSameImage(withPrepass, withoutPrepass);
+    }
+}
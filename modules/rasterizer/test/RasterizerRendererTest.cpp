@@ -0,0 +1,31 @@
+#include "rasterizer/RasterizerRenderer.h"
+
+#include "rasterizer/MemoryColorBuffer.h"
+
+#include "TestScene.h"
+
+#include "gtest/gtest.h"
+
+using namespace cg;
+using namespace cg::test_scene;
+
+namespace {
+MemoryColorBuffer render(RasterizerRenderer& renderer, Scene& scene) {
+    MemoryColorBuffer screen(screenWidth, screenHeight);
+    renderer.renderScene(scene, screen);
+    return screen;
+}
+} // namespace
+
+TEST(RasterizerRendererTest, depthPrepass_shouldDrawSameImage) {
+    Scene scene;
+    buildScene(scene);
+    RasterizerRenderer renderer;
+
+    MemoryColorBuffer withoutPrepass = render(renderer, scene);
+    renderer.setDepthPrepass(true);
+    MemoryColorBuffer withPrepass = render(renderer, scene);
+
+    EXPECT_GT(paintedPixelCount(withPrepass), 0u);
+    expectSameImage(withPrepass, withoutPrepass);
+}
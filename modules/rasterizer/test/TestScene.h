@@ -0,0 +1,87 @@
+#pragma once
+
+#include "core/BlinnPhong.h"
+#include "core/Mesh.h"
+#include "core/PerspectiveCamera.h"
+#include "core/PointLight.h"
+#include "core/Scene.h"
+#include "core/Sphere.h"
+#include "mesh/MeshGenerator.h"
+#include "rasterizer/MemoryColorBuffer.h"
+#include "rasterizer/RasterizerShaders.h"
+#include "shader/MeshShapeShader.h"
+#include "shader/SphereShapeShader.h"
+
+#include "gtest/gtest.h"
+
+#include <memory>
+
+// Scene shared by the renderer tests
+namespace cg::test_scene {
+using namespace angle_literals;
+
+// Not a multiple of the tile size, so the last row and column of tiles are partial
+constexpr int screenWidth = 150;
+constexpr int screenHeight = 100;
+
+inline std::unique_ptr<Sphere> createSphere(float radius, const Point& position, const Color& color) {
+    auto sphere = std::make_unique<Sphere>(radius);
+    sphere->setShaderGroup(std::make_unique<RasterizerShaders>(std::make_unique<SphereShapeShader>(8, 16)));
+    sphere->setPosition(position);
+    sphere->setAmbientReflectance(color);
+    sphere->setMaterial(std::make_unique<BlinnPhong>(color, 0.4f * Color::white(), 32, 0.3f * Color::white()));
+    sphere->update();
+    return sphere;
+}
+
+// Overlapping spheres in front of a floor, so depth testing decides most pixels
+inline void buildScene(Scene& scene) {
+    scene.setAmbientLight(0.05f * Color::white());
+
+    auto camera = std::make_unique<PerspectiveCamera>();
+    camera->setResolution(Camera::Resolution(screenWidth, screenHeight));
+    camera->setPosition(Point(0, 0, 0));
+    camera->setViewDirection(glm::vec3(1, 0, 0), glm::vec3(0, 1, 0));
+    camera->setViewPlaneDistance(0.5f);
+    camera->setViewPlaneSize(Size2d(screenWidth, screenHeight));
+    camera->setFieldOfView(80_deg);
+    camera->update();
+    scene.setCamera(std::move(camera));
+
+    auto light = std::make_unique<PointLight>(250 * Color::white());
+    light->setPosition(Point(-3, 6, 6));
+    scene.addLight(std::move(light));
+
+    scene.addShape(createSphere(2.0f, Point(10, 0, -1), Color::red()));
+    scene.addShape(createSphere(1.0f, Point(7, 0.5f, 0.5f), Color::green()));
+
+    auto floor = std::make_unique<Mesh>(MeshGenerator::generateRectangle({100, 1000}, 10, 10));
+    floor->setShaderGroup(std::make_unique<RasterizerShaders>(std::make_unique<MeshShapeShader>()));
+    floor->setRotation(-90_deg, 0_deg, 0_deg);
+    floor->setPosition(Point(0, -2, 0));
+    floor->setMaterial(std::make_unique<BlinnPhong>(0.5f * Color::white(), Color::black(), 1, 0.3f * Color::white()));
+    floor->update();
+    scene.addShape(std::move(floor));
+}
+
+inline unsigned paintedPixelCount(MemoryColorBuffer& screen) {
+    unsigned count = 0;
+    for (int row = 0; row < screen.height(); ++row) {
+        for (int col = 0; col < screen.width(); ++col) {
+            count += screen.colorAtPixel(row, col) != Color::black() ? 1 : 0;
+        }
+    }
+    return count;
+}
+// Reports the first pixel that differs, if any
+inline void expectSameImage(MemoryColorBuffer& actual, MemoryColorBuffer& expected) {
+    ASSERT_EQ(actual.width(), expected.width());
+    ASSERT_EQ(actual.height(), expected.height());
+    for (int row = 0; row < actual.height(); ++row) {
+        for (int col = 0; col < actual.width(); ++col) {
+            ASSERT_EQ(actual.colorAtPixel(row, col), expected.colorAtPixel(row, col))
+                << "row: " << row << ", col: " << col;
+        }
+    }
+}
+} // namespace cg::test_scene
@@ -1,8 +1,11 @@
 #include "core/Color.h"
+#include "rasterizer/DepthBuffer.h"
 #include "rasterizer/TriangleRasterizer.h"
 
 #include "gtest/gtest.h"
 
+#include <algorithm>
+#include <random>
 #include <set>
 
 using namespace cg;
@@ -35,6 +38,56 @@ private:
 };
 static_assert(FragmentPainter<TestPainter>, "TestPainter does not fulfill the FragmentPainter concept.");
 
+// Depth tests fragments, and lets the rasterizer skip occluded ones if `occlusionCulling` is set
+class DepthTestPainter {
+public:
+    DepthTestPainter(int width, int height, bool occlusionCulling)
+        : depthBuffer_(width, height), occlusionCulling_(occlusionCulling) {}
+
+    void paintFragment(const FragmentData& frag) {
+        ++fragmentsPainted_;
+        depthBuffer_.updateIfNearer(frag.x, frag.y, frag.z);
+    }
+    bool isOccluded(const PixelRect& rect, float depth) const {
+        return occlusionCulling_ && depthBuffer_.isOccluded(rect, depth);
+    }
+    int width() { return depthBuffer_.width(); }
+    int height() { return depthBuffer_.height(); }
+
+    DepthBuffer& depthBuffer() { return depthBuffer_; }
+    unsigned fragmentsPainted() const { return fragmentsPainted_; }
+
+private:
+    DepthBuffer depthBuffer_;
+    bool occlusionCulling_;
+    unsigned fragmentsPainted_ = 0;
+};
+static_assert(OccludingPainter<DepthTestPainter>, "DepthTestPainter does not fulfill the OccludingPainter concept.");
+
+// Keeps the z of the last fragment of every pixel, and lets the rasterizer skip the rest if `DepthOnly` is set
+template <bool DepthOnly>
+class DepthRecordingPainter {
+public:
+    static constexpr bool depthOnly = DepthOnly;
+
+    DepthRecordingPainter(int width, int height)
+        : width_(width), height_(height), depths_(width * height, DepthBuffer::farthest) {}
+
+    void paintFragment(const FragmentData& frag) { depths_[frag.y * width_ + frag.x] = frag.z; }
+    int width() const { return width_; }
+    int height() const { return height_; }
+
+    const std::vector<float>& depths() const { return depths_; }
+
+private:
+    int width_;
+    int height_;
+    std::vector<float> depths_;
+};
+static_assert(DepthOnlyPainter<DepthRecordingPainter<true>>,
+              "DepthRecordingPainter<true> does not fulfill the DepthOnlyPainter concept.");
+static_assert(!DepthOnlyPainter<DepthRecordingPainter<false>>, "DepthRecordingPainter<false> is depth only.");
+
 struct Vector2i {
     int x;
     int y;
@@ -181,3 +234,166 @@ TEST(TriangleRasterizerTest, rasterize_degenerateTriangle_shouldDrawNothing) {
                                   {globalPoints[0], globalPoints[1], globalPoints[2]}, {0, 0, 0}, painter);
     assertColoredPixels({}, painter);
 }
+
+TEST(TriangleRasterizerTest, rasterize_clipRectTiles_shouldTogetherDrawSameAsWholeScreen) {
+    constexpr int width = 10;
+    constexpr int height = 8;
+    std::array<glm::vec3, 3> normals = {};
+    std::array<glm::vec3, 3> globalPoints = {};
+    std::array<Point, 3> points = {Point{0.5f, 0.2f, 0}, Point{9.3f, 3.6f, 0}, Point{2.1f, 7.8f, 0}};
+
+    TestPainter wholePainter(width, height);
+    TriangleRasterizer::rasterize({points[0], points[1], points[2]}, {normals[0], normals[1], normals[2]},
+                                  {globalPoints[0], globalPoints[1], globalPoints[2]}, {0, 0, 0}, wholePainter);
+
+    TestPainter tiledPainter(width, height);
+    constexpr int tileSize = 3;
+    for (int tileY = 0; tileY < height; tileY += tileSize) {
+        for (int tileX = 0; tileX < width; tileX += tileSize) {
+            PixelRect tile{tileX, tileY, std::min(tileX + tileSize, width), std::min(tileY + tileSize, height)};
+            TriangleRasterizer::rasterize({points[0], points[1], points[2]}, {normals[0], normals[1], normals[2]},
+                                          {globalPoints[0], globalPoints[1], globalPoints[2]}, {0, 0, 0},
+                                          tiledPainter, tile);
+        }
+    }
+
+    EXPECT_GT(wholePainter.pixelsDrawn(), 0u);
+    EXPECT_EQ(tiledPainter.pixelsDrawn(), wholePainter.pixelsDrawn());
+    EXPECT_EQ(tiledPainter.pixels(), wholePainter.pixels());
+}
+
+TEST(TriangleRasterizerTest, rasterize_randomTriangles_shouldDrawSameAsPerPixel) {
+    constexpr int width = 61;
+    constexpr int height = 47;
+    std::array<glm::vec3, 3> normals = {};
+    std::array<glm::vec3, 3> globalPoints = {};
+    PixelRect screen{0, 0, width, height};
+
+    std::mt19937 generator(1234);
+    // From sub-pixel triangles to ones much larger than the screen
+    std::array<float, 5> extents = {0.7f, 3.0f, 12.0f, 40.0f, 150.0f};
+    std::uniform_real_distribution<float> unit(0.0f, 1.0f);
+    auto randomPoint = [&](const Point& center, float extent) {
+        return Point{center.x + (unit(generator) - 0.5f) * extent, center.y + (unit(generator) - 0.5f) * extent, 0};
+    };
+
+    TestPainter blockPainter(width, height);
+    TestPainter referencePainter(width, height);
+    unsigned trianglesDrawn = 0;
+    for (int i = 0; i < 1000; ++i) {
+        float extent = extents[i % extents.size()];
+        Point center{unit(generator) * width, unit(generator) * height, 0};
+        std::array<Point, 3> points = {randomPoint(center, extent), randomPoint(center, extent),
+                                       randomPoint(center, extent)};
+        if (i % 10 == 0) {
+            // On a line
+            points[2] = points[0] + 0.25f * (points[1] - points[0]);
+        } else if (i % 10 == 1) {
+            // Vertices on pixel centers, so pixels lie exactly on edges
+            for (Point& point : points) {
+                point = Point{std::round(point.x), std::round(point.y), 0};
+            }
+        }
+
+        // A quad split along a diagonal, pixels on the diagonal must be drawn once
+        std::array<Point, 3> neighbour = {points[1], points[0], randomPoint(center, extent)};
+        for (const std::array<Point, 3>& triangle : {points, neighbour}) {
+            blockPainter.clear();
+            referencePainter.clear();
+            TriangleRasterizer::rasterize({triangle[0], triangle[1], triangle[2]}, {normals[0], normals[1], normals[2]},
+                                          {globalPoints[0], globalPoints[1], globalPoints[2]}, {0, 0, 0}, blockPainter);
+            TriangleRasterizer::rasterizePerPixel({triangle[0], triangle[1], triangle[2]},
+                                                  {normals[0], normals[1], normals[2]},
+                                                  {globalPoints[0], globalPoints[1], globalPoints[2]}, {0, 0, 0},
+                                                  referencePainter, screen);
+            ASSERT_EQ(blockPainter.pixelsDrawn(), referencePainter.pixelsDrawn()) << "triangle: " << i;
+            ASSERT_EQ(blockPainter.pixels(), referencePainter.pixels()) << "triangle: " << i;
+            trianglesDrawn += blockPainter.pixelsDrawn() > 0 ? 1 : 0;
+        }
+    }
+    EXPECT_GT(trianglesDrawn, 500u);
+}
+
+TEST(TriangleRasterizerTest, rasterize_occludingPainter_shouldSkipHiddenTriangle) {
+    constexpr int width = 40;
+    constexpr int height = 30;
+    std::array<glm::vec3, 3> normals = {};
+    std::array<glm::vec3, 3> globalPoints = {};
+    DepthTestPainter painter(width, height, true);
+
+    // Covers the whole screen, near the camera
+    std::array<Point, 3> near = {Point{-1, -1, 0.5f}, Point{100, -1, 0.5f}, Point{-1, 100, 0.5f}};
+    OcclusionCounters counters =
+        TriangleRasterizer::rasterize({near[0], near[1], near[2]}, {normals[0], normals[1], normals[2]},
+                                      {globalPoints[0], globalPoints[1], globalPoints[2]}, {1, 1, 1}, painter);
+    EXPECT_EQ(counters.trianglesRejected, 0u);
+    EXPECT_EQ(painter.fragmentsPainted(), static_cast<unsigned>(width * height));
+
+    std::array<Point, 3> far = {Point{3.5f, 2.5f, 0.1f}, Point{30.5f, 5.5f, 0.2f}, Point{10.5f, 25.5f, 0.4f}};
+    counters = TriangleRasterizer::rasterize({far[0], far[1], far[2]}, {normals[0], normals[1], normals[2]},
+                                             {globalPoints[0], globalPoints[1], globalPoints[2]}, {1, 1, 1}, painter);
+    EXPECT_EQ(counters.trianglesRejected, 1u);
+    EXPECT_EQ(painter.fragmentsPainted(), static_cast<unsigned>(width * height));
+}
+
+TEST(TriangleRasterizerTest, rasterize_occludingPainter_shouldDrawSameDepthAsWithoutCulling) {
+    constexpr int width = 64;
+    constexpr int height = 48;
+    std::array<glm::vec3, 3> normals = {};
+    std::array<glm::vec3, 3> globalPoints = {};
+    // The left part of the screen gets a wall near the camera, then a sloped triangle goes behind it and comes out in
+    // front of it on the right
+    std::array<Point, 3> wall = {Point{-1, -1, 0.5f}, Point{30, -1, 0.5f}, Point{-1, 200, 0.5f}};
+    std::array<Point, 3> sloped = {Point{1.5f, 1.5f, 0.1f}, Point{62.5f, 4.5f, 0.9f}, Point{3.5f, 46.5f, 0.1f}};
+
+    DepthTestPainter culling(width, height, true);
+    DepthTestPainter reference(width, height, false);
+    OcclusionCounters total;
+    for (DepthTestPainter* painter : {&culling, &reference}) {
+        for (const std::array<Point, 3>& points : {wall, sloped}) {
+            total += TriangleRasterizer::rasterize({points[0], points[1], points[2]},
+                                                   {normals[0], normals[1], normals[2]},
+                                                   {globalPoints[0], globalPoints[1], globalPoints[2]}, {1, 1, 1},
+                                                   *painter);
+        }
+    }
+
+    EXPECT_EQ(total.trianglesRejected, 0u);
+    EXPECT_GT(total.blocksRejected, 0u);
+    EXPECT_LT(culling.fragmentsPainted(), reference.fragmentsPainted());
+    for (int y = 0; y < height; ++y) {
+        for (int x = 0; x < width; ++x) {
+            ASSERT_EQ(culling.depthBuffer().depthAtPixel(x, y), reference.depthBuffer().depthAtPixel(x, y))
+                << "x: " << x << ", y: " << y;
+        }
+    }
+}
+
+TEST(TriangleRasterizerTest, rasterize_depthOnlyPainter_shouldGetSameDepths) {
+    constexpr int width = 45;
+    constexpr int height = 37;
+    std::array<glm::vec3, 3> normals = {glm::vec3(1, 0, 0), glm::vec3(0, 1, 0), glm::vec3(0, 0, 1)};
+    std::array<glm::vec3, 3> globalPoints = {glm::vec3(1, 2, 3), glm::vec3(4, 5, 6), glm::vec3(7, 8, 9)};
+
+    std::mt19937 generator(4321);
+    std::uniform_real_distribution<float> coordinate(-10.0f, 55.0f);
+    std::uniform_real_distribution<float> depth(-0.9f, 0.9f);
+    DepthRecordingPainter<true> depthOnly(width, height);
+    DepthRecordingPainter<false> full(width, height);
+    for (int i = 0; i < 50; ++i) {
+        std::array<Point, 3> points;
+        for (Point& point : points) {
+            point = Point{coordinate(generator), coordinate(generator), depth(generator)};
+        }
+        std::array<float, 3> invertedW = {0.5f, 1.0f, 2.0f};
+        TriangleRasterizer::rasterize({points[0], points[1], points[2]}, {normals[0], normals[1], normals[2]},
+                                      {globalPoints[0], globalPoints[1], globalPoints[2]},
+                                      {invertedW[0], invertedW[1], invertedW[2]}, depthOnly);
+        TriangleRasterizer::rasterize({points[0], points[1], points[2]}, {normals[0], normals[1], normals[2]},
+                                      {globalPoints[0], globalPoints[1], globalPoints[2]},
+                                      {invertedW[0], invertedW[1], invertedW[2]}, full);
+    }
+
+    EXPECT_NE(std::ranges::count(depthOnly.depths(), DepthBuffer::farthest), width * height);
+    EXPECT_EQ(depthOnly.depths(), full.depths());
+}
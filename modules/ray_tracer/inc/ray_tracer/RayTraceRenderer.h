@@ -3,50 +3,75 @@
 #include "core/Scene.h"
 #include "ray_tracer/RayTracerShaders.h"
 #include "renderer/Renderer.h"
+#include "task/TaskArena.h"
 #include "task/TaskGraph.h"
+#include "task/TaskOf.h"
 
 #include <limits>
+#include <span>
+#include <stop_token>
+#include <vector>
 
 namespace cg {
 struct HitDesc;
 
 class RayTraceRenderer {
 public:
-    void renderScene(Scene& scene, Screen auto& screen) {
-        sceneShapes_ = scene.shapes();
-
-        for (auto shape : sceneShapes_) {
-            RayTracerShaders& shaderGroup = static_cast<RayTracerShaders&>(shape->shaderGroup());
-            shaderGroup.hitDetector().initForFrame();
-        }
+    // Traces on ThreadPool::defaultPool()
+    RayTraceRenderer();
+    // The pool has to outlive the renderer
+    explicit RayTraceRenderer(ThreadPool& threadPool);
 
+    // Requesting a stop abandons a stale frame: rows that haven't been traced yet are skipped and keep their previous
+    // contents, and the call returns as soon as the rows in progress are done
+    void renderScene(Scene& scene, Screen auto& screen, std::stop_token stopToken = {}) {
         const Camera& camera = scene.camera();
         auto res = camera.resolution();
 
-        TaskBatch batch;
-        for (unsigned row = 0; row < res.height; ++row) {
-            batch.addWork([this, &camera, &scene, painter = screen.paintPixels(), row, width = res.width]() mutable {
-                for (unsigned col = 0; col < width; ++col) {
-                    Color pixelColor = shadeRay(scene, camera.castRay(col, row), 0);
-                    painter.paint(row, col, pixelColor);
-                }
-            });
+        frameArena_.reset();
+        // Hit detectors prepare for the frame in parallel, the shapes are then handed to the row loop
+        std::vector<TaskOf<Shape*>> preparedShapes;
+        for (Shape* shape : scene.shapes()) {
+            preparedShapes.emplace_back(
+                [shape]() {
+                    static_cast<RayTracerShaders&>(shape->shaderGroup()).hitDetector().initForFrame();
+                    return shape;
+                },
+                frameArena_);
         }
-        batch.startAndWait(threadPool);
+        auto traceRows = [this, &camera, &scene, &screen, &stopToken, res](std::vector<Shape*>& shapes) {
+            auto rowLoop = parallelFor(
+                IndexRange(0u, res.height),
+                [this, &shapes, &camera, &scene, &screen, &stopToken, width = res.width](IndexRange<unsigned> rows) {
+                    auto painter = screen.paintPixels();
+                    for (unsigned row = rows.begin; row < rows.end && !stopToken.stop_requested(); ++row) {
+                        for (unsigned col = 0; col < width; ++col) {
+                            Color pixelColor = shadeRay(scene, shapes, camera.castRay(col, row), 0);
+                            painter.paint(row, col, pixelColor);
+                        }
+                    }
+                },
+                frameArena_);
+            rowLoop.setLabel("trace rows");
+            rowLoop.setStopToken(stopToken);
+            return rowLoop;
+        };
+        TaskSequence frame = collectAll(std::move(preparedShapes), frameArena_).consume(std::move(traceRows));
+        frame.startAndWait(*threadPool_);
     }
 
     unsigned maxBounces() const;
     void setMaxBounces(unsigned newMaxBounces);
 
 private:
-    Color shadeRay(Scene& scene, const Ray& ray, unsigned currBounceCount) const;
-    std::optional<HitDesc> hitScene(const Ray& ray, float rayMin, float rayMax) const;
+    Color shadeRay(Scene& scene, std::span<Shape* const> shapes, const Ray& ray, unsigned currBounceCount) const;
+    std::optional<HitDesc> hitScene(std::span<Shape* const> shapes, const Ray& ray, float rayMin, float rayMax) const;
 
     static constexpr float raySurfaceOffset = 0.00005f;
 
     unsigned maxBounces_ = 5;
-    std::vector<Shape*> sceneShapes_;
-    ThreadPool threadPool;
+    TaskArena frameArena_;
+    ThreadPool* threadPool_;
 };
 
 static_assert(Renderer<RayTraceRenderer>, "RayTraceRenderer does not fulfill the Renderer concept.");
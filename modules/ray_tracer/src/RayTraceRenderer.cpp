@@ -3,9 +3,14 @@
 #include <limits>
 
 namespace cg {
-Color RayTraceRenderer::shadeRay(Scene& scene, const Ray& ray, unsigned currBounceCount) const {
+RayTraceRenderer::RayTraceRenderer() : threadPool_(&ThreadPool::defaultPool()) {}
+
+RayTraceRenderer::RayTraceRenderer(ThreadPool& threadPool) : threadPool_(&threadPool) {}
+
+Color RayTraceRenderer::shadeRay(Scene& scene, std::span<Shape* const> shapes, const Ray& ray,
+                                 unsigned currBounceCount) const {
     Color pixelColor = Color(0, 0, 0);
-    auto result = hitScene(ray, 0, std::numeric_limits<float>::infinity());
+    auto result = hitScene(shapes, ray, 0, std::numeric_limits<float>::infinity());
     if (result.has_value()) {
         const HitDesc& hit = result.value();
         Point hitPoint = hit.ray.evaluate(hit.rayHitVal);
@@ -15,7 +20,7 @@ Color RayTraceRenderer::shadeRay(Scene& scene, const Ray& ray, unsigned currBoun
             Light::DistanceDesc lightDistance = light->distanceFrom(hitPoint);
             Ray rayToLight(hitPoint + raySurfaceOffset * hit.unitNormal, lightDistance.unitDirection);
 
-            auto shadowResult = hitScene(rayToLight, 0, lightDistance.distance);
+            auto shadowResult = hitScene(shapes, rayToLight, 0, lightDistance.distance);
             if (!shadowResult.has_value()) {
                 Color reflectedLight = hit.hitShape->material().reflect(hit.unitNormal, hit.unitViewDirection,
                                                                         lightDistance.unitDirection);
@@ -27,8 +32,8 @@ Color RayTraceRenderer::shadeRay(Scene& scene, const Ray& ray, unsigned currBoun
         if (hit.hitShape->material().surfaceReflectance() != Color::black() && currBounceCount < maxBounces_) {
             auto reflectedDirection = glm::reflect(hit.ray.direction(), hit.unitNormal);
             Ray reflectedRay(hitPoint + raySurfaceOffset * hit.unitNormal, reflectedDirection);
-            pixelColor +=
-                shadeRay(scene, reflectedRay, currBounceCount + 1) * hit.hitShape->material().surfaceReflectance();
+            pixelColor += shadeRay(scene, shapes, reflectedRay, currBounceCount + 1) *
+                          hit.hitShape->material().surfaceReflectance();
         }
 
         // Ambient light
@@ -37,9 +42,10 @@ Color RayTraceRenderer::shadeRay(Scene& scene, const Ray& ray, unsigned currBoun
     return pixelColor;
 }
 
-std::optional<HitDesc> RayTraceRenderer::hitScene(const Ray& ray, float rayMin, float rayMax) const {
+std::optional<HitDesc> RayTraceRenderer::hitScene(std::span<Shape* const> shapes, const Ray& ray, float rayMin,
+                                                  float rayMax) const {
     std::optional<HitDesc> result = std::nullopt;
-    for (auto shape : sceneShapes_) {
+    for (auto shape : shapes) {
         RayTracerShaders& shaderGroup = static_cast<RayTracerShaders&>(shape->shaderGroup());
         auto hitResult = shaderGroup.hitDetector().hit(ray, rayMin, rayMax);
         if (hitResult.has_value()) {
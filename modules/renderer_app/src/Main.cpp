@@ -16,9 +16,11 @@
 #include "RayTracerShaderFactory.h"
 #include "SdlScreen.h"
 #include "ShapeFactory.h"
+#include "task/TaskTrace.h"
 
 #include "SDL2/SDL.h"
 
+#include <fstream>
 #include <iostream>
 #include <memory>
 
@@ -120,6 +122,8 @@ void runApp(Screen& screen) {
 
     SDL_Event event;
     bool done = false;
+    // F12 saves the tasks of the next frame as a Chrome trace, when built with CG_TASK_TRACING
+    bool traceNextFrame = false;
 
     // Render loop
     while (!done) {
@@ -128,6 +132,8 @@ void runApp(Screen& screen) {
             case SDL_KEYDOWN:
                 if (event.key.keysym.sym == SDLK_ESCAPE) {
                     done = true;
+                } else if (event.key.keysym.sym == SDLK_F12 && TaskTrace::enabled) {
+                    traceNextFrame = true;
                 }
                 break;
             case SDL_QUIT:
@@ -137,7 +143,18 @@ void runApp(Screen& screen) {
         }
         screen.clear();
 
+        if (traceNextFrame) {
+            TaskTrace::clear();
+            TaskTrace::setRecording(true);
+        }
         renderer.renderScene(scene, screen);
+        if (traceNextFrame) {
+            TaskTrace::setRecording(false);
+            std::ofstream traceFile("frame_trace.json");
+            TaskTrace::writeChromeJson(traceFile);
+            std::cout << "Frame trace written to frame_trace.json" << std::endl;
+            traceNextFrame = false;
+        }
 
         screen.flush();
 
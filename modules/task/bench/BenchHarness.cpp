@@ -0,0 +1,176 @@
+#include "BenchHarness.h"
+
+#include "task/PoolMetrics.h"
+#include "task/TaskTrace.h"
+
+#include <algorithm>
+#include <charconv>
+#include <iomanip>
+#include <iostream>
+#include <string_view>
+#include <thread>
+
+namespace cg::bench {
+namespace {
+constexpr std::string_view usage = "Usage: task_bench [--threads=1,2,4] [--repetitions=N] [--filter=TEXT]\n"
+                                   "                  [--format=table|csv|json] [--out=FILE]\n"
+                                   "Thread counts default to powers of two up to the number of CPUs.\n";
+
+std::vector<unsigned> defaultThreadCounts() {
+    unsigned cpuCount = std::max(std::thread::hardware_concurrency(), 1u);
+    std::vector<unsigned> threadCounts;
+    for (unsigned count = 1; count < cpuCount; count *= 2) {
+        threadCounts.push_back(count);
+    }
+    threadCounts.push_back(cpuCount);
+    return threadCounts;
+}
+
+bool parseUnsigned(std::string_view text, unsigned& value) {
+    auto [end, error] = std::from_chars(text.data(), text.data() + text.size(), value);
+    return error == std::errc() && end == text.data() + text.size() && value > 0;
+}
+
+bool parseThreadCounts(std::string_view text, std::vector<unsigned>& threadCounts) {
+    threadCounts.clear();
+    while (!text.empty()) {
+        size_t comma = text.find(',');
+        unsigned count = 0;
+        if (!parseUnsigned(text.substr(0, comma), count)) {
+            return false;
+        }
+        threadCounts.push_back(count);
+        text = comma == std::string_view::npos ? std::string_view() : text.substr(comma + 1);
+    }
+    return !threadCounts.empty();
+}
+
+std::string jsonEscaped(std::string_view text) {
+    std::string escaped;
+    for (char c : text) {
+        if (c == '"' || c == '\\') {
+            escaped += '\\';
+        }
+        escaped += c;
+    }
+    return escaped;
+}
+
+void writeTable(std::ostream& out, const std::vector<Result>& results) {
+    out << std::left << std::setw(40) << "benchmark" << std::right << std::setw(8) << "threads" << std::setw(16)
+        << "ns/op" << std::setw(16) << "min ns/op" << std::setw(16) << "op/s" << std::endl;
+    for (const Result& result : results) {
+        out << std::left << std::setw(40) << caseId(result.name, result.param) << std::right << std::setw(8)
+            << result.threadCount << std::fixed << std::setprecision(1) << std::setw(16) << result.medianNsPerOp
+            << std::setw(16) << result.minNsPerOp << std::setprecision(0) << std::setw(16) << result.opsPerSecond
+            << std::endl;
+    }
+}
+
+void writeCsv(std::ostream& out, const std::vector<Result>& results) {
+    out << "name,param,threads,operations,ns_per_op_median,ns_per_op_min,ops_per_second" << std::endl;
+    for (const Result& result : results) {
+        out << result.name << ',' << result.param << ',' << result.threadCount << ',' << result.operations << ','
+            << result.medianNsPerOp << ',' << result.minNsPerOp << ',' << result.opsPerSecond << std::endl;
+    }
+}
+
+void writeJson(std::ostream& out, const Options& options, const std::vector<Result>& results) {
+    // Context that affects the numbers, so results of different builds and machines aren't compared blindly
+    out << "{\n  \"context\": {\n"
+        << "    \"hardware_concurrency\": " << std::thread::hardware_concurrency() << ",\n"
+        << "    \"repetitions\": " << options.repetitions << ",\n"
+        << "    \"task_tracing\": " << (TaskTrace::enabled ? "true" : "false") << ",\n"
+        << "    \"task_metrics\": " << (PoolMetrics::enabled ? "true" : "false") << "\n"
+        << "  },\n  \"results\": [";
+    for (size_t i = 0; i < results.size(); ++i) {
+        const Result& result = results[i];
+        out << (i == 0 ? "\n" : ",\n") << "    {\"name\": \"" << jsonEscaped(result.name) << "\", \"param\": \""
+            << jsonEscaped(result.param) << "\", \"threads\": " << result.threadCount
+            << ", \"operations\": " << result.operations << ", \"ns_per_op_median\": " << result.medianNsPerOp
+            << ", \"ns_per_op_min\": " << result.minNsPerOp << ", \"ops_per_second\": " << result.opsPerSecond
+            << "}";
+    }
+    out << "\n  ]\n}" << std::endl;
+}
+} // namespace
+
+std::optional<Options> parseOptions(int argc, char* argv[]) {
+    Options options;
+    options.threadCounts = defaultThreadCounts();
+    for (int i = 1; i < argc; ++i) {
+        std::string_view arg = argv[i];
+        size_t equals = arg.find('=');
+        std::string_view key = arg.substr(0, equals);
+        std::string_view value = equals == std::string_view::npos ? std::string_view() : arg.substr(equals + 1);
+        bool valid = true;
+        if (key == "--threads") {
+            valid = parseThreadCounts(value, options.threadCounts);
+        } else if (key == "--repetitions") {
+            valid = parseUnsigned(value, options.repetitions);
+        } else if (key == "--filter") {
+            options.filter = value;
+        } else if (key == "--format" && value == "table") {
+            options.format = OutputFormat::Table;
+        } else if (key == "--format" && value == "csv") {
+            options.format = OutputFormat::Csv;
+        } else if (key == "--format" && value == "json") {
+            options.format = OutputFormat::Json;
+        } else if (key == "--out" && !value.empty()) {
+            options.outputPath = value;
+        } else {
+            valid = false;
+        }
+        if (!valid) {
+            if (key != "--help") {
+                std::cerr << "Invalid argument: " << arg << std::endl;
+            }
+            std::cerr << usage;
+            return std::nullopt;
+        }
+    }
+    return options;
+}
+
+std::string caseId(const std::string& name, const std::string& param) {
+    return param.empty() ? name : name + "/" + param;
+}
+
+Result runBenchmark(const BenchmarkCase& benchmark, unsigned threadCount, unsigned repetitions) {
+    benchmark.run(threadCount);
+
+    std::vector<double> nsPerOp;
+    uint64_t operations = 0;
+    for (unsigned i = 0; i < repetitions; ++i) {
+        Sample sample = benchmark.run(threadCount);
+        operations = sample.operations;
+        nsPerOp.push_back(std::chrono::duration<double, std::nano>(sample.elapsed).count() /
+                          static_cast<double>(std::max<uint64_t>(sample.operations, 1)));
+    }
+    std::ranges::sort(nsPerOp);
+
+    Result result;
+    result.name = benchmark.name;
+    result.param = benchmark.param;
+    result.threadCount = threadCount;
+    result.operations = operations;
+    result.medianNsPerOp = nsPerOp[nsPerOp.size() / 2];
+    result.minNsPerOp = nsPerOp.front();
+    result.opsPerSecond = result.medianNsPerOp > 0 ? 1e9 / result.medianNsPerOp : 0;
+    return result;
+}
+
+void writeResults(std::ostream& out, OutputFormat format, const Options& options, const std::vector<Result>& results) {
+    switch (format) {
+    case OutputFormat::Table:
+        writeTable(out, results);
+        break;
+    case OutputFormat::Csv:
+        writeCsv(out, results);
+        break;
+    case OutputFormat::Json:
+        writeJson(out, options, results);
+        break;
+    }
+}
+} // namespace cg::bench
@@ -0,0 +1,61 @@
+#pragma once
+
+#include <chrono>
+#include <cstdint>
+#include <functional>
+#include <iosfwd>
+#include <optional>
+#include <string>
+#include <vector>
+
+namespace cg::bench {
+// What one run of a benchmark case did: `operations` units of work (tasks, fork-joins, messages...) in `elapsed`.
+// Runs time themselves, so setup like creating the pool or building the graph can be left out.
+struct Sample {
+    uint64_t operations = 0;
+    std::chrono::duration<double> elapsed{0};
+};
+
+struct BenchmarkCase {
+    // Same for all variants of a benchmark, e.g. "fork_join"
+    std::string name;
+    // Variant, e.g. the batch width. Empty if there is only one.
+    std::string param;
+    // Called once per repetition with the number of threads to use
+    std::function<Sample(unsigned threadCount)> run;
+};
+
+struct Result {
+    std::string name;
+    std::string param;
+    unsigned threadCount = 0;
+    // Per repetition
+    uint64_t operations = 0;
+    double medianNsPerOp = 0;
+    double minNsPerOp = 0;
+    // Based on the median
+    double opsPerSecond = 0;
+};
+
+enum class OutputFormat { Table, Csv, Json };
+
+struct Options {
+    std::vector<unsigned> threadCounts;
+    unsigned repetitions = 5;
+    // Only cases whose "name/param" contains this are run
+    std::string filter;
+    OutputFormat format = OutputFormat::Table;
+    // Empty for stdout
+    std::string outputPath;
+};
+
+// Prints usage and returns nullopt if the arguments can't be parsed or help was asked for
+std::optional<Options> parseOptions(int argc, char* argv[]);
+std::string caseId(const std::string& name, const std::string& param);
+// One warm-up run, then `repetitions` measured ones
+Result runBenchmark(const BenchmarkCase& benchmark, unsigned threadCount, unsigned repetitions);
+void writeResults(std::ostream& out, OutputFormat format, const Options& options, const std::vector<Result>& results);
+
+std::vector<BenchmarkCase> taskGraphBenchmarks();
+std::vector<BenchmarkCase> messageQueueBenchmarks();
+} // namespace cg::bench
@@ -0,0 +1,45 @@
+#include "BenchHarness.h"
+
+#include <fstream>
+#include <iostream>
+#include <optional>
+#include <vector>
+
+using namespace cg::bench;
+
+int main(int argc, char* argv[]) {
+    std::optional<Options> options = parseOptions(argc, argv);
+    if (!options.has_value()) {
+        return 1;
+    }
+
+    std::vector<BenchmarkCase> benchmarks = taskGraphBenchmarks();
+    for (BenchmarkCase& benchmark : messageQueueBenchmarks()) {
+        benchmarks.push_back(std::move(benchmark));
+    }
+
+    std::vector<Result> results;
+    for (const BenchmarkCase& benchmark : benchmarks) {
+        std::string id = caseId(benchmark.name, benchmark.param);
+        if (id.find(options->filter) == std::string::npos) {
+            continue;
+        }
+        for (unsigned threadCount : options->threadCounts) {
+            // Progress goes to stderr, so stdout only holds the results
+            std::cerr << "Running " << id << " with " << threadCount << " threads" << std::endl;
+            results.push_back(runBenchmark(benchmark, threadCount, options->repetitions));
+        }
+    }
+
+    if (options->outputPath.empty()) {
+        writeResults(std::cout, options->format, *options, results);
+    } else {
+        std::ofstream file(options->outputPath);
+        if (!file) {
+            std::cerr << "Can't open " << options->outputPath << std::endl;
+            return 1;
+        }
+        writeResults(file, options->format, *options, results);
+    }
+    return 0;
+}
@@ -0,0 +1,87 @@
+#include "BenchHarness.h"
+
+#include "common/TimeProfiler.h"
+#include "task/LockFreeMessageQueue.h"
+#include "task/MessageQueue.h"
+
+#include <algorithm>
+#include <array>
+#include <atomic>
+#include <cstdint>
+#include <iostream>
+#include <span>
+#include <thread>
+#include <vector>
+
+namespace cg::bench {
+namespace {
+constexpr uint64_t totalMessages = 1 << 19;
+constexpr size_t consumerBatchSize = 16;
+
+// Runs `threadCount` producers and `threadCount` consumers over one queue, measured per message. Consumers take up to
+// `consumerBatch` messages per lock when it's larger than 1 and the queue supports it.
+template <typename Queue>
+Sample measureThroughput(Queue& queue, unsigned threadCount, size_t consumerBatch = 1) {
+    uint64_t msgsPerThread = totalMessages / threadCount;
+    std::atomic<uint64_t> checksum = 0;
+    TimeProfiler<std::chrono::steady_clock> profiler;
+    {
+        std::vector<std::jthread> threads;
+        for (unsigned i = 0; i < threadCount; ++i) {
+            threads.emplace_back([&queue, msgsPerThread]() {
+                for (uint64_t msg = 0; msg < msgsPerThread; ++msg) {
+                    queue.post(msg);
+                }
+            });
+            threads.emplace_back([&queue, &checksum, msgsPerThread, consumerBatch]() {
+                uint64_t sum = 0;
+                if constexpr (requires(std::span<uint64_t> out) { queue.takeUpTo(out); }) {
+                    if (consumerBatch > 1) {
+                        std::array<uint64_t, consumerBatchSize> msgs;
+                        for (uint64_t taken = 0; taken < msgsPerThread;) {
+                            size_t count = std::min<uint64_t>(consumerBatch, msgsPerThread - taken);
+                            count = queue.takeUpTo(std::span(msgs).first(count));
+                            for (size_t i = 0; i < count; ++i) {
+                                sum += msgs[i];
+                            }
+                            taken += count;
+                        }
+                        checksum += sum;
+                        return;
+                    }
+                }
+                for (uint64_t msg = 0; msg < msgsPerThread; ++msg) {
+                    sum += queue.take();
+                }
+                checksum += sum;
+            });
+        }
+    }
+    Sample sample{msgsPerThread * threadCount, profiler.time<std::chrono::duration<double>>()};
+    if (checksum != threadCount * (msgsPerThread * (msgsPerThread - 1) / 2)) {
+        std::cerr << "Unexpected checksum, messages were lost or duplicated" << std::endl;
+    }
+    return sample;
+}
+} // namespace
+
+std::vector<BenchmarkCase> messageQueueBenchmarks() {
+    return {
+        {"message_queue", "mutex",
+         [](unsigned threadCount) {
+             MessageQueue<uint64_t> queue;
+             return measureThroughput(queue, threadCount);
+         }},
+        {"message_queue", "mutex_take_up_to",
+         [](unsigned threadCount) {
+             MessageQueue<uint64_t> queue;
+             return measureThroughput(queue, threadCount, consumerBatchSize);
+         }},
+        {"message_queue", "lock_free",
+         [](unsigned threadCount) {
+             LockFreeMessageQueue<uint64_t> queue;
+             return measureThroughput(queue, threadCount);
+         }},
+    };
+}
+} // namespace cg::bench
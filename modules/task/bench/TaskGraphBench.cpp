@@ -0,0 +1,145 @@
+#include "BenchHarness.h"
+
+#include "common/TimeProfiler.h"
+#include "task/TaskGraph.h"
+#include "task/ThreadPool.h"
+
+#include <algorithm>
+#include <array>
+#include <atomic>
+#include <iostream>
+#include <string>
+
+namespace cg::bench {
+namespace {
+using Profiler = TimeProfiler<std::chrono::steady_clock>;
+
+constexpr uint64_t emptyTaskCount = 1 << 16;
+constexpr std::array<unsigned, 5> forkJoinWidths = {1, 8, 64, 512, 4096};
+// Enough fork-joins per run for the widest batch to still take a few milliseconds
+constexpr uint64_t forkJoinTaskCount = 1 << 16;
+constexpr uint64_t sequenceStageCount = 1 << 13;
+constexpr std::array<unsigned, 3> dynamicWorkWidths = {4, 16, 64};
+constexpr uint64_t dynamicWorkTaskCount = 1 << 15;
+constexpr uint64_t poolTaskCount = 1 << 17;
+
+Sample elapsedSince(const Profiler& profiler, uint64_t operations) {
+    return Sample{operations, profiler.time<std::chrono::duration<double>>()};
+}
+
+// Cost of posting and running a task, without any graph around it. The calling thread runs tasks too while waiting,
+// like it does in startAndWait().
+Sample runEmptyTasks(unsigned threadCount) {
+    ThreadPool threadPool(threadCount);
+    std::atomic<uint64_t> remaining = emptyTaskCount;
+    std::atomic<bool> done = false;
+    Profiler profiler;
+    for (uint64_t i = 0; i < emptyTaskCount; ++i) {
+        threadPool.postTask([&threadPool, &remaining, &done]() {
+            if (remaining.fetch_sub(1) == 1) {
+                threadPool.notifyDone(done);
+            }
+        });
+    }
+    threadPool.runTasksUntil(done);
+    return elapsedSince(profiler, emptyTaskCount);
+}
+
+// Time from building a batch of `width` empty tasks until all of them are done, per batch
+Sample runForkJoin(unsigned threadCount, unsigned width) {
+    ThreadPool threadPool(threadCount);
+    uint64_t iterations = std::max<uint64_t>(forkJoinTaskCount / width, 16);
+    Profiler profiler;
+    for (uint64_t i = 0; i < iterations; ++i) {
+        TaskBatch batch;
+        for (unsigned task = 0; task < width; ++task) {
+            batch.addWork([]() {});
+        }
+        batch.startAndWait(threadPool);
+    }
+    return elapsedSince(profiler, iterations);
+}
+
+// Time from one step of a sequence finishing until the next one starts, per step
+Sample runSequenceHandoff(unsigned threadCount) {
+    ThreadPool threadPool(threadCount);
+    TaskSequence sequence;
+    for (uint64_t i = 0; i < sequenceStageCount; ++i) {
+        sequence.addWork([]() {});
+    }
+    Profiler profiler;
+    sequence.startAndWait(threadPool);
+    return elapsedSince(profiler, sequenceStageCount);
+}
+
+// Batch of `width` generators, each adding a batch of `width` empty tasks when it runs. Measured per outer graph.
+Sample runDynamicWork(unsigned threadCount, unsigned width) {
+    ThreadPool threadPool(threadCount);
+    uint64_t iterations = std::max<uint64_t>(dynamicWorkTaskCount / (width * width), 4);
+    Profiler profiler;
+    for (uint64_t i = 0; i < iterations; ++i) {
+        TaskBatch outer;
+        for (unsigned generator = 0; generator < width; ++generator) {
+            outer.addDynamicWork([width]() {
+                TaskBatch inner;
+                for (unsigned task = 0; task < width; ++task) {
+                    inner.addWork([]() {});
+                }
+                return inner;
+            });
+        }
+        outer.startAndWait(threadPool);
+    }
+    return elapsedSince(profiler, iterations);
+}
+
+// Tasks per second for a large batch of tiny tasks, for each shared queue order and task batch size of the pool
+Sample runPoolThroughput(unsigned threadCount, QueueOrder order, unsigned maxTaskBatch) {
+    ThreadPool::Options options;
+    options.threadCount = threadCount;
+    options.queueOrder = order;
+    options.maxTaskBatch = maxTaskBatch;
+    ThreadPool threadPool(options);
+    std::atomic<uint64_t> sum = 0;
+    TaskBatch batch;
+    for (uint64_t i = 0; i < poolTaskCount; ++i) {
+        batch.addWork([&sum, i]() {
+            sum.fetch_add(i, std::memory_order_relaxed);
+        });
+    }
+    Profiler profiler;
+    batch.startAndWait(threadPool);
+    Sample sample = elapsedSince(profiler, poolTaskCount);
+    if (sum != poolTaskCount * (poolTaskCount - 1) / 2) {
+        std::cerr << "Unexpected sum, tasks were lost or run twice" << std::endl;
+    }
+    return sample;
+}
+} // namespace
+
+std::vector<BenchmarkCase> taskGraphBenchmarks() {
+    std::vector<BenchmarkCase> benchmarks;
+    benchmarks.push_back({"empty_task", "", runEmptyTasks});
+    for (unsigned width : forkJoinWidths) {
+        benchmarks.push_back({"fork_join", std::to_string(width), [width](unsigned threadCount) {
+                                  return runForkJoin(threadCount, width);
+                              }});
+    }
+    benchmarks.push_back({"sequence_handoff", "", runSequenceHandoff});
+    for (unsigned width : dynamicWorkWidths) {
+        benchmarks.push_back({"dynamic_work", std::to_string(width), [width](unsigned threadCount) {
+                                  return runDynamicWork(threadCount, width);
+                              }});
+    }
+    for (QueueOrder order : {QueueOrder::Fifo, QueueOrder::Lifo}) {
+        for (unsigned maxTaskBatch : {1u, 8u}) {
+            std::string param =
+                std::string(order == QueueOrder::Fifo ? "fifo" : "lifo") + "_batch" + std::to_string(maxTaskBatch);
+            benchmarks.push_back({"pool_throughput", param, [order, maxTaskBatch](unsigned threadCount) {
+                                      return runPoolThroughput(threadCount, order, maxTaskBatch);
+                                  }});
+        }
+    }
+    return benchmarks;
+}
+} // namespace cg::bench
@@ -0,0 +1,356 @@
+#pragma once
+
+#include "task/Task.h"
+#include "task/TaskGraph.h"
+#include "task/ThreadPool.h"
+
+#include <atomic>
+#include <cassert>
+#include <coroutine>
+#include <exception>
+#include <optional>
+#include <tuple>
+#include <type_traits>
+#include <utility>
+
+namespace cg {
+// Coroutine running on a ThreadPool. It doesn't start until it's started like a graph or awaited from another CoTask,
+// which then runs it on the same pool. Inside, `co_await` takes other CoTasks, any RunnableGraph (moved in) and
+// whenAll(...), and suspends the coroutine instead of blocking its thread, so everything the stages share can simply
+// be local variables. CoTask<void> is a RunnableGraph itself, so coroutines can be added to task graphs.
+template <typename T = void>
+class CoTask;
+
+template <typename... Graphs>
+class WhenAll;
+
+namespace detail {
+template <typename T>
+struct IsCoTask : std::false_type {};
+template <typename T>
+struct IsCoTask<CoTask<T>> : std::true_type {};
+
+// CoTasks with a result aren't RunnableGraphs, but can still be awaited together
+template <typename T>
+concept AwaitableGraph = RunnableGraph<T> || IsCoTask<T>::value;
+
+class CoTaskPromiseBase {
+public:
+    std::suspend_always initial_suspend() noexcept { return {}; }
+
+    struct FinalAwaiter {
+        bool await_ready() noexcept { return false; }
+
+        template <typename Promise>
+        std::coroutine_handle<> await_suspend(std::coroutine_handle<Promise> handle) noexcept {
+            CoTaskPromiseBase& promise = handle.promise();
+            if (promise.awaiting_) {
+                return promise.awaiting_;
+            }
+            Task continuation = std::move(promise.continuation_);
+            if (promise.detached_) {
+                // Nobody is left to receive the exception
+                if (promise.exception_) {
+                    std::terminate();
+                }
+                handle.destroy();
+            }
+            // Nothing in the frame may be touched from here on, the continuation may destroy it
+            if (continuation) {
+                continuation();
+            }
+            return std::noop_coroutine();
+        }
+
+        void await_resume() noexcept {}
+    };
+    FinalAwaiter final_suspend() noexcept { return {}; }
+
+    void unhandled_exception() { exception_ = std::current_exception(); }
+
+    template <typename U>
+    auto await_transform(CoTask<U>&& task);
+    template <typename... Graphs>
+    WhenAll<Graphs...> await_transform(WhenAll<Graphs...>&& whenAll);
+    template <RunnableGraph Graph>
+        requires(!IsCoTask<std::remove_cvref_t<Graph>>::value)
+    auto await_transform(Graph&& graph);
+
+protected:
+    void rethrowIfFailed() {
+        if (exception_) {
+            std::rethrow_exception(std::exchange(exception_, nullptr));
+        }
+    }
+
+private:
+    template <typename U>
+    friend class cg::CoTask;
+
+    ThreadPool* threadPool_ = nullptr;
+    // Coroutine that awaits this one, resumed when this one is done
+    std::coroutine_handle<> awaiting_;
+    // Called when done if no coroutine awaits this one
+    Task continuation_;
+    // Started as a graph, so the frame destroys itself when done
+    bool detached_ = false;
+    ThreadPool::Priority priority_ = ThreadPool::Priority::Normal;
+    const char* label_ = nullptr;
+    std::exception_ptr exception_;
+};
+
+template <typename T>
+class CoTaskPromise : public CoTaskPromiseBase {
+public:
+    CoTask<T> get_return_object() { return CoTask<T>(std::coroutine_handle<CoTaskPromise>::from_promise(*this)); }
+
+    template <typename U>
+        requires std::convertible_to<U, T>
+    void return_value(U&& value) {
+        result_.emplace(std::forward<U>(value));
+    }
+
+    T takeResult() {
+        rethrowIfFailed();
+        assert(result_.has_value());
+        return std::move(*result_);
+    }
+
+private:
+    std::optional<T> result_;
+};
+
+template <>
+class CoTaskPromise<void> : public CoTaskPromiseBase {
+public:
+    CoTask<void> get_return_object();
+    void return_void() {}
+    void takeResult() { rethrowIfFailed(); }
+};
+
+// Resumes the awaiting coroutine once the graph is done. The graph can finish on another thread before its start()
+// returns, so whichever of the two finishes last lets the coroutine continue.
+template <RunnableGraph Graph>
+class GraphAwaiter {
+public:
+    GraphAwaiter(Graph&& graph, ThreadPool& threadPool) : graph_(std::move(graph)), threadPool_(&threadPool) {}
+
+    bool await_ready() const noexcept { return false; }
+    bool await_suspend(std::coroutine_handle<> handle) {
+        handle_ = handle;
+        graph_.start(*threadPool_, [this]() {
+            if (pendingCount_.fetch_sub(1) == 1) {
+                handle_.resume();
+            }
+        });
+        return pendingCount_.fetch_sub(1) != 1;
+    }
+    void await_resume() const noexcept {}
+
+private:
+    Graph graph_;
+    ThreadPool* threadPool_;
+    std::coroutine_handle<> handle_;
+    std::atomic<int> pendingCount_ = 2;
+};
+} // namespace detail
+
+template <typename T>
+class [[nodiscard]] CoTask {
+public:
+    using promise_type = detail::CoTaskPromise<T>;
+
+    CoTask(CoTask&& other) noexcept : handle_(std::exchange(other.handle_, {})) {}
+    CoTask& operator=(CoTask&& other) noexcept {
+        if (this != &other) {
+            destroy();
+            handle_ = std::exchange(other.handle_, {});
+        }
+        return *this;
+    }
+    ~CoTask() { destroy(); }
+
+    // Only apply to the task that starts the coroutine, awaited CoTasks continue on the thread of the awaiting one
+    void setPriority(ThreadPool::Priority priority) { handle_.promise().priority_ = priority; }
+    void setLabel(const char* label) { handle_.promise().label_ = label; }
+
+    // Runs the coroutine on `threadPool` and calls `continuation` once it's done. The coroutine frees itself, so its
+    // result is discarded.
+    void start(ThreadPool& threadPool) {
+        start(threadPool, []() {});
+    }
+
+    template <TaskCallable C>
+    void start(ThreadPool& threadPool, C&& continuation) {
+        assert(handle_ && "CoTask was already started.");
+        promise_type& promise = handle_.promise();
+        promise.threadPool_ = &threadPool;
+        promise.continuation_ = Task(std::forward<C>(continuation));
+        promise.detached_ = true;
+        threadPool.postTask(
+            [handle = std::exchange(handle_, {})]() {
+                handle.resume();
+            },
+            promise.priority_, promise.label_);
+    }
+
+    // The calling thread runs pool tasks until the coroutine is done, see ThreadPool::runTasksUntil
+    T startAndWait(ThreadPool& threadPool) {
+        std::atomic<bool> done = false;
+        startOwned(threadPool, [&threadPool, &done]() {
+            threadPool.notifyDone(done);
+        });
+        threadPool.runTasksUntil(done);
+        return handle_.promise().takeResult();
+    }
+
+    // Awaiting a CoTask runs it right away on the awaiting thread and continues the awaiting coroutine when it's done
+    class Awaiter {
+    public:
+        bool await_ready() const noexcept { return false; }
+        std::coroutine_handle<> await_suspend(std::coroutine_handle<> awaiting) {
+            task_.handle_.promise().awaiting_ = awaiting;
+            return task_.handle_;
+        }
+        T await_resume() { return task_.handle_.promise().takeResult(); }
+
+    private:
+        friend class detail::CoTaskPromiseBase;
+
+        Awaiter(CoTask&& task, ThreadPool& threadPool) : task_(std::move(task)) {
+            assert(task_.handle_ && "CoTask was already started.");
+            task_.handle_.promise().threadPool_ = &threadPool;
+        }
+
+        CoTask task_;
+    };
+
+private:
+    friend class detail::CoTaskPromise<T>;
+    template <typename... Graphs>
+    friend class WhenAll;
+
+    explicit CoTask(std::coroutine_handle<promise_type> handle) : handle_(handle) {}
+
+    // Like start(), but the frame stays alive until this object is destroyed, so the result can still be taken
+    template <TaskCallable C>
+    void startOwned(ThreadPool& threadPool, C&& continuation) {
+        assert(handle_ && "CoTask was already started.");
+        promise_type& promise = handle_.promise();
+        promise.threadPool_ = &threadPool;
+        promise.continuation_ = Task(std::forward<C>(continuation));
+        threadPool.postTask(
+            [handle = handle_]() {
+                handle.resume();
+            },
+            promise.priority_, promise.label_);
+    }
+
+    T takeResult() { return handle_.promise().takeResult(); }
+
+    void destroy() {
+        if (handle_) {
+            std::exchange(handle_, {}).destroy();
+        }
+    }
+
+    std::coroutine_handle<promise_type> handle_;
+};
+
+static_assert(RunnableGraph<CoTask<>>, "CoTask<void> does not fulfill the RunnableGraph concept.");
+
+inline CoTask<void> detail::CoTaskPromise<void>::get_return_object() {
+    return CoTask<void>(std::coroutine_handle<CoTaskPromise>::from_promise(*this));
+}
+
+// Awaitable that runs all graphs at once and continues when every one of them is done. If all of them are CoTasks with
+// a result, awaiting gives a tuple of the results.
+template <typename... Graphs>
+class WhenAll {
+    template <typename G>
+    static constexpr bool hasResult = [] {
+        if constexpr (detail::IsCoTask<G>::value) {
+            return !std::is_void_v<decltype(std::declval<G&>().takeResult())>;
+        } else {
+            return false;
+        }
+    }();
+
+public:
+    static constexpr bool returnsResults = sizeof...(Graphs) > 0 && (hasResult<Graphs> && ...);
+
+    explicit WhenAll(Graphs&&... graphs) : graphs_(std::move(graphs)...) {}
+    // Only moved before it's awaited
+    WhenAll(WhenAll&& other) noexcept : graphs_(std::move(other.graphs_)), threadPool_(other.threadPool_) {}
+
+    bool await_ready() const noexcept { return sizeof...(Graphs) == 0; }
+    bool await_suspend(std::coroutine_handle<> handle) {
+        handle_ = handle;
+        pendingCount_.store(sizeof...(Graphs) + 1);
+        std::apply(
+            [this](auto&... graphs) {
+                (startGraph(graphs), ...);
+            },
+            graphs_);
+        // Like GraphAwaiter, this counts as one more graph, so nothing resumes the coroutine while graphs are started
+        return pendingCount_.fetch_sub(1) != 1;
+    }
+    auto await_resume() {
+        if constexpr (returnsResults) {
+            return std::apply(
+                [](auto&... tasks) {
+                    return std::tuple(tasks.takeResult()...);
+                },
+                graphs_);
+        }
+    }
+
+private:
+    friend class detail::CoTaskPromiseBase;
+
+    template <typename G>
+    void startGraph(G& graph) {
+        auto graphDone = [this]() {
+            if (pendingCount_.fetch_sub(1) == 1) {
+                handle_.resume();
+            }
+        };
+        if constexpr (detail::IsCoTask<G>::value) {
+            graph.startOwned(*threadPool_, graphDone);
+        } else {
+            graph.start(*threadPool_, graphDone);
+        }
+    }
+
+    std::tuple<Graphs...> graphs_;
+    ThreadPool* threadPool_ = nullptr;
+    std::coroutine_handle<> handle_;
+    std::atomic<size_t> pendingCount_ = 0;
+};
+
+template <typename... Graphs>
+    requires(detail::AwaitableGraph<Graphs> && ...)
+WhenAll<Graphs...> whenAll(Graphs... graphs) {
+    return WhenAll<Graphs...>(std::move(graphs)...);
+}
+
+template <typename U>
+auto detail::CoTaskPromiseBase::await_transform(CoTask<U>&& task) {
+    assert(threadPool_ != nullptr);
+    return typename CoTask<U>::Awaiter(std::move(task), *threadPool_);
+}
+
+template <typename... Graphs>
+WhenAll<Graphs...> detail::CoTaskPromiseBase::await_transform(WhenAll<Graphs...>&& whenAll) {
+    assert(threadPool_ != nullptr);
+    whenAll.threadPool_ = threadPool_;
+    return std::move(whenAll);
+}
+
+template <RunnableGraph Graph>
+    requires(!detail::IsCoTask<std::remove_cvref_t<Graph>>::value)
+auto detail::CoTaskPromiseBase::await_transform(Graph&& graph) {
+    assert(threadPool_ != nullptr);
+    return GraphAwaiter<std::remove_cvref_t<Graph>>(std::move(graph), *threadPool_);
+}
+} // namespace cg
@@ -0,0 +1,44 @@
+#pragma once
+
+#include <string>
+#include <string_view>
+#include <thread>
+#include <vector>
+
+namespace cg {
+struct LogicalCpu {
+    // Index the OS uses for the CPU, used for pinning
+    unsigned id;
+    // Dense index of the physical core, shared by SMT siblings
+    unsigned core;
+    // NUMA node the CPU belongs to
+    unsigned node;
+};
+
+// Logical CPUs this process is allowed to run on, with their physical core and NUMA node
+class CpuTopology {
+public:
+    explicit CpuTopology(std::vector<LogicalCpu> cpus);
+
+    // Falls back to a single node without SMT if the OS doesn't provide the topology
+    static CpuTopology detect();
+
+    const std::vector<LogicalCpu>& logicalCpus() const;
+    unsigned physicalCoreCount() const;
+    unsigned nodeCount() const;
+
+    // CPUs in the order workers should be pinned to them: first one CPU of each physical core, grouped by node, then
+    // (if included) the remaining SMT siblings in the same order.
+    std::vector<LogicalCpu> pinningOrder(bool includeSmtSiblings) const;
+
+    // Parses Linux CPU list format, e.g. "0-3,8,10-11"
+    static std::vector<unsigned> parseCpuList(std::string_view list);
+
+private:
+    std::vector<LogicalCpu> cpus_;
+};
+
+// Both return false if the OS doesn't support the operation or it failed
+bool pinThreadToCpu(std::thread::native_handle_type thread, unsigned cpuId);
+bool setThreadName(std::thread::native_handle_type thread, const std::string& name);
+} // namespace cg
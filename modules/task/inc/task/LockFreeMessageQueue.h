@@ -0,0 +1,168 @@
+#pragma once
+
+#include <atomic>
+#include <cassert>
+#include <concepts>
+#include <cstddef>
+#include <cstdint>
+#include <memory>
+#include <new>
+#include <optional>
+#include <span>
+#include <thread>
+
+namespace cg {
+// Bounded multi-producer multi-consumer queue with the same interface as MessageQueue, based on Dmitry Vyukov's
+// ring buffer where each cell carries a sequence number telling producers and consumers whose turn it is. Posting and
+// taking never lock; only take() goes to the kernel, and only once the queue has been observed empty.
+// Since the queue is bounded, post() backs off (yields) while the queue is full.
+template <typename T>
+class LockFreeMessageQueue {
+    static_assert(std::move_constructible<T>);
+
+public:
+    static constexpr size_t defaultCapacity = 1024;
+
+    explicit LockFreeMessageQueue(size_t capacity = defaultCapacity)
+        : mask_(roundUpToPowerOf2(capacity) - 1), cells_(std::make_unique<Cell[]>(mask_ + 1)) {
+        for (size_t i = 0; i <= mask_; ++i) {
+            cells_[i].sequence.store(i, std::memory_order_relaxed);
+        }
+    }
+    ~LockFreeMessageQueue() {
+        while (tryTake().has_value()) {
+        }
+    }
+    LockFreeMessageQueue(const LockFreeMessageQueue&) = delete;
+    LockFreeMessageQueue& operator=(const LockFreeMessageQueue&) = delete;
+
+    template <typename U>
+        requires std::convertible_to<U, T>
+    bool tryPost(U&& msg) {
+        size_t pos = enqueuePos_.load(std::memory_order_relaxed);
+        Cell* cell;
+        while (true) {
+            cell = &cells_[pos & mask_];
+            size_t seq = cell->sequence.load(std::memory_order_acquire);
+            auto diff = static_cast<std::intptr_t>(seq) - static_cast<std::intptr_t>(pos);
+            if (diff == 0) {
+                if (enqueuePos_.compare_exchange_weak(pos, pos + 1, std::memory_order_relaxed)) {
+                    break;
+                }
+            } else if (diff < 0) {
+                // The cell still holds a message from the previous lap, so the queue is full
+                return false;
+            } else {
+                pos = enqueuePos_.load(std::memory_order_relaxed);
+            }
+        }
+        new (cell->storage) T(std::forward<U>(msg));
+        cell->sequence.store(pos + 1, std::memory_order_release);
+        notifyPosted();
+        return true;
+    }
+
+    template <typename U>
+        requires std::convertible_to<U, T>
+    void post(U&& msg) {
+        T tmp(std::forward<U>(msg));
+        while (!tryPost(std::move(tmp))) {
+            std::this_thread::yield();
+        }
+    }
+
+    void post(std::span<T> msgs) {
+        for (T& msg : msgs) {
+            post(std::move(msg));
+        }
+    }
+
+    T take() {
+        while (true) {
+            for (unsigned i = 0; i < spinCount; ++i) {
+                auto optMsg = tryTake();
+                if (optMsg.has_value()) {
+                    return std::move(optMsg.value());
+                }
+            }
+            // Announce ourselves before the final check, so a producer either sees the waiter or we see its message
+            waiterCount_.fetch_add(1);
+            std::atomic_thread_fence(std::memory_order_seq_cst);
+            uint32_t epoch = wakeEpoch_.load();
+            auto optMsg = tryTake();
+            if (optMsg.has_value()) {
+                waiterCount_.fetch_sub(1);
+                return std::move(optMsg.value());
+            }
+            wakeEpoch_.wait(epoch);
+            waiterCount_.fetch_sub(1);
+        }
+    }
+
+    std::optional<T> tryTake() {
+        size_t pos = dequeuePos_.load(std::memory_order_relaxed);
+        Cell* cell;
+        while (true) {
+            cell = &cells_[pos & mask_];
+            size_t seq = cell->sequence.load(std::memory_order_acquire);
+            auto diff = static_cast<std::intptr_t>(seq) - static_cast<std::intptr_t>(pos + 1);
+            if (diff == 0) {
+                if (dequeuePos_.compare_exchange_weak(pos, pos + 1, std::memory_order_relaxed)) {
+                    break;
+                }
+            } else if (diff < 0) {
+                return std::nullopt;
+            } else {
+                pos = dequeuePos_.load(std::memory_order_relaxed);
+            }
+        }
+        T* stored = std::launder(reinterpret_cast<T*>(cell->storage));
+        std::optional<T> msg(std::move(*stored));
+        stored->~T();
+        // Hand the cell over to the producer of the next lap
+        cell->sequence.store(pos + mask_ + 1, std::memory_order_release);
+        return msg;
+    }
+
+    size_t capacity() const { return mask_ + 1; }
+
+    // For debug and testing use only, approximate while other threads are using the queue
+    size_t size() const {
+        return enqueuePos_.load(std::memory_order_relaxed) - dequeuePos_.load(std::memory_order_relaxed);
+    }
+
+private:
+    struct Cell {
+        std::atomic<size_t> sequence;
+        alignas(T) std::byte storage[sizeof(T)];
+    };
+
+    static constexpr unsigned spinCount = 64;
+
+    static size_t roundUpToPowerOf2(size_t value) {
+        assert(value > 0);
+        size_t result = 1;
+        while (result < value) {
+            result <<= 1;
+        }
+        return result;
+    }
+
+    void notifyPosted() {
+        // Pairs with the waiter count increment in take(): either we see the waiter, or the waiter sees the message
+        std::atomic_thread_fence(std::memory_order_seq_cst);
+        if (waiterCount_.load(std::memory_order_relaxed) > 0) {
+            wakeEpoch_.fetch_add(1);
+            wakeEpoch_.notify_one();
+        }
+    }
+
+    const size_t mask_;
+    std::unique_ptr<Cell[]> cells_;
+
+    alignas(64) std::atomic<size_t> enqueuePos_ = 0;
+    alignas(64) std::atomic<size_t> dequeuePos_ = 0;
+    alignas(64) std::atomic<uint32_t> waiterCount_ = 0;
+    std::atomic<uint32_t> wakeEpoch_ = 0;
+};
+} // namespace cg
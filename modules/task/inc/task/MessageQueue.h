@@ -1,35 +1,50 @@
 #pragma once
 
+#include <algorithm>
+#include <atomic>
 #include <concepts>
 #include <condition_variable>
+#include <cstdint>
 #include <deque>
 #include <iterator>
 #include <mutex>
 #include <optional>
+#include <span>
 
 #include "task/Task.h"
 
 namespace cg {
+enum class QueueOrder : uint8_t {
+    // Oldest message first
+    Fifo,
+    // Most recently posted message first, its data is the most likely to still be in cache
+    Lifo
+};
+
 template <typename T, typename Container = std::deque<T>>
 class MessageQueue {
     static_assert(std::move_constructible<T>);
 
 public:
+    explicit MessageQueue(QueueOrder order = QueueOrder::Fifo) : order_(order) {}
+
     template <typename U>
         requires std::convertible_to<U, T>
     void post(U&& msg) {
         {
             std::scoped_lock lock(mtx_);
             messages_.push_back(std::forward<U>(msg));
+            size_.store(messages_.size(), std::memory_order_release);
         }
         hasMessagesCond_.notify_one();
     }
 
-    void post(std::vector<T>& msgs) {
+    void post(std::span<T> msgs) {
         {
             std::scoped_lock lock(mtx_);
             messages_.insert(messages_.end(), std::make_move_iterator(msgs.begin()),
                              std::make_move_iterator(msgs.end()));
+            size_.store(messages_.size(), std::memory_order_release);
         }
         hasMessagesCond_.notify_all();
     }
@@ -39,17 +54,40 @@ public:
         while (messages_.empty()) {
             hasMessagesCond_.wait(lock);
         }
-        return popFront();
+        return popNext();
     }
 
+    // Returns without locking if the queue looks empty, so polling empty queues stays cheap
     std::optional<T> tryTake() {
+        if (size_.load(std::memory_order_acquire) == 0) {
+            return std::nullopt;
+        }
         std::scoped_lock lock(mtx_);
         if (!messages_.empty()) {
-            return popFront();
+            return popNext();
         }
         return std::nullopt;
     }
 
+    // Waits for a message, then moves up to `out.size()` messages into `out` under a single lock. Returns the number
+    // of messages taken, in the order take() would have returned them.
+    size_t takeUpTo(std::span<T> out) {
+        std::unique_lock<std::mutex> lock(mtx_);
+        while (messages_.empty()) {
+            hasMessagesCond_.wait(lock);
+        }
+        return popMany(out);
+    }
+
+    // Like takeUpTo(), but returns 0 instead of waiting if the queue is empty
+    size_t tryTakeMany(std::span<T> out) {
+        if (out.empty() || size_.load(std::memory_order_acquire) == 0) {
+            return 0;
+        }
+        std::scoped_lock lock(mtx_);
+        return popMany(out);
+    }
+
     // For debug and testing use only
     size_t size() {
         std::scoped_lock lock(mtx_);
@@ -57,14 +95,39 @@ public:
     }
 
 private:
-    T popFront() {
-        T msg = std::move(messages_.front());
-        messages_.pop_front();
+    T popNext() {
+        if (order_ == QueueOrder::Fifo) {
+            T msg = std::move(messages_.front());
+            messages_.pop_front();
+            size_.store(messages_.size(), std::memory_order_release);
+            return msg;
+        }
+        T msg = std::move(messages_.back());
+        messages_.pop_back();
+        size_.store(messages_.size(), std::memory_order_release);
         return msg;
     }
 
+    size_t popMany(std::span<T> out) {
+        size_t count = std::min(out.size(), messages_.size());
+        for (size_t i = 0; i < count; ++i) {
+            if (order_ == QueueOrder::Fifo) {
+                out[i] = std::move(messages_.front());
+                messages_.pop_front();
+            } else {
+                out[i] = std::move(messages_.back());
+                messages_.pop_back();
+            }
+        }
+        size_.store(messages_.size(), std::memory_order_release);
+        return count;
+    }
+
     mutable std::mutex mtx_;
     std::condition_variable hasMessagesCond_;
     Container messages_;
+    // Copy of messages_.size(), readable without the lock
+    std::atomic<size_t> size_ = 0;
+    QueueOrder order_;
 };
 } // namespace cg
@@ -0,0 +1,73 @@
+#pragma once
+
+#include <array>
+#include <atomic>
+#include <chrono>
+#include <cstddef>
+#include <cstdint>
+#include <vector>
+
+// Enabled through the CG_TASK_METRICS CMake option, on by default. Costs two clock reads per task and a timestamp in
+// every Task. When disabled, snapshots only report the current queue depth.
+#ifndef CG_TASK_METRICS
+#define CG_TASK_METRICS 1
+#endif
+
+namespace cg {
+struct WorkerMetrics {
+    // Bucket 0 counts tasks that started less than 1us after being posted, bucket i counts [2^(i-1), 2^i) us and the
+    // last one everything slower
+    static constexpr size_t latencyBucketCount = 20;
+    using LatencyHistogram = std::array<uint64_t, latencyBucketCount>;
+
+    static std::chrono::nanoseconds latencyBucketUpperBound(size_t bucket);
+
+    uint64_t tasksExecuted = 0;
+    std::chrono::nanoseconds busyTime{0};
+    // Time the worker has existed without running a task, including looking for one. Always 0 for the participant
+    // outside the pool.
+    std::chrono::nanoseconds idleTime{0};
+    // Time from posting to start of the tasks this thread ran
+    LatencyHistogram startLatency{};
+
+    double busyRatio() const;
+};
+
+// Snapshot of ThreadPool::metrics(). Counters are cumulative since the pool was created, so rates come from the
+// difference between two snapshots.
+struct PoolMetrics {
+    static constexpr bool enabled = CG_TASK_METRICS;
+
+    // One per participant, see ThreadPool::participantCount(). The last one is the thread outside the pool that ran
+    // tasks while waiting in runTasksUntil().
+    std::vector<WorkerMetrics> workers;
+    // Tasks posted but not yet started, excluding ones posted to a specific worker
+    size_t queuedTaskCount = 0;
+    // Largest queuedTaskCount since the pool was created or ThreadPool::resetQueueDepthHighWater() was called
+    size_t queueDepthHighWater = 0;
+
+    uint64_t tasksExecuted() const;
+    // Busy time over busy and idle time of all workers
+    double busyRatio() const;
+    WorkerMetrics::LatencyHistogram startLatency() const;
+    // Upper bound of the histogram bucket the given quantile (0 to 1) of start latencies falls into, 0 if no task ran
+    std::chrono::nanoseconds startLatencyQuantile(double quantile) const;
+};
+
+namespace detail {
+int64_t metricsNow();
+
+// Only written by the thread using the slot, so updates don't need read-modify-write operations. Aligned to keep
+// threads from sharing cache lines.
+struct alignas(64) WorkerCounters {
+    void recordTask(int64_t postTime, int64_t beginTime, int64_t endTime);
+    WorkerMetrics snapshot(int64_t now) const;
+
+    std::atomic<uint64_t> tasksExecuted = 0;
+    std::atomic<int64_t> busyNs = 0;
+    std::array<std::atomic<uint64_t>, WorkerMetrics::latencyBucketCount> startLatency{};
+    // 0 for the participant outside the pool, which has no idle time
+    int64_t startTime = 0;
+};
+} // namespace detail
+} // namespace cg
@@ -0,0 +1,290 @@
+#pragma once
+
+#include "task/Task.h"
+#include "task/TaskGraph.h"
+#include "task/ThreadPool.h"
+
+#include <atomic>
+#include <cassert>
+#include <concepts>
+#include <functional>
+#include <memory>
+#include <optional>
+#include <type_traits>
+#include <vector>
+
+namespace cg {
+// Default parameters for recorded graphs whose tasks don't need any
+struct NoParams {};
+
+// Recorded graphs are built once and can then be started any number of times, one run at a time. Unlike TaskBatch and
+// TaskSequence, running them doesn't consume the recorded tasks, so graph construction stays out of per-frame work.
+// Each run gets a `Params` value, which tasks and generators can take as `const Params&`. Dynamic work is the only part
+// that is regenerated on every run. Since the graph keeps its state between runs, it has to outlive them, which is why
+// recorded graphs aren't RunnableGraphs and can't be added to one-shot graphs.
+template <typename T, typename Params>
+concept RecordedTask =
+    (std::invocable<T&, const Params&> && std::is_void_v<std::invoke_result_t<T&, const Params&>>) ||
+    (std::invocable<T&> && std::is_void_v<std::invoke_result_t<T&>>);
+
+template <typename T, typename Params>
+concept RecordedGraphGenerator = (std::invocable<T&, const Params&> &&
+                                  RunnableGraph<std::invoke_result_t<T&, const Params&>>) ||
+                                 (std::invocable<T&> && RunnableGraph<std::invoke_result_t<T&>>);
+
+template <typename Params>
+class RecordedBatch;
+template <typename Params>
+class RecordedSequence;
+
+namespace detail {
+// Signals the parent of a recorded node that the node has finished
+struct Completion {
+    void (*func)(void* context);
+    void* context;
+
+    void operator()() const { func(context); }
+};
+
+// Recorded nodes are always called from a pool task
+template <typename Params>
+using RecordedNode = std::move_only_function<void(ThreadPool&, const Params&, Completion)>;
+
+template <typename Params, typename T>
+decltype(auto) invokeWithParams(T& callable, const Params& params) {
+    if constexpr (std::invocable<T&, const Params&>) {
+        return callable(params);
+    } else {
+        return callable();
+    }
+}
+
+// Handles starting and finishing runs of a recorded graph, `State` only needs to provide run()
+template <typename Params, typename State>
+class RecordedRunner {
+public:
+    template <TaskCallable C>
+    void start(State& state, ThreadPool& threadPool, Params&& params, C&& continuation) {
+        [[maybe_unused]] bool wasRunning = running_.exchange(true);
+        assert(!wasRunning && "Recorded graph started again before the previous run finished.");
+        params_ = std::move(params);
+        continuation_ = std::forward<C>(continuation);
+        state.run(threadPool, *params_, Completion{&RecordedRunner::finishRun, this});
+    }
+
+private:
+    static void finishRun(void* context) {
+        auto* runner = static_cast<RecordedRunner*>(context);
+        Task continuation = std::move(runner->continuation_);
+        // Allow the continuation to start the next run
+        runner->running_.store(false);
+        continuation();
+    }
+
+    std::atomic<bool> running_ = false;
+    std::optional<Params> params_;
+    Task continuation_;
+};
+} // namespace detail
+
+template <typename Params = NoParams>
+class RecordedBatch {
+public:
+    RecordedBatch() : state_(std::make_unique<State>()) {}
+
+    template <RecordedTask<Params> T>
+    void addWork(T&& task) {
+        state_->nodes.emplace_back(
+            [task(std::forward<T>(task))](ThreadPool&, const Params& params, detail::Completion done) mutable {
+                detail::invokeWithParams(task, params);
+                done();
+            });
+    }
+
+    // Recorded sub-graphs run with the params of their parent
+    void addWork(RecordedBatch<Params>&& subGraph) { state_->nodes.emplace_back(std::move(subGraph).intoNode()); }
+    void addWork(RecordedSequence<Params>&& subGraph) { state_->nodes.emplace_back(std::move(subGraph).intoNode()); }
+
+    template <RecordedGraphGenerator<Params> Gen>
+    void addDynamicWork(Gen&& generator) {
+        state_->nodes.emplace_back([gen(std::forward<Gen>(generator))](ThreadPool& threadPool, const Params& params,
+                                                                        detail::Completion done) mutable {
+            auto subGraph = detail::invokeWithParams(gen, params);
+            subGraph.start(threadPool, [done]() {
+                done();
+            });
+        });
+    }
+
+    // Priority of the tasks this graph posts. Sub-graphs keep their own priority.
+    void setPriority(ThreadPool::Priority priority) { state_->priority = priority; }
+    // Name of the tasks this graph posts in traces, see TaskTrace
+    void setLabel(const char* label) { state_->label = label; }
+
+    // `params` are kept by the graph until the next run, tasks can use them until the run is done
+    template <TaskCallable C>
+    void start(ThreadPool& threadPool, Params params, C&& continuation) {
+        state_->runner.start(*state_, threadPool, std::move(params), std::forward<C>(continuation));
+    }
+
+    // The calling thread runs pool tasks until the graph is done, see ThreadPool::runTasksUntil
+    void startAndWait(ThreadPool& threadPool, Params params) {
+        std::atomic<bool> done = false;
+        start(threadPool, std::move(params), [&threadPool, &done]() {
+            threadPool.notifyDone(done);
+        });
+        threadPool.runTasksUntil(done);
+    }
+
+private:
+    friend class RecordedSequence<Params>;
+
+    detail::RecordedNode<Params> intoNode() && {
+        return [state = std::move(state_)](ThreadPool& threadPool, const Params& params, detail::Completion done) {
+            state->run(threadPool, params, done);
+        };
+    }
+
+    struct State {
+        void run(ThreadPool& threadPool_, const Params& params_, detail::Completion done) {
+            if (nodes.empty()) {
+                done();
+                return;
+            }
+            threadPool = &threadPool_;
+            params = &params_;
+            parentDone = done;
+            nodesLeft = nodes.size();
+            // Reused between runs, so posting doesn't allocate once the vector has grown
+            nodeTasks.clear();
+            for (auto& node : nodes) {
+                nodeTasks.emplace_back([this, node = &node]() {
+                    (*node)(*threadPool, *params, detail::Completion{&State::nodeDone, this});
+                });
+            }
+            threadPool->postTasks(nodeTasks, priority, label);
+        }
+
+        static void nodeDone(void* context) {
+            auto* state = static_cast<State*>(context);
+            if (--state->nodesLeft == 0) {
+                state->parentDone();
+            }
+        }
+
+        std::vector<detail::RecordedNode<Params>> nodes;
+        std::vector<Task> nodeTasks;
+        std::atomic<size_t> nodesLeft = 0;
+        ThreadPool* threadPool = nullptr;
+        ThreadPool::Priority priority = ThreadPool::Priority::Normal;
+        const char* label = nullptr;
+        const Params* params = nullptr;
+        detail::Completion parentDone{};
+        detail::RecordedRunner<Params, State> runner;
+    };
+
+    std::unique_ptr<State> state_;
+};
+
+template <typename Params = NoParams>
+class RecordedSequence {
+public:
+    RecordedSequence() : state_(std::make_unique<State>()) {}
+
+    template <RecordedTask<Params> T>
+    void addWork(T&& task) {
+        state_->nodes.emplace_back(
+            [task(std::forward<T>(task))](ThreadPool&, const Params& params, detail::Completion done) mutable {
+                detail::invokeWithParams(task, params);
+                done();
+            });
+    }
+
+    // Recorded sub-graphs run with the params of their parent
+    void addWork(RecordedBatch<Params>&& subGraph) { state_->nodes.emplace_back(std::move(subGraph).intoNode()); }
+    void addWork(RecordedSequence<Params>&& subGraph) { state_->nodes.emplace_back(std::move(subGraph).intoNode()); }
+
+    template <RecordedGraphGenerator<Params> Gen>
+    void addDynamicWork(Gen&& generator) {
+        state_->nodes.emplace_back([gen(std::forward<Gen>(generator))](ThreadPool& threadPool, const Params& params,
+                                                                        detail::Completion done) mutable {
+            auto subGraph = detail::invokeWithParams(gen, params);
+            subGraph.start(threadPool, [done]() {
+                done();
+            });
+        });
+    }
+
+    // Priority of the tasks this graph posts. Sub-graphs keep their own priority.
+    void setPriority(ThreadPool::Priority priority) { state_->priority = priority; }
+    // Name of the tasks this graph posts in traces, see TaskTrace
+    void setLabel(const char* label) { state_->label = label; }
+
+    // `params` are kept by the graph until the next run, tasks can use them until the run is done
+    template <TaskCallable C>
+    void start(ThreadPool& threadPool, Params params, C&& continuation) {
+        state_->runner.start(*state_, threadPool, std::move(params), std::forward<C>(continuation));
+    }
+
+    // The calling thread runs pool tasks until the graph is done, see ThreadPool::runTasksUntil
+    void startAndWait(ThreadPool& threadPool, Params params) {
+        std::atomic<bool> done = false;
+        start(threadPool, std::move(params), [&threadPool, &done]() {
+            threadPool.notifyDone(done);
+        });
+        threadPool.runTasksUntil(done);
+    }
+
+private:
+    friend class RecordedBatch<Params>;
+
+    detail::RecordedNode<Params> intoNode() && {
+        return [state = std::move(state_)](ThreadPool& threadPool, const Params& params, detail::Completion done) {
+            state->run(threadPool, params, done);
+        };
+    }
+
+    struct State {
+        void run(ThreadPool& threadPool_, const Params& params_, detail::Completion done) {
+            if (nodes.empty()) {
+                done();
+                return;
+            }
+            threadPool = &threadPool_;
+            params = &params_;
+            parentDone = done;
+            currNode = 0;
+            postCurrNode();
+        }
+
+        void postCurrNode() {
+            // Posted instead of called directly, so long sequences of plain tasks don't nest calls
+            threadPool->postTask(
+                [this]() {
+                    nodes[currNode](*threadPool, *params, detail::Completion{&State::nodeDone, this});
+                },
+                priority, label);
+        }
+
+        static void nodeDone(void* context) {
+            auto* state = static_cast<State*>(context);
+            if (++state->currNode == state->nodes.size()) {
+                state->parentDone();
+            } else {
+                state->postCurrNode();
+            }
+        }
+
+        std::vector<detail::RecordedNode<Params>> nodes;
+        size_t currNode = 0;
+        ThreadPool* threadPool = nullptr;
+        ThreadPool::Priority priority = ThreadPool::Priority::Normal;
+        const char* label = nullptr;
+        const Params* params = nullptr;
+        detail::Completion parentDone{};
+        detail::RecordedRunner<Params, State> runner;
+    };
+
+    std::unique_ptr<State> state_;
+};
+} // namespace cg
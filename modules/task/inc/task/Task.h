@@ -1,10 +1,181 @@
 #pragma once
 
+#include "task/PoolMetrics.h"
+#include "task/TaskTrace.h"
+
+#include <atomic>
 #include <concepts>
-#include <functional>
+#include <cstddef>
+#include <cstdint>
+#include <memory>
+#include <memory_resource>
+#include <new>
+#include <type_traits>
+#include <utility>
+
+// Callables up to this size are stored inside the task itself, without any allocation
+#ifndef CG_TASK_INLINE_SIZE
+#define CG_TASK_INLINE_SIZE 64
+#endif
 
 namespace cg {
-using Task = std::move_only_function<void()>;
+// Move-only `void()` callable. Unlike std::move_only_function, the size of the inline buffer is guaranteed, so the
+// captures that fit are known up front. Larger callables are placed in a memory resource when one is given (e.g. a
+// TaskArena), otherwise on the heap, which is counted in heapAllocationCount().
+class Task {
+public:
+    static constexpr size_t inlineSize = CG_TASK_INLINE_SIZE;
+
+    template <typename F>
+    static constexpr bool fitsInline = sizeof(F) <= inlineSize && alignof(F) <= alignof(std::max_align_t) &&
+                                       std::is_nothrow_move_constructible_v<F>;
+
+    Task() = default;
+    Task(std::nullptr_t) {}
+
+    template <typename F>
+        requires(!std::same_as<std::remove_cvref_t<F>, Task>) && std::invocable<std::decay_t<F>&>
+    Task(F&& func) : Task(std::allocator_arg, nullptr, std::forward<F>(func)) {}
+
+    template <typename F>
+        requires(!std::same_as<std::remove_cvref_t<F>, Task>) && std::invocable<std::decay_t<F>&>
+    Task(std::allocator_arg_t, std::pmr::memory_resource* resource, F&& func) {
+        using Func = std::decay_t<F>;
+        if constexpr (fitsInline<Func>) {
+            new (storage_) Func(std::forward<F>(func));
+            ops_ = &inlineOps<Func>;
+        } else {
+            void* mem;
+            if (resource != nullptr) {
+                mem = resource->allocate(sizeof(Func), alignof(Func));
+            } else {
+                mem = ::operator new(sizeof(Func), std::align_val_t(alignof(Func)));
+                heapAllocationCount_.fetch_add(1, std::memory_order_relaxed);
+            }
+            new (mem) Func(std::forward<F>(func));
+            new (storage_) Remote{mem, resource};
+            ops_ = &remoteOps<Func>;
+        }
+    }
+
+    Task(Task&& other) noexcept { moveFrom(other); }
+    Task& operator=(Task&& other) noexcept {
+        if (this != &other) {
+            reset();
+            moveFrom(other);
+        }
+        return *this;
+    }
+    Task& operator=(std::nullptr_t) {
+        reset();
+        return *this;
+    }
+    ~Task() { reset(); }
+
+    void operator()() { ops_->invoke(storage_); }
+    explicit operator bool() const { return ops_ != nullptr; }
+    bool isInline() const { return ops_ != nullptr && ops_->isInline; }
+
+    // Name of the task in traces, must outlive the trace. Only kept when CG_TASK_TRACING is enabled.
+    void setLabel([[maybe_unused]] const char* label) {
+#if CG_TASK_TRACING
+        label_ = label;
+#endif
+    }
+    const char* label() const {
+#if CG_TASK_TRACING
+        return label_;
+#else
+        return nullptr;
+#endif
+    }
+
+    // Number of callables that didn't fit inline and had to be allocated with operator new, over the whole process
+    static size_t heapAllocationCount() { return heapAllocationCount_.load(std::memory_order_relaxed); }
+
+private:
+    friend class ThreadPool;
+
+    struct Ops {
+        void (*invoke)(void* storage);
+        // Move constructs into `dst` and destroys `src`
+        void (*relocate)(void* dst, void* src);
+        void (*destroy)(void* storage);
+        bool isInline;
+    };
+
+    struct Remote {
+        void* func;
+        // nullptr if allocated with operator new
+        std::pmr::memory_resource* resource;
+    };
+    static_assert(sizeof(Remote) <= inlineSize, "CG_TASK_INLINE_SIZE is too small.");
+
+    template <typename Func>
+    static constexpr Ops inlineOps = {
+        [](void* storage) {
+            (*std::launder(static_cast<Func*>(storage)))();
+        },
+        [](void* dst, void* src) {
+            Func* srcFunc = std::launder(static_cast<Func*>(src));
+            new (dst) Func(std::move(*srcFunc));
+            srcFunc->~Func();
+        },
+        [](void* storage) {
+            std::launder(static_cast<Func*>(storage))->~Func();
+        },
+        true};
+
+    template <typename Func>
+    static constexpr Ops remoteOps = {
+        [](void* storage) {
+            (*static_cast<Func*>(static_cast<Remote*>(storage)->func))();
+        },
+        [](void* dst, void* src) {
+            new (dst) Remote(*static_cast<Remote*>(src));
+        },
+        [](void* storage) {
+            Remote& remote = *static_cast<Remote*>(storage);
+            static_cast<Func*>(remote.func)->~Func();
+            if (remote.resource != nullptr) {
+                remote.resource->deallocate(remote.func, sizeof(Func), alignof(Func));
+            } else {
+                ::operator delete(remote.func, sizeof(Func), std::align_val_t(alignof(Func)));
+            }
+        },
+        false};
+
+    void moveFrom(Task& other) {
+        if (other.ops_ != nullptr) {
+            other.ops_->relocate(storage_, other.storage_);
+            ops_ = std::exchange(other.ops_, nullptr);
+        }
+#if CG_TASK_TRACING
+        label_ = other.label_;
+#endif
+#if CG_TASK_TRACING || CG_TASK_METRICS
+        postTime_ = other.postTime_;
+#endif
+    }
+
+    void reset() {
+        if (ops_ != nullptr) {
+            std::exchange(ops_, nullptr)->destroy(storage_);
+        }
+    }
+
+    static inline std::atomic<size_t> heapAllocationCount_ = 0;
+
+    alignas(std::max_align_t) std::byte storage_[inlineSize];
+    const Ops* ops_ = nullptr;
+#if CG_TASK_TRACING
+    const char* label_ = nullptr;
+#endif
+#if CG_TASK_TRACING || CG_TASK_METRICS
+    // Set by ThreadPool when the task is queued, for measuring queue latency
+    int64_t postTime_ = 0;
+#endif
+};
 
 template <typename T>
 concept TaskCallable = std::convertible_to<T, Task>;
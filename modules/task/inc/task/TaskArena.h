@@ -0,0 +1,71 @@
+#pragma once
+
+#include <atomic>
+#include <chrono>
+#include <cstddef>
+#include <memory>
+#include <memory_resource>
+#include <mutex>
+#include <utility>
+#include <vector>
+
+namespace cg {
+// Bump allocator for task graph state and task callables that are rebuilt every frame. Memory is handed out from
+// chunks which are kept on reset(), so once the arena has grown to the size of a frame, following frames don't
+// allocate at all. Deallocation does nothing besides counting, everything is released at once by reset().
+// Allocating is lock-free as long as the current chunk has room, only moving on to another chunk takes a lock.
+class TaskArena : public std::pmr::memory_resource {
+public:
+    static constexpr size_t defaultChunkSize = 64 * 1024;
+
+    explicit TaskArena(size_t chunkSize = defaultChunkSize);
+    TaskArena(const TaskArena&) = delete;
+    TaskArena& operator=(const TaskArena&) = delete;
+    ~TaskArena() override;
+
+    // Makes all memory available for reuse. Every graph and task using the arena must be done when calling it. Graphs
+    // signal completion before their state is destroyed, so this waits a moment for workers to finish destroying it,
+    // and asserts if allocations are still alive after that. The destructor waits and checks the same way.
+    void reset();
+
+    // Number of times the arena had to allocate a new chunk, over its whole lifetime
+    size_t chunkAllocationCount() const;
+    size_t bytesAllocated() const;
+    size_t capacity() const;
+
+private:
+    // How long reset() waits for workers to deallocate the state of graphs that have just finished
+    static constexpr std::chrono::seconds maxDeallocationWait{1};
+
+    struct Chunk {
+        Chunk(size_t size, size_t index);
+        Chunk(const Chunk&) = delete;
+        Chunk& operator=(const Chunk&) = delete;
+        ~Chunk();
+
+        std::byte* memory;
+        size_t size;
+        // Position in chunks_
+        size_t index;
+        std::atomic<size_t> offset = 0;
+    };
+
+    void* do_allocate(size_t bytes, size_t alignment) override;
+    void do_deallocate(void* ptr, size_t bytes, size_t alignment) override;
+    bool do_is_equal(const std::pmr::memory_resource& other) const noexcept override;
+
+    bool waitForDeallocations() const;
+    static void* allocateFromChunk(Chunk& chunk, size_t bytes, size_t alignment);
+    // Makes the chunk after `full` current, allocating one big enough for `bytes` if there is none left
+    void advanceChunk(const Chunk* full, size_t bytes, size_t alignment);
+
+    size_t chunkSize_;
+    mutable std::mutex mtx_;
+    // Chunks never move, so allocating threads can keep using the current one without holding the lock
+    std::vector<std::unique_ptr<Chunk>> chunks_;
+    std::atomic<Chunk*> currChunk_ = nullptr;
+    std::atomic<size_t> bytesAllocated_ = 0;
+    size_t chunkAllocationCount_ = 0;
+    std::atomic<size_t> liveAllocationCount_ = 0;
+};
+} // namespace cg
@@ -3,10 +3,19 @@
 #include "task/Task.h"
 #include "task/ThreadPool.h"
 
+#include <algorithm>
 #include <atomic>
 #include <cassert>
+#include <chrono>
 #include <concepts>
-#include <future>
+#include <functional>
+#include <limits>
+#include <memory>
+#include <memory_resource>
+#include <mutex>
+#include <new>
+#include <stop_token>
+#include <type_traits>
 #include <vector>
 
 namespace cg {
@@ -28,13 +37,19 @@ struct TaskGraphArchetype {
 };
 } // namespace detail
 
+// Anything that can be started on a thread pool and signal its completion. These can be added as work to task graphs.
 template <typename T>
-concept TaskGraph = requires(T taskGraph, ThreadPool& threadPool, std::move_only_function<void(void)> task,
-                             detail::TaskGraphArchetype subGraph, std::move_only_function<Task(void)> taskGenerator,
-                             std::move_only_function<detail::TaskGraphArchetype(void)> graphGenerator) {
-    { taskGraph.start(threadPool) } -> std::same_as<void>;
-    { taskGraph.start(threadPool, std::move(task)) } -> std::same_as<void>;
-    { taskGraph.startAndWait(threadPool) } -> std::same_as<void>;
+concept RunnableGraph = requires(T graph, ThreadPool& threadPool, std::move_only_function<void(void)> task) {
+    { graph.start(threadPool) } -> std::same_as<void>;
+    { graph.start(threadPool, std::move(task)) } -> std::same_as<void>;
+    { graph.startAndWait(threadPool) } -> std::same_as<void>;
+};
+
+template <typename T>
+concept TaskGraph =
+    RunnableGraph<T> && requires(T taskGraph, std::move_only_function<void(void)> task,
+                                 detail::TaskGraphArchetype subGraph, std::move_only_function<Task(void)> taskGenerator,
+                                 std::move_only_function<detail::TaskGraphArchetype(void)> graphGenerator) {
     { taskGraph.addWork(std::move(task)) } -> std::same_as<void>;
     { taskGraph.addWork(std::move(subGraph)) } -> std::same_as<void>;
     { taskGraph.addDynamicWork(std::move(taskGenerator)) } -> std::same_as<void>;
@@ -44,9 +59,31 @@ concept TaskGraph = requires(T taskGraph, ThreadPool& threadPool, std::move_only
 static_assert(TaskGraph<detail::TaskGraphArchetype>);
 
 template <typename T>
-concept GraphGenerator = std::invocable<T> && TaskGraph<std::invoke_result_t<T>>;
+concept GraphGenerator = std::invocable<T> && RunnableGraph<std::invoke_result_t<T>>;
 
 namespace detail {
+template <typename T>
+struct ResourceDeleter {
+    std::pmr::memory_resource* resource;
+    void operator()(T* ptr) const {
+        ptr->~T();
+        resource->deallocate(ptr, sizeof(T), alignof(T));
+    }
+};
+
+template <typename T>
+using ResourcePtr = std::unique_ptr<T, ResourceDeleter<T>>;
+
+// Like make_unique, but the memory comes from `resource`, or from the heap if it's nullptr
+template <typename T, typename... Args>
+ResourcePtr<T> makeWithResource(std::pmr::memory_resource* resource, Args&&... args) {
+    if (resource == nullptr) {
+        resource = std::pmr::new_delete_resource();
+    }
+    void* mem = resource->allocate(sizeof(T), alignof(T));
+    return ResourcePtr<T>(new (mem) T(std::forward<Args>(args)...), ResourceDeleter<T>{resource});
+}
+
 class WhenAllHelper {
 public:
     void markTaskDone() {
@@ -59,10 +96,11 @@ public:
     }
 
     template <TaskCallable T>
-    void setContinuation(T&& continuation) {
-        continuation_ = std::forward<T>(continuation);
+    void setContinuation(std::pmr::memory_resource* resource, T&& continuation) {
+        continuation_ = Task(std::allocator_arg, resource, std::forward<T>(continuation));
     }
     void setTaskCount(size_t taskCount) { tasksLeft_ = taskCount; }
+    void addTasks(size_t taskCount) { tasksLeft_ += taskCount; }
 
 private:
     std::atomic<size_t> tasksLeft_;
@@ -70,25 +108,36 @@ private:
 };
 } // namespace detail
 
+// Graphs can be given a memory resource, usually a TaskArena, which is then used for the graph's state and for tasks
+// that don't fit inline into Task. Without one, these are allocated on the heap.
 class TaskBatch {
 public:
-    TaskBatch() : state_(std::make_unique<State>()) {}
+    TaskBatch() : TaskBatch(nullptr) {}
+    explicit TaskBatch(std::pmr::memory_resource& resource) : TaskBatch(&resource) {}
 
     template <TaskCallable T>
     void addWork(T&& task) {
-        tasks_.emplace_back([state = state_.get(), batchedTask(std::forward<T>(task))]() mutable {
-            batchedTask();
-            state->whenAllHelper.markTaskDone();
-        });
+        tasks_.emplace_back(std::allocator_arg, state_->resource,
+                            [state = state_.get(), batchedTask(std::forward<T>(task))]() mutable {
+                                if (!state->stopToken.stop_requested()) {
+                                    batchedTask();
+                                }
+                                state->whenAllHelper.markTaskDone();
+                            });
     }
 
-    template <TaskGraph SubGraph>
+    template <RunnableGraph SubGraph>
     void addWork(SubGraph&& subGraph) {
-        tasks_.emplace_back([state = state_.get(), subGraph = std::move(subGraph)]() mutable {
-            subGraph.start(*state->threadPool, [state]() {
-                state->whenAllHelper.markTaskDone();
-            });
-        });
+        tasks_.emplace_back(std::allocator_arg, state_->resource,
+                            [state = state_.get(), subGraph = std::move(subGraph)]() mutable {
+                                if (state->stopToken.stop_requested()) {
+                                    state->whenAllHelper.markTaskDone();
+                                    return;
+                                }
+                                subGraph.start(*state->threadPool, [state]() {
+                                    state->whenAllHelper.markTaskDone();
+                                });
+                            });
     }
 
     template <TaskGenerator Gen>
@@ -101,14 +150,28 @@ public:
 
     template <GraphGenerator Gen>
     void addDynamicWork(Gen&& generator) {
-        tasks_.emplace_back([state = state_.get(), gen(std::forward<Gen>(generator))]() mutable {
-            auto subGraph = gen();
-            subGraph.start(*state->threadPool, [state]() {
-                state->whenAllHelper.markTaskDone();
-            });
-        });
+        tasks_.emplace_back(std::allocator_arg, state_->resource,
+                            [state = state_.get(), gen(std::forward<Gen>(generator))]() mutable {
+                                if (state->stopToken.stop_requested()) {
+                                    state->whenAllHelper.markTaskDone();
+                                    return;
+                                }
+                                auto subGraph = gen();
+                                subGraph.start(*state->threadPool, [state]() {
+                                    state->whenAllHelper.markTaskDone();
+                                });
+                            });
     }
 
+    // Priority of the tasks this graph posts. Sub-graphs keep their own priority.
+    void setPriority(ThreadPool::Priority priority) { state_->priority = priority; }
+    // Name of the tasks this graph posts in traces, see TaskTrace
+    void setLabel(const char* label) { state_->label = label; }
+    // Once a stop is requested, tasks of this graph that haven't started yet are skipped and sub-graphs that haven't
+    // started aren't started, so the graph finishes early and still calls its continuation. Running tasks can poll the
+    // token themselves.
+    void setStopToken(std::stop_token stopToken) { state_->stopToken = std::move(stopToken); }
+
     void start(ThreadPool& threadPool) {
         start(threadPool, []() {});
     }
@@ -118,48 +181,69 @@ public:
         state_->whenAllHelper.setTaskCount(tasks_.size());
         state_->threadPool = &threadPool;
         detail::WhenAllHelper& helper = state_->whenAllHelper;
-        helper.setContinuation([cont(std::forward<T>(continuation)), state = std::move(state_)]() mutable {
+        std::pmr::memory_resource* resource = state_->resource;
+        ThreadPool::Priority priority = state_->priority;
+        const char* label = state_->label;
+        helper.setContinuation(resource, [cont(std::forward<T>(continuation)), state = std::move(state_)]() mutable {
             cont();
         });
-        threadPool.postTasks(tasks_);
+        threadPool.postTasks(tasks_, priority, label);
     }
 
+    // The calling thread runs pool tasks until the graph is done, see ThreadPool::runTasksUntil
     void startAndWait(ThreadPool& threadPool) {
-        std::promise<void> promise;
-        auto future = promise.get_future();
-        start(threadPool, [promise = std::move(promise)]() mutable {
-            promise.set_value();
+        std::atomic<bool> done = false;
+        start(threadPool, [&threadPool, &done]() {
+            threadPool.notifyDone(done);
         });
-        future.get();
+        threadPool.runTasksUntil(done);
     }
 
 private:
+    explicit TaskBatch(std::pmr::memory_resource* resource)
+        : tasks_(resource != nullptr ? resource : std::pmr::get_default_resource()),
+          state_(detail::makeWithResource<State>(resource, resource)) {}
+
     struct State {
+        explicit State(std::pmr::memory_resource* resource_) : resource(resource_) {}
+
         detail::WhenAllHelper whenAllHelper;
-        ThreadPool* threadPool;
+        ThreadPool* threadPool = nullptr;
+        ThreadPool::Priority priority = ThreadPool::Priority::Normal;
+        const char* label = nullptr;
+        std::stop_token stopToken;
+        // nullptr if tasks should use the heap
+        std::pmr::memory_resource* resource;
     };
 
-    std::vector<Task> tasks_;
-    std::unique_ptr<State> state_;
+    std::pmr::vector<Task> tasks_;
+    detail::ResourcePtr<State> state_;
 };
 
 static_assert(TaskGraph<TaskBatch>, "TaskBatch does not fulfill the TaskGraph concept.");
 
 class TaskSequence {
 public:
-    TaskSequence() : state_(std::make_unique<State>()) {}
+    TaskSequence() : TaskSequence(nullptr) {}
+    explicit TaskSequence(std::pmr::memory_resource& resource) : TaskSequence(&resource) {}
 
     template <TaskCallable T>
     void addWork(T&& task) {
-        state_->tasks.emplace_back([task(std::forward<T>(task)), state = state_.get()]() mutable {
-            task();
+        state_->addTask([task(std::forward<T>(task)), state = state_.get()]() mutable {
+            if (!state->stopToken.stop_requested()) {
+                task();
+            }
             state->moveToNextTask();
         });
     }
 
-    template <TaskGraph SubGraph>
+    template <RunnableGraph SubGraph>
     void addWork(SubGraph&& subGraph) {
-        state_->tasks.emplace_back([subGraph(std::forward<SubGraph>(subGraph)), state = state_.get()]() mutable {
+        state_->addTask([subGraph(std::forward<SubGraph>(subGraph)), state = state_.get()]() mutable {
+            if (state->stopToken.stop_requested()) {
+                state->moveToNextTask();
+                return;
+            }
             subGraph.start(*state->threadPool, [state]() mutable {
                 state->moveToNextTask();
             });
@@ -176,7 +260,11 @@ public:
 
     template <GraphGenerator Gen>
     void addDynamicWork(Gen&& generator) {
-        state_->tasks.emplace_back([state = state_.get(), gen(std::forward<Gen>(generator))]() mutable {
+        state_->addTask([state = state_.get(), gen(std::forward<Gen>(generator))]() mutable {
+            if (state->stopToken.stop_requested()) {
+                state->moveToNextTask();
+                return;
+            }
             auto subGraph = gen();
             subGraph.start(*state->threadPool, [state]() {
                 state->moveToNextTask();
@@ -184,6 +272,15 @@ public:
         });
     }
 
+    // Priority of the tasks this graph posts. Sub-graphs keep their own priority.
+    void setPriority(ThreadPool::Priority priority) { state_->priority = priority; }
+    // Name of the tasks this graph posts in traces, see TaskTrace
+    void setLabel(const char* label) { state_->label = label; }
+    // Once a stop is requested, tasks of this graph that haven't started yet are skipped and sub-graphs that haven't
+    // started aren't started, so the graph finishes early and still calls its continuation. Running tasks can poll the
+    // token themselves.
+    void setStopToken(std::stop_token stopToken) { state_->stopToken = std::move(stopToken); }
+
     void start(ThreadPool& threadPool) {
         start(threadPool, []() {});
     }
@@ -192,28 +289,46 @@ public:
     void start(ThreadPool& threadPool, T&& continuation) {
         state_->threadPool = &threadPool;
         State* statePtr = state_.get();
-        statePtr->tasks.emplace_back([cont(std::forward<T>(continuation)), state = std::move(state_)]() mutable {
+        statePtr->addTask([cont(std::forward<T>(continuation)), state = std::move(state_)]() mutable {
             cont();
         });
-        threadPool.postTask([state = statePtr]() {
-            state->moveToNextTask();
-        });
+        threadPool.postTask(
+            [state = statePtr]() {
+                state->moveToNextTask();
+            },
+            statePtr->priority, statePtr->label);
     }
 
+    // The calling thread runs pool tasks until the graph is done, see ThreadPool::runTasksUntil
     void startAndWait(ThreadPool& threadPool) {
-        std::promise<void> promise;
-        auto future = promise.get_future();
-        start(threadPool, [promise = std::move(promise)]() mutable {
-            promise.set_value();
+        std::atomic<bool> done = false;
+        start(threadPool, [&threadPool, &done]() {
+            threadPool.notifyDone(done);
         });
-        future.get();
+        threadPool.runTasksUntil(done);
     }
 
 private:
+    explicit TaskSequence(std::pmr::memory_resource* resource)
+        : state_(detail::makeWithResource<State>(resource, resource)) {}
+
     struct State {
-        std::vector<Task> tasks;
+        explicit State(std::pmr::memory_resource* resource_)
+            : tasks(resource_ != nullptr ? resource_ : std::pmr::get_default_resource()), resource(resource_) {}
+
+        template <TaskCallable T>
+        void addTask(T&& task) {
+            tasks.emplace_back(std::allocator_arg, resource, std::forward<T>(task));
+        }
+
+        std::pmr::vector<Task> tasks;
         unsigned currTask_ = 0;
-        ThreadPool* threadPool;
+        ThreadPool* threadPool = nullptr;
+        ThreadPool::Priority priority = ThreadPool::Priority::Normal;
+        const char* label = nullptr;
+        std::stop_token stopToken;
+        // nullptr if tasks should use the heap
+        std::pmr::memory_resource* resource;
 
         void moveToNextTask() {
             assert(currTask_ < tasks.size());
@@ -223,8 +338,514 @@ private:
         }
     };
 
-    std::unique_ptr<State> state_;
+    detail::ResourcePtr<State> state_;
 };
 
 static_assert(TaskGraph<TaskSequence>, "TaskSequence does not fulfill the TaskGraph concept.");
+
+// Graph of tasks with arbitrary dependencies: precede(a, b) makes b wait for a. Every node keeps a count of inputs that
+// haven't finished yet and is posted as soon as it drops to 0, so work doesn't wait for unrelated nodes the way it does
+// between the steps of a sequence. Nodes added through addWork have no dependencies unless precede is called for them.
+class TaskDag {
+public:
+    using NodeId = size_t;
+
+    TaskDag() : TaskDag(nullptr) {}
+    explicit TaskDag(std::pmr::memory_resource& resource) : TaskDag(&resource) {}
+
+    template <TaskCallable T>
+    NodeId addNode(T&& task) {
+        NodeId id = state_->nodes.size();
+        state_->addNode([state = state_.get(), id, task(std::forward<T>(task))]() mutable {
+            if (!state->stopToken.stop_requested()) {
+                task();
+            }
+            state->nodeDone(id);
+        });
+        return id;
+    }
+
+    template <RunnableGraph SubGraph>
+    NodeId addNode(SubGraph&& subGraph) {
+        NodeId id = state_->nodes.size();
+        state_->addNode([state = state_.get(), id, subGraph(std::forward<SubGraph>(subGraph))]() mutable {
+            if (state->stopToken.stop_requested()) {
+                state->nodeDone(id);
+                return;
+            }
+            subGraph.start(*state->threadPool, [state, id]() {
+                state->nodeDone(id);
+            });
+        });
+        return id;
+    }
+
+    template <TaskGenerator Gen>
+    NodeId addDynamicNode(Gen&& generator) {
+        return addNode([gen(std::forward<Gen>(generator))]() {
+            auto task = gen();
+            task();
+        });
+    }
+
+    template <GraphGenerator Gen>
+    NodeId addDynamicNode(Gen&& generator) {
+        NodeId id = state_->nodes.size();
+        state_->addNode([state = state_.get(), id, gen(std::forward<Gen>(generator))]() mutable {
+            if (state->stopToken.stop_requested()) {
+                state->nodeDone(id);
+                return;
+            }
+            auto subGraph = gen();
+            subGraph.start(*state->threadPool, [state, id]() {
+                state->nodeDone(id);
+            });
+        });
+        return id;
+    }
+
+    template <TaskCallable T>
+    void addWork(T&& task) {
+        addNode(std::forward<T>(task));
+    }
+
+    template <RunnableGraph SubGraph>
+    void addWork(SubGraph&& subGraph) {
+        addNode(std::forward<SubGraph>(subGraph));
+    }
+
+    template <TaskGenerator Gen>
+    void addDynamicWork(Gen&& generator) {
+        addDynamicNode(std::forward<Gen>(generator));
+    }
+
+    template <GraphGenerator Gen>
+    void addDynamicWork(Gen&& generator) {
+        addDynamicNode(std::forward<Gen>(generator));
+    }
+
+    // `before` has to finish before `after` can start
+    void precede(NodeId before, NodeId after) {
+        assert(before < state_->nodes.size() && after < state_->nodes.size());
+        assert(before != after);
+        state_->nodes[before].successors.push_back(after);
+        ++state_->nodes[after].inputCount;
+    }
+
+    // Priority of the tasks this graph posts. Sub-graphs keep their own priority.
+    void setPriority(ThreadPool::Priority priority) { state_->priority = priority; }
+    // Name of the tasks this graph posts in traces, see TaskTrace
+    void setLabel(const char* label) { state_->label = label; }
+    // Once a stop is requested, tasks of this graph that haven't started yet are skipped and sub-graphs that haven't
+    // started aren't started, so the graph finishes early and still calls its continuation. Running tasks can poll the
+    // token themselves.
+    void setStopToken(std::stop_token stopToken) { state_->stopToken = std::move(stopToken); }
+
+    void start(ThreadPool& threadPool) {
+        start(threadPool, []() {});
+    }
+
+    template <TaskCallable T>
+    void start(ThreadPool& threadPool, T&& continuation) {
+        assert(isAcyclic() && "TaskDag has a dependency cycle.");
+        State* state = state_.get();
+        state->threadPool = &threadPool;
+        if (state->nodes.empty()) {
+            state_.reset();
+            continuation();
+            return;
+        }
+
+        std::pmr::vector<Task> roots(state->nodes.get_allocator().resource());
+        for (NodeId id = 0; id < state->nodes.size(); ++id) {
+            state->nodes[id].pendingInputs.store(state->nodes[id].inputCount, std::memory_order_relaxed);
+            if (state->nodes[id].inputCount == 0) {
+                roots.push_back(std::move(state->nodes[id].work));
+            }
+        }
+        state->whenAllHelper.setTaskCount(state->nodes.size());
+        state->whenAllHelper.setContinuation(state->resource, [cont(std::forward<T>(continuation)),
+                                                               state = std::move(state_)]() mutable {
+            cont();
+        });
+        threadPool.postTasks(roots, state->priority, state->label);
+    }
+
+    // The calling thread runs pool tasks until the graph is done, see ThreadPool::runTasksUntil
+    void startAndWait(ThreadPool& threadPool) {
+        std::atomic<bool> done = false;
+        start(threadPool, [&threadPool, &done]() {
+            threadPool.notifyDone(done);
+        });
+        threadPool.runTasksUntil(done);
+    }
+
+private:
+    explicit TaskDag(std::pmr::memory_resource* resource)
+        : state_(detail::makeWithResource<State>(resource, resource)) {}
+
+    struct Node {
+        Node(Task&& work_, std::pmr::memory_resource* resource) : work(std::move(work_)), successors(resource) {}
+        // Only moved while the graph is built, before pendingInputs is in use
+        Node(Node&& other) noexcept
+            : work(std::move(other.work)), successors(std::move(other.successors)), inputCount(other.inputCount) {}
+
+        Task work;
+        std::pmr::vector<NodeId> successors;
+        unsigned inputCount = 0;
+        std::atomic<unsigned> pendingInputs = 0;
+    };
+
+    struct State {
+        explicit State(std::pmr::memory_resource* resource_)
+            : nodes(resource_ != nullptr ? resource_ : std::pmr::get_default_resource()), resource(resource_) {}
+
+        template <TaskCallable T>
+        void addNode(T&& work) {
+            nodes.emplace_back(Task(std::allocator_arg, resource, std::forward<T>(work)),
+                               nodes.get_allocator().resource());
+        }
+
+        void nodeDone(NodeId id) {
+            for (NodeId successor : nodes[id].successors) {
+                if (--nodes[successor].pendingInputs == 0) {
+                    threadPool->postTask(std::move(nodes[successor].work), priority, label);
+                }
+            }
+            whenAllHelper.markTaskDone();
+        }
+
+        std::pmr::vector<Node> nodes;
+        detail::WhenAllHelper whenAllHelper;
+        ThreadPool* threadPool = nullptr;
+        ThreadPool::Priority priority = ThreadPool::Priority::Normal;
+        const char* label = nullptr;
+        std::stop_token stopToken;
+        // nullptr if tasks should use the heap
+        std::pmr::memory_resource* resource;
+    };
+
+    bool isAcyclic() const {
+        // Kahn's algorithm, every node gets visited only if there is no cycle
+        std::vector<unsigned> inputsLeft;
+        std::vector<NodeId> ready;
+        for (NodeId id = 0; id < state_->nodes.size(); ++id) {
+            inputsLeft.push_back(state_->nodes[id].inputCount);
+            if (inputsLeft.back() == 0) {
+                ready.push_back(id);
+            }
+        }
+        size_t visited = 0;
+        while (!ready.empty()) {
+            NodeId id = ready.back();
+            ready.pop_back();
+            ++visited;
+            for (NodeId successor : state_->nodes[id].successors) {
+                if (--inputsLeft[successor] == 0) {
+                    ready.push_back(successor);
+                }
+            }
+        }
+        return visited == state_->nodes.size();
+    }
+
+    detail::ResourcePtr<State> state_;
+};
+
+static_assert(TaskGraph<TaskDag>, "TaskDag does not fulfill the TaskGraph concept.");
+
+template <std::integral Index>
+struct IndexRange {
+    IndexRange(Index begin_, Index end_) : begin(begin_), end(end_) { assert(begin <= end); }
+
+    Index size() const { return end - begin; }
+    bool empty() const { return begin == end; }
+
+    Index begin;
+    Index end;
+};
+
+namespace detail {
+// A ParallelFor body with state of its own per chunk: every chunk calls startChunk(), runs its steps on the returned
+// object and hands it to finishChunk() once it's done
+template <typename Body, typename Index>
+concept ChunkedBody = requires(Body& body, IndexRange<Index> range) {
+    requires std::invocable<decltype(body.startChunk())&, IndexRange<Index>>;
+    body.finishChunk(body.startChunk());
+};
+} // namespace detail
+
+// Runs `body` over sub-ranges of `range` in parallel. Instead of cutting the range into fixed size chunks up front, a
+// chunk keeps handing half of its remaining range to a new task for as long as there are idle threads to pick it up,
+// and processes the rest in steps sized from the measured cost per index. This keeps the task count low when the pool
+// is busy and still balances the load when threads run out of work.
+template <std::integral Index, typename Body>
+    requires std::invocable<Body&, IndexRange<Index>> || detail::ChunkedBody<Body, Index>
+class ParallelFor {
+public:
+    static constexpr std::chrono::nanoseconds defaultTargetChunkDuration = std::chrono::microseconds(20);
+
+    ParallelFor(IndexRange<Index> range, Body body) : ParallelFor(range, std::move(body), nullptr) {}
+    ParallelFor(IndexRange<Index> range, Body body, std::pmr::memory_resource& resource)
+        : ParallelFor(range, std::move(body), &resource) {}
+
+    // Lower bound for the number of indices processed in one step, e.g. to keep writes to shared cache lines apart
+    void setMinGrainSize(Index minGrainSize) {
+        assert(minGrainSize > 0);
+        state_->minGrainSize = minGrainSize;
+    }
+    // How long one step between checks for idle threads should take, based on the measured cost per index
+    void setTargetChunkDuration(std::chrono::nanoseconds duration) { state_->targetChunkNs = duration.count(); }
+
+    // Priority of the chunk tasks
+    void setPriority(ThreadPool::Priority priority) { state_->priority = priority; }
+    // Name of the tasks this graph posts in traces, see TaskTrace
+    void setLabel(const char* label) { state_->label = label; }
+    // Once a stop is requested, chunks stop taking new steps, so the loop finishes early and still calls its
+    // continuation. The body can poll the token to stop within a step.
+    void setStopToken(std::stop_token stopToken) { state_->stopToken = std::move(stopToken); }
+
+    void start(ThreadPool& threadPool) {
+        start(threadPool, []() {});
+    }
+
+    template <TaskCallable T>
+    void start(ThreadPool& threadPool, T&& continuation) {
+        State* state = state_.get();
+        state->threadPool = &threadPool;
+        state->whenAllHelper.setTaskCount(1);
+        state->whenAllHelper.setContinuation(state->resource, [cont(std::forward<T>(continuation)),
+                                                               state = std::move(state_)]() mutable {
+            cont();
+        });
+        state->spawnChunk(range_);
+    }
+
+    // The calling thread runs pool tasks until the graph is done, see ThreadPool::runTasksUntil
+    void startAndWait(ThreadPool& threadPool) {
+        std::atomic<bool> done = false;
+        start(threadPool, [&threadPool, &done]() {
+            threadPool.notifyDone(done);
+        });
+        threadPool.runTasksUntil(done);
+    }
+
+private:
+    ParallelFor(IndexRange<Index> range, Body&& body, std::pmr::memory_resource* resource)
+        : range_(range), state_(detail::makeWithResource<State>(resource, std::move(body), resource)) {}
+
+    struct State {
+        State(Body&& body_, std::pmr::memory_resource* resource_) : body(std::move(body_)), resource(resource_) {}
+
+        void spawnChunk(IndexRange<Index> range) {
+            ++unstartedChunks;
+            threadPool->postTask(
+                [this, range]() {
+                    --unstartedChunks;
+                    runChunk(range);
+                },
+                priority, label);
+        }
+
+        void runChunk(IndexRange<Index> range) {
+            if constexpr (detail::ChunkedBody<Body, Index>) {
+                auto chunk = body.startChunk();
+                runSteps(range, chunk);
+                body.finishChunk(std::move(chunk));
+            } else {
+                runSteps(range, body);
+            }
+            whenAllHelper.markTaskDone();
+        }
+
+        template <typename StepBody>
+        void runSteps(IndexRange<Index> range, StepBody& stepBody) {
+            while (!range.empty() && !stopToken.stop_requested()) {
+                // Split off the upper half while there are idle threads that aren't already about to pick up a chunk
+                Index grainSize = currentGrainSize();
+                // Both halves have to stay at least minGrainSize
+                while (range.size() > grainSize && range.size() / 2 >= minGrainSize &&
+                       unstartedChunks.load() < threadPool->idleThreadCount()) {
+                    Index mid = range.begin + range.size() / 2;
+                    whenAllHelper.addTasks(1);
+                    spawnChunk(IndexRange<Index>(mid, range.end));
+                    range.end = mid;
+                }
+
+                Index stepSize = std::min(grainSize, range.size());
+                if (range.size() - stepSize < minGrainSize) {
+                    // Take the whole rest instead of leaving a step smaller than minGrainSize behind
+                    stepSize = range.size();
+                }
+                IndexRange<Index> step(range.begin, range.begin + stepSize);
+                auto stepStart = std::chrono::steady_clock::now();
+                stepBody(step);
+                auto stepNs = std::chrono::duration<double, std::nano>(std::chrono::steady_clock::now() - stepStart);
+                updateCostEstimate(stepNs.count() / static_cast<double>(step.size()));
+                range.begin = step.end;
+            }
+        }
+
+        Index currentGrainSize() const {
+            double nsPerIndex = nsPerIndexEstimate.load(std::memory_order_relaxed);
+            if (nsPerIndex <= 0) {
+                // Nothing measured yet, take a small step to get the first estimate
+                return minGrainSize;
+            }
+            double grainSize = static_cast<double>(targetChunkNs) / nsPerIndex;
+            if (grainSize >= static_cast<double>(std::numeric_limits<Index>::max())) {
+                return std::numeric_limits<Index>::max();
+            }
+            return std::max(static_cast<Index>(grainSize), minGrainSize);
+        }
+
+        void updateCostEstimate(double nsPerIndex) {
+            // Very cheap steps can measure as 0 with a coarse clock, which would look like no estimate at all
+            nsPerIndex = std::max(nsPerIndex, 0.001);
+            // Races between chunks only lose a sample, which is fine for an estimate
+            double prevEstimate = nsPerIndexEstimate.load(std::memory_order_relaxed);
+            double newEstimate = prevEstimate <= 0 ? nsPerIndex : (3 * prevEstimate + nsPerIndex) / 4;
+            nsPerIndexEstimate.store(newEstimate, std::memory_order_relaxed);
+        }
+
+        Body body;
+        ThreadPool* threadPool = nullptr;
+        ThreadPool::Priority priority = ThreadPool::Priority::Normal;
+        const char* label = nullptr;
+        std::stop_token stopToken;
+        // nullptr if the continuation should use the heap
+        std::pmr::memory_resource* resource;
+        detail::WhenAllHelper whenAllHelper;
+        std::atomic<unsigned> unstartedChunks = 0;
+        std::atomic<double> nsPerIndexEstimate = 0;
+        Index minGrainSize = 1;
+        std::chrono::nanoseconds::rep targetChunkNs = defaultTargetChunkDuration.count();
+    };
+
+    IndexRange<Index> range_;
+    detail::ResourcePtr<State> state_;
+};
+
+static_assert(RunnableGraph<ParallelFor<int, void (*)(IndexRange<int>)>>,
+              "ParallelFor does not fulfill the RunnableGraph concept.");
+
+template <std::integral Index, typename Body>
+    requires std::invocable<Body&, IndexRange<Index>>
+ParallelFor<Index, std::decay_t<Body>> parallelFor(IndexRange<Index> range, Body&& body) {
+    return ParallelFor<Index, std::decay_t<Body>>(range, std::forward<Body>(body));
+}
+
+template <std::integral Index, typename Body>
+    requires std::invocable<Body&, IndexRange<Index>>
+ParallelFor<Index, std::decay_t<Body>> parallelFor(IndexRange<Index> range, Body&& body,
+                                                   std::pmr::memory_resource& resource) {
+    return ParallelFor<Index, std::decay_t<Body>>(range, std::forward<Body>(body), resource);
+}
+
+// Reduces `range` in parallel: `body(subRange, partial)` adds a sub-range to `partial` and returns it. Every chunk of
+// the underlying ParallelFor starts from `identity` and runs its steps on a partial of its own, which is joined into
+// the result once when the chunk is done. `join` must be associative and commutative since chunks finish in any order.
+// The final value is written to `result` by the time the graph's continuation runs.
+template <std::integral Index, typename T, typename Body, typename Join>
+    requires std::is_invocable_r_v<T, Body&, IndexRange<Index>, T> && std::is_invocable_r_v<T, Join&, T, T>
+class ParallelReduce {
+public:
+    ParallelReduce(IndexRange<Index> range, T identity, Body body, Join join, T& result)
+        : reduction_(detail::makeWithResource<Reduction>(nullptr, std::move(identity), std::move(body),
+                                                         std::move(join), result)),
+          parallelFor_(range, ChunkBody{reduction_.get()}) {}
+    ParallelReduce(IndexRange<Index> range, T identity, Body body, Join join, T& result,
+                   std::pmr::memory_resource& resource)
+        : reduction_(detail::makeWithResource<Reduction>(&resource, std::move(identity), std::move(body),
+                                                         std::move(join), result)),
+          parallelFor_(range, ChunkBody{reduction_.get()}, resource) {}
+
+    void setMinGrainSize(Index minGrainSize) { parallelFor_.setMinGrainSize(minGrainSize); }
+    void setTargetChunkDuration(std::chrono::nanoseconds duration) { parallelFor_.setTargetChunkDuration(duration); }
+    void setPriority(ThreadPool::Priority priority) { parallelFor_.setPriority(priority); }
+    void setLabel(const char* label) { parallelFor_.setLabel(label); }
+    // The result only covers the sub-ranges processed before the stop
+    void setStopToken(std::stop_token stopToken) { parallelFor_.setStopToken(std::move(stopToken)); }
+
+    void start(ThreadPool& threadPool) {
+        start(threadPool, []() {});
+    }
+
+    template <TaskCallable C>
+    void start(ThreadPool& threadPool, C&& continuation) {
+        reduction_->result = reduction_->identity;
+        // The reduction state has to outlive all chunks, so hand it over to the continuation
+        parallelFor_.start(threadPool,
+                           [cont(std::forward<C>(continuation)), reduction = std::move(reduction_)]() mutable {
+                               cont();
+                           });
+    }
+
+    void startAndWait(ThreadPool& threadPool) {
+        std::atomic<bool> done = false;
+        start(threadPool, [&threadPool, &done]() {
+            threadPool.notifyDone(done);
+        });
+        threadPool.runTasksUntil(done);
+    }
+
+private:
+    struct Reduction {
+        Reduction(T&& identity_, Body&& body_, Join&& join_, T& result_)
+            : identity(std::move(identity_)), body(std::move(body_)), join(std::move(join_)), result(result_) {}
+
+        void addPartial(T&& partial) {
+            std::scoped_lock lock(mtx);
+            result = join(std::move(result), std::move(partial));
+        }
+
+        T identity;
+        Body body;
+        Join join;
+        T& result;
+        std::mutex mtx;
+    };
+
+    struct ChunkBody {
+        // Partial result of one chunk, only touched by the thread running it
+        struct Chunk {
+            Reduction* reduction;
+            T partial;
+            bool hasPartial = false;
+
+            void operator()(IndexRange<Index> subRange) {
+                partial = reduction->body(subRange, std::move(partial));
+                hasPartial = true;
+            }
+        };
+
+        Chunk startChunk() { return Chunk{reduction, reduction->identity}; }
+        void finishChunk(Chunk&& chunk) {
+            // Chunks with an empty range, or stopped before their first step, don't add anything
+            if (chunk.hasPartial) {
+                reduction->addPartial(std::move(chunk.partial));
+            }
+        }
+
+        Reduction* reduction;
+    };
+
+    detail::ResourcePtr<Reduction> reduction_;
+    ParallelFor<Index, ChunkBody> parallelFor_;
+};
+
+template <std::integral Index, typename T, typename Body, typename Join>
+ParallelReduce<Index, T, std::decay_t<Body>, std::decay_t<Join>> parallelReduce(IndexRange<Index> range, T identity,
+                                                                                 Body&& body, Join&& join, T& result) {
+    return ParallelReduce<Index, T, std::decay_t<Body>, std::decay_t<Join>>(
+        range, std::move(identity), std::forward<Body>(body), std::forward<Join>(join), result);
+}
+
+template <std::integral Index, typename T, typename Body, typename Join>
+ParallelReduce<Index, T, std::decay_t<Body>, std::decay_t<Join>>
+parallelReduce(IndexRange<Index> range, T identity, Body&& body, Join&& join, T& result,
+               std::pmr::memory_resource& resource) {
+    return ParallelReduce<Index, T, std::decay_t<Body>, std::decay_t<Join>>(
+        range, std::move(identity), std::forward<Body>(body), std::forward<Join>(join), result, resource);
+}
 } // namespace cg
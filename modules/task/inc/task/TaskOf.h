@@ -0,0 +1,223 @@
+#pragma once
+
+#include "task/Task.h"
+#include "task/TaskGraph.h"
+#include "task/ThreadPool.h"
+
+#include <concepts>
+#include <functional>
+#include <memory_resource>
+#include <optional>
+#include <type_traits>
+#include <utility>
+#include <vector>
+
+namespace cg {
+template <typename T>
+class TaskOf;
+
+namespace detail {
+template <typename T>
+struct IsTaskOf : std::false_type {};
+template <typename T>
+struct IsTaskOf<TaskOf<T>> : std::true_type {};
+
+template <typename T>
+TaskOf<std::vector<T>> collectAll(std::vector<TaskOf<T>>&& tasks, std::pmr::memory_resource* resource);
+} // namespace detail
+
+// Chain of stages where every stage gets the result of the previous one moved in, so stages pass values along instead
+// of sharing state that lives outside of the graph. A value is destroyed as soon as the stage that takes it is done.
+// Like the steps of a TaskSequence, each stage runs on the thread that finished the one before it.
+//
+// TaskOf isn't a RunnableGraph, since something has to take its result. consume() ends the chain with a TaskSequence,
+// which can then be added to other graphs.
+template <typename T>
+class TaskOf {
+    static_assert(std::is_object_v<T>, "TaskOf needs a value type, use TaskSequence for stages without results.");
+
+public:
+    using ValueType = T;
+
+    template <typename F>
+        requires std::is_invocable_r_v<T, F&>
+    explicit TaskOf(F&& producer) : TaskOf(nullptr, std::forward<F>(producer)) {}
+
+    // The resource is used for the stages and their values, see TaskSequence
+    template <typename F>
+        requires std::is_invocable_r_v<T, F&>
+    TaskOf(F&& producer, std::pmr::memory_resource& resource) : TaskOf(&resource, std::forward<F>(producer)) {}
+
+    // Adds a stage that gets the current value as `T&&` and returns the next one. If it returns a TaskOf, that chain is
+    // started and its result becomes the next value.
+    template <typename F>
+        requires std::invocable<F&, T&&>
+    auto then(F&& stage) && {
+        using Result = std::invoke_result_t<F&, T&&>;
+        if constexpr (detail::IsTaskOf<Result>::value) {
+            using U = typename Result::ValueType;
+            auto next = detail::makeWithResource<std::optional<U>>(resource_);
+            sequence_.addDynamicWork(
+                [in = std::move(value_), out = next.get(), stage = std::forward<F>(stage)]() mutable {
+                    Result inner = std::invoke(stage, std::move(**in));
+                    in.reset();
+                    return std::move(inner).consume([out](U& value) {
+                        out->emplace(std::move(value));
+                    });
+                });
+            return TaskOf<U>(std::move(sequence_), std::move(next), resource_);
+        } else {
+            static_assert(std::is_object_v<Result>, "Stages that don't return a value are added with consume().");
+            auto next = detail::makeWithResource<std::optional<Result>>(resource_);
+            sequence_.addWork([in = std::move(value_), out = next.get(), stage = std::forward<F>(stage)]() mutable {
+                out->emplace(std::invoke(stage, std::move(**in)));
+                in.reset();
+            });
+            return TaskOf<Result>(std::move(sequence_), std::move(next), resource_);
+        }
+    }
+
+    // Ends the chain with a stage that gets the value as `T&`. If the stage returns a graph, e.g. a ParallelFor over
+    // the value, the value is kept until that graph is done.
+    template <typename F>
+        requires std::invocable<F&, T&>
+    TaskSequence consume(F&& stage) && {
+        using Result = std::invoke_result_t<F&, T&>;
+        if constexpr (RunnableGraph<Result>) {
+            sequence_.addDynamicWork([value = value_.get(), stage = std::forward<F>(stage)]() mutable {
+                return std::invoke(stage, **value);
+            });
+        } else {
+            sequence_.addWork([value = value_.get(), stage = std::forward<F>(stage)]() mutable {
+                std::invoke(stage, **value);
+            });
+        }
+        sequence_.addWork([value = std::move(value_)]() mutable {
+            value.reset();
+        });
+        return std::move(sequence_);
+    }
+
+    // Priority of the tasks this chain posts. Sub-graphs keep their own priority.
+    void setPriority(ThreadPool::Priority priority) { sequence_.setPriority(priority); }
+    // Name of the tasks this chain posts in traces, see TaskTrace
+    void setLabel(const char* label) { sequence_.setLabel(label); }
+
+    // `continuation` gets the final value as `T&&`
+    template <typename C>
+        requires std::invocable<C&, T&&>
+    void start(ThreadPool& threadPool, C&& continuation) {
+        std::move(*this)
+            .consume([cont = std::forward<C>(continuation)](T& value) mutable {
+                std::invoke(cont, std::move(value));
+            })
+            .start(threadPool);
+    }
+
+    // The calling thread runs pool tasks until the value is ready, see ThreadPool::runTasksUntil
+    T startAndWait(ThreadPool& threadPool) {
+        std::optional<T> result;
+        std::move(*this)
+            .consume([&result](T& value) {
+                result.emplace(std::move(value));
+            })
+            .startAndWait(threadPool);
+        return std::move(*result);
+    }
+
+private:
+    template <typename U>
+    friend class TaskOf;
+    template <typename U>
+    friend TaskOf<std::vector<U>> detail::collectAll(std::vector<TaskOf<U>>&& tasks,
+                                                     std::pmr::memory_resource* resource);
+
+    template <typename F>
+    TaskOf(std::pmr::memory_resource* resource, F&& producer)
+        : sequence_(resource != nullptr ? TaskSequence(*resource) : TaskSequence()),
+          value_(detail::makeWithResource<std::optional<T>>(resource)), resource_(resource) {
+        sequence_.addWork([out = value_.get(), producer = std::forward<F>(producer)]() mutable {
+            out->emplace(std::invoke(producer));
+        });
+    }
+
+    TaskOf(TaskSequence&& sequence, detail::ResourcePtr<std::optional<T>>&& value,
+           std::pmr::memory_resource* resource)
+        : sequence_(std::move(sequence)), value_(std::move(value)), resource_(resource) {}
+
+    TaskSequence sequence_;
+    // Written by the last stage of the sequence
+    detail::ResourcePtr<std::optional<T>> value_;
+    // nullptr if the heap should be used
+    std::pmr::memory_resource* resource_;
+};
+
+namespace detail {
+template <typename T>
+TaskOf<std::vector<T>> collectAll(std::vector<TaskOf<T>>&& tasks, std::pmr::memory_resource* resource) {
+    auto partials = makeWithResource<std::vector<std::optional<T>>>(resource, tasks.size());
+    TaskBatch batch = resource != nullptr ? TaskBatch(*resource) : TaskBatch();
+    for (size_t i = 0; i < tasks.size(); ++i) {
+        batch.addWork(std::move(tasks[i]).consume([partial = &(*partials)[i]](T& value) {
+            partial->emplace(std::move(value));
+        }));
+    }
+
+    TaskSequence sequence = resource != nullptr ? TaskSequence(*resource) : TaskSequence();
+    // An empty batch would never finish
+    if (!tasks.empty()) {
+        sequence.addWork(std::move(batch));
+    }
+    auto values = makeWithResource<std::optional<std::vector<T>>>(resource);
+    sequence.addWork([partials = std::move(partials), out = values.get()]() mutable {
+        std::vector<T> collected;
+        collected.reserve(partials->size());
+        for (std::optional<T>& partial : *partials) {
+            collected.push_back(std::move(*partial));
+        }
+        partials.reset();
+        out->emplace(std::move(collected));
+    });
+    return TaskOf<std::vector<T>>(std::move(sequence), std::move(values), resource);
+}
+} // namespace detail
+
+// Runs all tasks at once, the values are collected in the order of `tasks`
+template <typename T>
+TaskOf<std::vector<T>> collectAll(std::vector<TaskOf<T>> tasks) {
+    return detail::collectAll(std::move(tasks), nullptr);
+}
+
+template <typename T>
+TaskOf<std::vector<T>> collectAll(std::vector<TaskOf<T>> tasks, std::pmr::memory_resource& resource) {
+    return detail::collectAll(std::move(tasks), &resource);
+}
+
+namespace detail {
+template <typename T, typename Join>
+auto foldInOrder(T identity, Join&& join) {
+    return [identity = std::move(identity), join = std::forward<Join>(join)](std::vector<T>&& values) mutable {
+        T result = std::move(identity);
+        for (T& value : values) {
+            result = std::invoke(join, std::move(result), std::move(value));
+        }
+        return result;
+    };
+}
+} // namespace detail
+
+// Runs all tasks at once and folds their values with `join(T, T)`, starting from `identity`. Values are folded in the
+// order of `tasks` once all of them are done, so the result doesn't depend on which task finishes first.
+template <typename T, typename Join>
+    requires std::is_invocable_r_v<T, Join&, T, T>
+TaskOf<T> reduceAll(std::vector<TaskOf<T>> tasks, T identity, Join&& join) {
+    return collectAll(std::move(tasks)).then(detail::foldInOrder(std::move(identity), std::forward<Join>(join)));
+}
+
+template <typename T, typename Join>
+    requires std::is_invocable_r_v<T, Join&, T, T>
+TaskOf<T> reduceAll(std::vector<TaskOf<T>> tasks, T identity, Join&& join, std::pmr::memory_resource& resource) {
+    return collectAll(std::move(tasks), resource)
+        .then(detail::foldInOrder(std::move(identity), std::forward<Join>(join)));
+}
+} // namespace cg
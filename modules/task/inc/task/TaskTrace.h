@@ -0,0 +1,71 @@
+#pragma once
+
+#include <cstdint>
+#include <ostream>
+#include <string>
+
+// Enabled through the CG_TASK_TRACING CMake option. When disabled, tracing calls compile to nothing and tasks don't
+// carry any tracing data.
+#ifndef CG_TASK_TRACING
+#define CG_TASK_TRACING 0
+#endif
+
+namespace cg {
+struct TraceEvent {
+    // Must outlive the trace, usually a string literal. nullptr is exported as "task".
+    const char* label;
+    // Index of the thread in its pool, or -1 outside of pools
+    int threadIndex;
+    // Nanoseconds since TaskTrace::now()'s epoch. postTime is 0 if the event didn't come from a queued task.
+    int64_t postTime;
+    int64_t beginTime;
+    int64_t endTime;
+};
+
+// Collects task timings from all threads into per-thread buffers, which only their own thread writes to, so recording
+// doesn't take locks. The result can be loaded into Perfetto or chrome://tracing.
+class TaskTrace {
+public:
+    static constexpr bool enabled = CG_TASK_TRACING;
+
+    static int64_t now();
+    // Recording is off by default, so a build with tracing doesn't keep collecting events nobody looks at
+    static void setRecording(bool recording);
+    static bool isRecording();
+    // Does nothing while not recording
+    static void record(const TraceEvent& event);
+    // Name shown for the calling thread in the trace
+    static void setThreadName(std::string name);
+
+    // Writes everything recorded since the last clear() in the Chrome trace event format. Stop recording first, so
+    // threads don't overwrite events while they're being written.
+    static void writeChromeJson(std::ostream& out);
+    // Drops all recorded events. Threads release their buffers the next time they record, so this is safe to call
+    // while tasks are running.
+    static void clear();
+};
+
+// Records the time between construction and destruction as an event
+class TraceScope {
+public:
+#if CG_TASK_TRACING
+    explicit TraceScope(const char* label, int threadIndex, int64_t postTime = 0)
+        : event_{label, threadIndex, postTime, TaskTrace::isRecording() ? TaskTrace::now() : 0, 0} {}
+    ~TraceScope() {
+        if (event_.beginTime != 0) {
+            event_.endTime = TaskTrace::now();
+            TaskTrace::record(event_);
+        }
+    }
+#else
+    explicit TraceScope(const char*, int, int64_t = 0) {}
+#endif
+    TraceScope(const TraceScope&) = delete;
+    TraceScope& operator=(const TraceScope&) = delete;
+
+private:
+#if CG_TASK_TRACING
+    TraceEvent event_;
+#endif
+};
+} // namespace cg
@@ -1,10 +1,24 @@
 #pragma once
 
+#include "task/CpuTopology.h"
 #include "task/MessageQueue.h"
+#include "task/PoolMetrics.h"
 #include "task/Task.h"
+#include "task/WorkStealingQueue.h"
 
-#include < vector>
+#include <array>
+#include <atomic>
+#include <chrono>
+#include <condition_variable>
+#include <cstdint>
+#include <memory>
+#include <mutex>
+#include <optional>
+#include <span>
+#include <stop_token>
+#include <string>
 #include <thread>
+#include <vector>
 
 namespace cg {
 class ThreadPool {
@@ -12,24 +26,243 @@ public:
     using ThreadIndex = int;
     static constexpr ThreadIndex invalidIndex = -1;
 
-    ThreadPool(unsigned threadCount = std::thread::hardware_concurrency());
+    enum class Scheduling : uint8_t {
+        // All tasks go through one shared queue
+        SharedQueue,
+        // Each worker has its own deque. Tasks posted from a worker go to that worker's deque, tasks posted from
+        // outside go to the shared queue and idle workers steal from the other workers' deques.
+        WorkStealing
+    };
+
+    enum class Priority : uint8_t {
+        // Latency critical work, e.g. tasks of the current frame
+        High,
+        Normal,
+        // Runs when nothing more urgent is queued, but still gets a turn regularly, so it can't starve
+        Background
+    };
+    static constexpr size_t priorityCount = 3;
+    // Every this many times a thread looks for a task, it checks the lower priorities first
+    static constexpr unsigned starvationInterval = 16;
+
+    enum class Pinning : uint8_t {
+        // The OS decides where workers run
+        None,
+        // Each worker is pinned to its own physical core, SMT siblings are left unused. If there are more workers than
+        // cores, cores are shared.
+        PhysicalCores,
+        // Like PhysicalCores, but once every core has a worker, SMT siblings are used too
+        LogicalCpus
+    };
+
+    // How a thread that ran out of tasks waits for more. Before going to sleep, it keeps checking for a while, so work
+    // that comes in shortly after, like the next step of a sequence, is picked up without a sleep and wake up round
+    // trip through the OS.
+    struct IdlePolicy {
+        // Checks with a CPU pause in between. Ignored on single CPU machines, where spinning only delays the thread
+        // that would post the next task.
+        unsigned spinCount = 256;
+        // Checks after giving up the rest of the time slice, once spinning is over
+        unsigned yieldCount = 8;
+    };
+
+    struct Options {
+        unsigned threadCount = std::thread::hardware_concurrency();
+        Scheduling scheduling = Scheduling::SharedQueue;
+        Pinning pinning = Pinning::None;
+        // Workers are named "<threadName>-<index>" so they can be told apart in perf, top and debuggers. An empty name
+        // leaves them unnamed.
+        std::string threadName = "cg-worker";
+        IdlePolicy idlePolicy;
+        // Order in which tasks of the same priority are taken from the shared queues
+        QueueOrder queueOrder = QueueOrder::Fifo;
+        // Most normal priority tasks a worker takes from the shared queue under one lock. Workers only take more than
+        // one when the queue holds plenty of tasks for every thread, so short queues are still spread over all of them.
+        // The rest of a batch stays counted as queued, so while the worker runs one task, idle threads steal the
+        // others. 1 disables batching.
+        unsigned maxTaskBatch = 8;
+        // Workers the pool can ever have, see setThreadCount(). Workers above the current thread count are parked and
+        // don't take tasks. 0 means threadCount.
+        unsigned maxThreadCount = 0;
+        // Activates parked workers while tasks queue up faster than the active ones take them, and parks them again
+        // one at a time once workers stay idle for `shrinkDelay`, but never below threadCount
+        bool elastic = false;
+        std::chrono::milliseconds shrinkDelay{100};
+    };
+
+    ThreadPool(unsigned threadCount = std::thread::hardware_concurrency(),
+               Scheduling scheduling = Scheduling::SharedQueue);
+    explicit ThreadPool(const Options& options);
     ~ThreadPool();
 
+    // Pool for everything that isn't given one explicitly, so components share one set of workers instead of each
+    // starting a thread per CPU. Created with default options on first use.
+    static ThreadPool& defaultPool();
+
+    // A non-null `label` names the task in traces (see TaskTrace), it has to outlive the trace
+    template <TaskCallable T>
+    void postTask(T&& task, Priority priority = Priority::Normal, const char* label = nullptr) {
+        pushTask(Task(std::forward<T>(task)), priority, label);
+    }
+    // The task is dropped without running if a stop is requested before a thread picks it up
     template <TaskCallable T>
-    void postTask(T&& task) {
-        taskQueue_.post(std::forward<T>(task));
+    void postTask(T&& task, std::stop_token stopToken, Priority priority = Priority::Normal,
+                  const char* label = nullptr) {
+        postTask(
+            [task = std::decay_t<T>(std::forward<T>(task)), stopToken = std::move(stopToken)]() mutable {
+                if (!stopToken.stop_requested()) {
+                    task();
+                }
+            },
+            priority, label);
     }
-    void postTasks(std::vector<Task>& tasks);
+    // Moves the tasks out of `tasks`
+    void postTasks(std::span<Task> tasks, Priority priority = Priority::Normal, const char* label = nullptr);
+    // Runs the task on the given worker, before any other task it could pick up. Meant for per-worker setup, e.g.
+    // allocating scratch memory from the worker itself, so that with pinned workers it's placed on the worker's node.
+    template <TaskCallable T>
+    void postTaskToWorker(ThreadIndex workerIndex, T&& task) {
+        pushTaskToWorker(workerIndex, Task(std::forward<T>(task)));
+    }
+    // Number of workers currently taking tasks, they have the indices below it. Only a hint while the pool is elastic.
     unsigned threadCount() const;
+    unsigned maxThreadCount() const;
+    // Number of distinct values threadIndex() can return inside pool tasks: one per worker the pool can have, parked
+    // or not, plus one for a thread outside the pool that runs tasks while waiting in runTasksUntil(). It doesn't
+    // change when the thread count does, so per-thread resources sized with it never need to be resized. Resources
+    // that are expensive to keep for parked workers should be created on first use instead, like WorkerLocal does.
+    unsigned participantCount() const;
+    // Parks or activates workers so `count` of them take tasks, and turns elastic sizing off. A worker that gets
+    // parked first finishes its current task and any work only it can run, so graphs in flight aren't affected. With
+    // 0 workers only threads waiting in runTasksUntil() run tasks.
+    void setThreadCount(unsigned count);
+    // Elastic sizing between `minCount` and `maxCount` workers, see Options::elastic
+    void setThreadCountRange(unsigned minCount, unsigned maxCount);
+    // Number of threads out of tasks, whether still spinning or already sleeping, that would pick up a task posted now.
+    // Parked workers don't count. Only a hint, it can change right after reading it.
+    unsigned idleThreadCount() const;
+    // The idle threads that went to sleep and need a wake up through the OS to take a task
+    unsigned sleepingThreadCount() const;
+    Scheduling scheduling() const;
+    // Indices stay the same for the lifetime of the pool, parking included, so a worker keeps its CPU and node
     static ThreadIndex threadIndex();
+    // Whether the calling thread is one of this pool's workers, as opposed to a thread outside that only participates
+    // while it waits in runTasksUntil()
+    bool isOwnWorkerThread() const;
+    // Whether the calling thread runs this pool's tasks right now, either as one of its workers or as the thread
+    // outside holding the participant slot in runTasksUntil()
+    bool isCurrentParticipant() const;
+    // CPU the worker is pinned to, or nullopt if pinning is off or the OS refused it
+    std::optional<LogicalCpu> workerCpu(ThreadIndex workerIndex) const;
+
+    // Reads counters only, without touching the queues, so it's cheap enough to poll from a monitoring thread. Values
+    // of different threads are read one after another, not at a single point in time.
+    PoolMetrics metrics() const;
+    void resetQueueDepthHighWater();
+
+    // Runs queued tasks on the calling thread until `done` is set through notifyDone(), sleeping while there is
+    // nothing to run. Workers of this pool always participate, so waiting from inside a task doesn't deadlock the pool.
+    // Only one thread outside the pool at a time can participate (it gets index maxThreadCount()), others wait until
+    // their graph finishes or the slot is free again.
+    void runTasksUntil(const std::atomic<bool>& done);
+    void notifyDone(std::atomic<bool>& done);
 
 private:
+    void pushTask(Task&& task, Priority priority, const char* label);
+    void pushTaskToWorker(ThreadIndex workerIndex, Task&& task);
+    static void markPosted(std::span<Task> tasks, const char* label);
+    void runTask(Task& task, ThreadIndex threadIndex);
+    void updateQueueDepthHighWater(size_t queueDepth);
+    bool hasTasksFor(ThreadIndex threadIndex) const;
+    MessageQueue<Task>& sharedQueue(Priority priority);
+    bool goesToOwnQueue(Priority priority) const;
+    void notifyTasksPosted(size_t taskCount);
+    static void notifyWakeUps(std::condition_variable& cond, size_t wakeUpCount, size_t sleepingCount);
+    void growIfBacklogged();
+    void shrinkAfterIdle();
+    void notifyThreadCountChanged();
+    bool isParked(ThreadIndex threadIndex) const;
+    std::optional<Task> findTask(ThreadIndex threadIndex);
+    // Mailbox, batch and own deque only, what a worker still has to run before it parks
+    std::optional<Task> findOwnTask(ThreadIndex threadIndex);
+    std::optional<Task> takeMailboxTask(ThreadIndex threadIndex);
+    // These take care of queuedTaskCount_ themselves, unlike the other queues
+    std::optional<Task> takeNormalTask(ThreadIndex threadIndex);
+    // Next task of the batch `batchOwner` took, any thread can take it
+    std::optional<Task> takeBatchedTask(ThreadIndex batchOwner);
+    std::optional<Task> stealBatchedTask(ThreadIndex threadIndex);
+    // Leaves the thread counted in spinningThreadCount_ if it returns false
+    template <typename Condition>
+    bool spinUntil(const Condition& condition);
+    void waitForTasks(const std::stop_token& stopToken);
+    void park(ThreadIndex threadIndex);
+    void runTasksAsParticipant(ThreadIndex threadIndex, const std::atomic<bool>& done);
+
     void threadTask(const std::stop_token& stopToken, int threadIndex);
     static void setThreadIndex(ThreadIndex index);
 
     static thread_local ThreadIndex threadIndex_;
+    static thread_local const ThreadPool* currentPool_;
+    // Pool whose outside participant slot the thread holds, it runs that pool's tasks even if it's a worker of another
+    static thread_local const ThreadPool* outsideSlotPool_;
+    static thread_local unsigned findTaskCount_;
+
+    Scheduling scheduling_;
+    std::string threadName_;
+    IdlePolicy idlePolicy_;
+    unsigned maxTaskBatch_;
+    std::chrono::milliseconds shrinkDelay_;
+    // Workers with an index below activeThreadCount_ take tasks, the others are parked. Elastic sizing keeps it between
+    // the min and max, which are equal when the pool isn't elastic.
+    std::atomic<unsigned> activeThreadCount_;
+    std::atomic<unsigned> minActiveThreadCount_;
+    std::atomic<unsigned> maxActiveThreadCount_;
+    // One shared queue per priority
+    std::array<MessageQueue<Task>, priorityCount> taskQueues_;
+    std::vector<std::unique_ptr<WorkStealingQueue<Task>>> workerQueues_;
+
+    // Tasks only the given worker may run. They aren't counted in queuedTaskCount_, since other threads can't take
+    // them and would otherwise keep waking up for nothing.
+    struct Mailbox {
+        MessageQueue<Task> tasks;
+        std::atomic<size_t> taskCount = 0;
+    };
+    std::vector<std::unique_ptr<Mailbox>> mailboxes_;
+    // Tasks a worker took from the shared queue in one go, but didn't run yet. Only that worker refills it, but other
+    // threads take tasks from it when they run out of work.
+    struct TakenTasks {
+        std::mutex mtx;
+        std::vector<Task> tasks;
+        size_t next = 0;
+        size_t end = 0;
+        // Read without the lock, so threads looking for work skip empty batches cheaply
+        std::atomic<size_t> taskCount = 0;
+    };
+    std::vector<std::unique_ptr<TakenTasks>> takenTasks_;
+    std::vector<std::optional<LogicalCpu>> workerCpus_;
+
+    // Number of tasks posted, but not yet taken by any thread. Used to decide whether idle workers can go to sleep.
+    std::atomic<size_t> queuedTaskCount_ = 0;
+    std::atomic<size_t> queueDepthHighWater_ = 0;
+    // One per participant, indexed by thread index
+    std::unique_ptr<detail::WorkerCounters[]> workerCounters_;
+    // Threads spinning in spinUntil() while they look for a task
+    std::atomic<unsigned> spinningThreadCount_ = 0;
+    std::atomic<unsigned> sleepingThreadCount_ = 0;
+    // Part of sleepingThreadCount_, the ones sleeping on participantCond_
+    std::atomic<unsigned> sleepingParticipantCount_ = 0;
+    std::mutex sleepMtx_;
+    std::condition_variable wakeUpCond_;
+    // Threads running tasks in runTasksUntil() sleep here, so finishing a graph only wakes them and not every idle
+    // worker. They still get their share of the wake ups for posted tasks.
+    std::condition_variable participantCond_;
+    // Separate from wakeUpCond_, so a notify_one meant for a thread that can run tasks is never consumed by a thread
+    // that only waits for its graph to finish
+    std::condition_variable doneCond_;
+    // Parked workers wait here, also separate from wakeUpCond_ so they never consume a wake up meant for a task
+    std::condition_variable parkCond_;
+    std::atomic<bool> externalSlotTaken_ = false;
 
-    MessageQueue<Task> taskQueue_;
     std::vector<std::jthread> threads_;
 };
 
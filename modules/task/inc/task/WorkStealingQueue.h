@@ -0,0 +1,73 @@
+#pragma once
+
+#include <atomic>
+#include <concepts>
+#include <deque>
+#include <iterator>
+#include <mutex>
+#include <optional>
+#include <span>
+
+namespace cg {
+// Per-worker task deque. The owning worker pushes and pops at the back (LIFO, so recently posted work stays hot in
+// cache), while other workers steal from the front (FIFO, so they take the oldest and usually largest work items).
+// Each queue has its own lock, so contention is limited to the owner and the occasional thief.
+template <typename T>
+class alignas(64) WorkStealingQueue {
+    static_assert(std::move_constructible<T>);
+
+public:
+    template <typename U>
+        requires std::convertible_to<U, T>
+    void push(U&& item) {
+        std::scoped_lock lock(mtx_);
+        items_.push_back(std::forward<U>(item));
+        size_.store(items_.size(), std::memory_order_relaxed);
+    }
+
+    void push(std::span<T> items) {
+        std::scoped_lock lock(mtx_);
+        items_.insert(items_.end(), std::make_move_iterator(items.begin()), std::make_move_iterator(items.end()));
+        size_.store(items_.size(), std::memory_order_relaxed);
+    }
+
+    // Owner side
+    std::optional<T> pop() {
+        if (empty()) {
+            return std::nullopt;
+        }
+        std::scoped_lock lock(mtx_);
+        if (items_.empty()) {
+            return std::nullopt;
+        }
+        T item = std::move(items_.back());
+        items_.pop_back();
+        size_.store(items_.size(), std::memory_order_relaxed);
+        return item;
+    }
+
+    // Thief side
+    std::optional<T> steal() {
+        if (empty()) {
+            return std::nullopt;
+        }
+        std::scoped_lock lock(mtx_);
+        if (items_.empty()) {
+            return std::nullopt;
+        }
+        T item = std::move(items_.front());
+        items_.pop_front();
+        size_.store(items_.size(), std::memory_order_relaxed);
+        return item;
+    }
+
+    // Approximate, doesn't take the lock
+    bool empty() const { return size_.load(std::memory_order_relaxed) == 0; }
+    size_t size() const { return size_.load(std::memory_order_relaxed); }
+
+private:
+    std::mutex mtx_;
+    std::deque<T> items_;
+    std::atomic<size_t> size_ = 0;
+};
+} // namespace cg
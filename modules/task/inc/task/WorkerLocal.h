@@ -0,0 +1,161 @@
+#pragma once
+
+#include "task/ThreadPool.h"
+
+#include <cassert>
+#include <atomic>
+#include <concepts>
+#include <cstddef>
+#include <functional>
+#include <memory>
+#include <optional>
+#include <type_traits>
+#include <utility>
+
+namespace cg {
+// One value of T per participant of a pool (see ThreadPool::participantCount()), for per-thread state like scratch
+// buffers or partial results, so tasks don't have to index vectors with ThreadPool::threadIndex(). Values are created
+// on first use by the thread that uses them, and each one has cache lines of its own, so threads never write to the
+// same line.
+//
+// While tasks run, a value is only touched by its own thread. Going over all values (forEach(), combine(), get()) is
+// meant for when no task uses the container, e.g. in the continuation or the last step of a graph.
+template <typename T>
+class WorkerLocal {
+public:
+    // Values are default constructed
+    explicit WorkerLocal(ThreadPool& threadPool)
+        requires std::default_initializable<T>
+        : WorkerLocal(threadPool, []() {
+              return T();
+          }) {}
+
+    // `factory()` or `factory(threadIndex)` creates the value of a thread
+    template <typename Factory>
+        requires std::is_invocable_r_v<T, Factory&> || std::is_invocable_r_v<T, Factory&, ThreadPool::ThreadIndex>
+    WorkerLocal(ThreadPool& threadPool, Factory&& factory)
+        : threadPool_(threadPool), factory_(makeFactory(std::forward<Factory>(factory))),
+          slotCount_(threadPool.participantCount()), slots_(std::make_unique<Slot[]>(slotCount_)) {}
+
+    WorkerLocal(const WorkerLocal&) = delete;
+    WorkerLocal& operator=(const WorkerLocal&) = delete;
+
+    // Value of the calling thread, which has to be a participant of the pool (see ThreadPool::isCurrentParticipant())
+    T& local() {
+        assert(threadPool_.isCurrentParticipant() && "Thread isn't a participant of the pool.");
+        ThreadPool::ThreadIndex index = ThreadPool::threadIndex();
+        assert(static_cast<size_t>(index) < slotCount_ && "Thread index is out of the pool's range.");
+        std::optional<T>& value = slots_[index].value;
+        if (!value.has_value()) {
+            value.emplace(factory_(index));
+        }
+        return *value;
+    }
+
+    // Creates the value of every worker that doesn't have one yet on the worker itself, and waits for them, running
+    // pool tasks in the meantime (see ThreadPool::runTasksUntil()). Memory a value allocates and fills on creation is
+    // then placed on its worker's node, when workers are pinned. Called from outside the pool, the value of the
+    // participant outside the pool is created on the calling thread. A worker calling this creates its own value
+    // right away instead, since its mailbox would only be served after the wait. Parked workers are skipped, they
+    // create their value on first use once they are active again.
+    void createOnWorkers() {
+        unsigned workerCount = threadPool_.threadCount();
+        ThreadPool::ThreadIndex callerIndex = ThreadPool::invalidIndex;
+        if (threadPool_.isOwnWorkerThread()) {
+            callerIndex = ThreadPool::threadIndex();
+            local();
+        }
+        unsigned taskCount = 0;
+        for (unsigned i = 0; i < workerCount; ++i) {
+            taskCount += static_cast<ThreadPool::ThreadIndex>(i) != callerIndex ? 1 : 0;
+        }
+        std::atomic<unsigned> pending = taskCount;
+        std::atomic<bool> done = false;
+        for (unsigned i = 0; i < workerCount; ++i) {
+            if (static_cast<ThreadPool::ThreadIndex>(i) == callerIndex) {
+                continue;
+            }
+            threadPool_.postTaskToWorker(static_cast<ThreadPool::ThreadIndex>(i), [this, &pending, &done]() {
+                local();
+                if (--pending == 0) {
+                    threadPool_.notifyDone(done);
+                }
+            });
+        }
+        std::optional<T>& outsideValue = slots_[slotCount_ - 1].value;
+        if (callerIndex == ThreadPool::invalidIndex && !outsideValue.has_value()) {
+            outsideValue.emplace(factory_(static_cast<ThreadPool::ThreadIndex>(slotCount_ - 1)));
+        }
+        // Even if every task already ran, the last one may still be in notifyDone()
+        if (taskCount > 0) {
+            threadPool_.runTasksUntil(done);
+        }
+    }
+
+    // Value of the given thread, nullptr if it wasn't created
+    T* get(ThreadPool::ThreadIndex index) {
+        assert(index >= 0 && static_cast<size_t>(index) < slotCount_ && "Invalid thread index.");
+        std::optional<T>& value = slots_[index].value;
+        return value.has_value() ? &*value : nullptr;
+    }
+
+    // Calls `visitor(T&)` for every created value, in thread index order
+    template <typename F>
+        requires std::invocable<F&, T&>
+    void forEach(F&& visitor) {
+        for (size_t i = 0; i < slotCount_; ++i) {
+            if (slots_[i].value.has_value()) {
+                std::invoke(visitor, *slots_[i].value);
+            }
+        }
+    }
+
+    // Folds the created values into `identity` with `join(T, T)`, in thread index order, then destroys them
+    template <typename Join>
+        requires std::is_invocable_r_v<T, Join&, T, T>
+    T combine(T identity, Join&& join) {
+        T result = std::move(identity);
+        forEach([&result, &join](T& value) {
+            result = std::invoke(join, std::move(result), std::move(value));
+        });
+        clear();
+        return result;
+    }
+
+    size_t createdCount() const {
+        size_t count = 0;
+        for (size_t i = 0; i < slotCount_; ++i) {
+            count += slots_[i].value.has_value() ? 1 : 0;
+        }
+        return count;
+    }
+
+    // Destroys all values, they are created again on next use
+    void clear() {
+        for (size_t i = 0; i < slotCount_; ++i) {
+            slots_[i].value.reset();
+        }
+    }
+
+private:
+    struct alignas(64) Slot {
+        std::optional<T> value;
+    };
+
+    template <typename Factory>
+    static std::function<T(ThreadPool::ThreadIndex)> makeFactory(Factory&& factory) {
+        if constexpr (std::is_invocable_r_v<T, Factory&, ThreadPool::ThreadIndex>) {
+            return std::forward<Factory>(factory);
+        } else {
+            return [factory = std::forward<Factory>(factory)](ThreadPool::ThreadIndex) mutable {
+                return std::invoke(factory);
+            };
+        }
+    }
+
+    ThreadPool& threadPool_;
+    std::function<T(ThreadPool::ThreadIndex)> factory_;
+    size_t slotCount_;
+    std::unique_ptr<Slot[]> slots_;
+};
+} // namespace cg
@@ -0,0 +1,251 @@
+#include "task/CpuTopology.h"
+
+#include <algorithm>
+#include <cassert>
+#include <charconv>
+#include <map>
+#include <set>
+#include <utility>
+
+#ifdef _WIN32
+#define WIN32_LEAN_AND_MEAN
+#define NOMINMAX
+#include <windows.h>
+#else
+#include <filesystem>
+#include <fstream>
+#include <optional>
+#include <pthread.h>
+#include <sched.h>
+#endif
+
+namespace cg {
+namespace {
+CpuTopology fallbackTopology() {
+    std::vector<LogicalCpu> cpus;
+    unsigned cpuCount = std::max(std::thread::hardware_concurrency(), 1u);
+    for (unsigned i = 0; i < cpuCount; ++i) {
+        cpus.push_back({.id = i, .core = i, .node = 0});
+    }
+    return CpuTopology(std::move(cpus));
+}
+
+#ifndef _WIN32
+std::optional<std::string> readFirstLine(const std::filesystem::path& path) {
+    std::ifstream file(path);
+    std::string line;
+    if (!file || !std::getline(file, line)) {
+        return std::nullopt;
+    }
+    return line;
+}
+
+std::optional<unsigned> readUnsigned(const std::filesystem::path& path) {
+    auto line = readFirstLine(path);
+    unsigned value;
+    if (!line.has_value() || std::from_chars(line->data(), line->data() + line->size(), value).ec != std::errc()) {
+        return std::nullopt;
+    }
+    return value;
+}
+
+CpuTopology detectTopology() {
+    const std::filesystem::path cpuDir = "/sys/devices/system/cpu";
+    auto onlineList = readFirstLine(cpuDir / "online");
+    if (!onlineList.has_value()) {
+        return fallbackTopology();
+    }
+
+    std::map<unsigned, unsigned> nodeOfCpu;
+    std::error_code error;
+    for (const auto& entry : std::filesystem::directory_iterator("/sys/devices/system/node", error)) {
+        std::string name = entry.path().filename().string();
+        unsigned node;
+        if (!name.starts_with("node") ||
+            std::from_chars(name.data() + 4, name.data() + name.size(), node).ec != std::errc()) {
+            continue;
+        }
+        auto cpuList = readFirstLine(entry.path() / "cpulist");
+        for (unsigned cpu : CpuTopology::parseCpuList(cpuList.value_or(""))) {
+            nodeOfCpu[cpu] = node;
+        }
+    }
+
+    cpu_set_t allowedCpus;
+    CPU_ZERO(&allowedCpus);
+    bool hasAffinity = sched_getaffinity(0, sizeof(allowedCpus), &allowedCpus) == 0;
+
+    // Physical cores are identified by package and core id, which are only unique together
+    std::map<std::pair<unsigned, unsigned>, unsigned> coreIndices;
+    std::vector<LogicalCpu> cpus;
+    for (unsigned cpu : CpuTopology::parseCpuList(*onlineList)) {
+        if (hasAffinity && (cpu >= CPU_SETSIZE || !CPU_ISSET(cpu, &allowedCpus))) {
+            continue;
+        }
+        auto topologyDir = cpuDir / ("cpu" + std::to_string(cpu)) / "topology";
+        unsigned package = readUnsigned(topologyDir / "physical_package_id").value_or(0);
+        unsigned coreId = readUnsigned(topologyDir / "core_id").value_or(cpu);
+        auto [coreIt, inserted] = coreIndices.try_emplace({package, coreId}, static_cast<unsigned>(coreIndices.size()));
+        auto nodeIt = nodeOfCpu.find(cpu);
+        cpus.push_back({.id = cpu, .core = coreIt->second, .node = nodeIt != nodeOfCpu.end() ? nodeIt->second : 0});
+    }
+    if (cpus.empty()) {
+        return fallbackTopology();
+    }
+    return CpuTopology(std::move(cpus));
+}
+#else
+CpuTopology detectTopology() {
+    DWORD length = 0;
+    GetLogicalProcessorInformationEx(RelationAll, nullptr, &length);
+    if (GetLastError() != ERROR_INSUFFICIENT_BUFFER) {
+        return fallbackTopology();
+    }
+    std::vector<std::byte> buffer(length);
+    auto* info = reinterpret_cast<SYSTEM_LOGICAL_PROCESSOR_INFORMATION_EX*>(buffer.data());
+    if (!GetLogicalProcessorInformationEx(RelationAll, info, &length)) {
+        return fallbackTopology();
+    }
+
+    // Logical CPU ids are numbered across processor groups, 64 per group
+    auto forEachCpu = [](const GROUP_AFFINITY& affinity, auto&& func) {
+        for (unsigned bit = 0; bit < 64; ++bit) {
+            if (affinity.Mask & (KAFFINITY(1) << bit)) {
+                func(static_cast<unsigned>(affinity.Group) * 64 + bit);
+            }
+        }
+    };
+
+    std::map<unsigned, unsigned> nodeOfCpu;
+    std::vector<LogicalCpu> cpus;
+    unsigned coreIndex = 0;
+    for (DWORD offset = 0; offset < length;) {
+        auto* entry = reinterpret_cast<SYSTEM_LOGICAL_PROCESSOR_INFORMATION_EX*>(buffer.data() + offset);
+        if (entry->Relationship == RelationProcessorCore) {
+            for (WORD i = 0; i < entry->Processor.GroupCount; ++i) {
+                forEachCpu(entry->Processor.GroupMask[i], [&](unsigned cpu) {
+                    cpus.push_back({.id = cpu, .core = coreIndex, .node = 0});
+                });
+            }
+            ++coreIndex;
+        } else if (entry->Relationship == RelationNumaNode) {
+            forEachCpu(entry->NumaNode.GroupMask, [&](unsigned cpu) {
+                nodeOfCpu[cpu] = entry->NumaNode.NodeNumber;
+            });
+        }
+        offset += entry->Size;
+    }
+    for (LogicalCpu& cpu : cpus) {
+        auto nodeIt = nodeOfCpu.find(cpu.id);
+        cpu.node = nodeIt != nodeOfCpu.end() ? nodeIt->second : 0;
+    }
+    if (cpus.empty()) {
+        return fallbackTopology();
+    }
+    return CpuTopology(std::move(cpus));
+}
+#endif
+} // namespace
+
+CpuTopology::CpuTopology(std::vector<LogicalCpu> cpus) : cpus_(std::move(cpus)) {
+    assert(!cpus_.empty());
+    std::ranges::sort(cpus_, {}, &LogicalCpu::id);
+}
+
+CpuTopology CpuTopology::detect() { return detectTopology(); }
+
+const std::vector<LogicalCpu>& CpuTopology::logicalCpus() const { return cpus_; }
+
+unsigned CpuTopology::physicalCoreCount() const {
+    std::set<unsigned> cores;
+    for (const LogicalCpu& cpu : cpus_) {
+        cores.insert(cpu.core);
+    }
+    return static_cast<unsigned>(cores.size());
+}
+
+unsigned CpuTopology::nodeCount() const {
+    std::set<unsigned> nodes;
+    for (const LogicalCpu& cpu : cpus_) {
+        nodes.insert(cpu.node);
+    }
+    return static_cast<unsigned>(nodes.size());
+}
+
+std::vector<LogicalCpu> CpuTopology::pinningOrder(bool includeSmtSiblings) const {
+    std::vector<LogicalCpu> firstOnCore;
+    std::vector<LogicalCpu> siblings;
+    std::set<unsigned> coresSeen;
+    // cpus_ is sorted by id, so the lowest id of each core is the one that is used first
+    for (const LogicalCpu& cpu : cpus_) {
+        if (coresSeen.insert(cpu.core).second) {
+            firstOnCore.push_back(cpu);
+        } else {
+            siblings.push_back(cpu);
+        }
+    }
+    auto byNodeAndCore = [](const LogicalCpu& lhs, const LogicalCpu& rhs) {
+        return std::tie(lhs.node, lhs.core, lhs.id) < std::tie(rhs.node, rhs.core, rhs.id);
+    };
+    std::ranges::sort(firstOnCore, byNodeAndCore);
+    if (includeSmtSiblings) {
+        std::ranges::sort(siblings, byNodeAndCore);
+        firstOnCore.insert(firstOnCore.end(), siblings.begin(), siblings.end());
+    }
+    return firstOnCore;
+}
+
+std::vector<unsigned> CpuTopology::parseCpuList(std::string_view list) {
+    std::vector<unsigned> cpus;
+    while (!list.empty()) {
+        size_t comma = list.find(',');
+        std::string_view range = list.substr(0, comma);
+        list = comma == std::string_view::npos ? std::string_view() : list.substr(comma + 1);
+
+        unsigned first;
+        auto [firstEnd, firstError] = std::from_chars(range.data(), range.data() + range.size(), first);
+        if (firstError != std::errc()) {
+            continue;
+        }
+        unsigned last = first;
+        if (firstEnd != range.data() + range.size() && *firstEnd == '-') {
+            if (std::from_chars(firstEnd + 1, range.data() + range.size(), last).ec != std::errc() || last < first) {
+                continue;
+            }
+        }
+        for (unsigned cpu = first; cpu <= last; ++cpu) {
+            cpus.push_back(cpu);
+        }
+    }
+    return cpus;
+}
+
+#ifndef _WIN32
+bool pinThreadToCpu(std::thread::native_handle_type thread, unsigned cpuId) {
+    if (cpuId >= CPU_SETSIZE) {
+        return false;
+    }
+    cpu_set_t cpuSet;
+    CPU_ZERO(&cpuSet);
+    CPU_SET(cpuId, &cpuSet);
+    return pthread_setaffinity_np(thread, sizeof(cpuSet), &cpuSet) == 0;
+}
+
+bool setThreadName(std::thread::native_handle_type thread, const std::string& name) {
+    // Linux limits thread names to 15 characters
+    return pthread_setname_np(thread, name.substr(0, 15).c_str()) == 0;
+}
+#else
+bool pinThreadToCpu(std::thread::native_handle_type thread, unsigned cpuId) {
+    GROUP_AFFINITY affinity{};
+    affinity.Group = static_cast<WORD>(cpuId / 64);
+    affinity.Mask = KAFFINITY(1) << (cpuId % 64);
+    return SetThreadGroupAffinity(static_cast<HANDLE>(thread), &affinity, nullptr) != 0;
+}
+
+bool setThreadName(std::thread::native_handle_type thread, const std::string& name) {
+    std::wstring wideName(name.begin(), name.end());
+    return SUCCEEDED(SetThreadDescription(static_cast<HANDLE>(thread), wideName.c_str()));
+}
+#endif
+} // namespace cg
@@ -0,0 +1,104 @@
+#include "task/PoolMetrics.h"
+
+#include <algorithm>
+#include <bit>
+#include <cmath>
+
+namespace cg {
+namespace {
+size_t latencyBucket(int64_t latencyNs) {
+    auto micros = static_cast<uint64_t>(std::max<int64_t>(latencyNs, 0) / 1000);
+    return std::min<size_t>(std::bit_width(micros), WorkerMetrics::latencyBucketCount - 1);
+}
+
+double ratio(std::chrono::nanoseconds busy, std::chrono::nanoseconds idle) {
+    auto total = busy + idle;
+    return total.count() > 0 ? static_cast<double>(busy.count()) / static_cast<double>(total.count()) : 0.0;
+}
+} // namespace
+
+std::chrono::nanoseconds WorkerMetrics::latencyBucketUpperBound(size_t bucket) {
+    if (bucket + 1 >= latencyBucketCount) {
+        return std::chrono::nanoseconds::max();
+    }
+    return std::chrono::microseconds(uint64_t(1) << bucket);
+}
+
+double WorkerMetrics::busyRatio() const { return ratio(busyTime, idleTime); }
+
+uint64_t PoolMetrics::tasksExecuted() const {
+    uint64_t total = 0;
+    for (const WorkerMetrics& worker : workers) {
+        total += worker.tasksExecuted;
+    }
+    return total;
+}
+
+double PoolMetrics::busyRatio() const {
+    std::chrono::nanoseconds busy{0};
+    std::chrono::nanoseconds idle{0};
+    // The outside participant only has busy time, so it would skew the ratio
+    for (size_t i = 0; i + 1 < workers.size(); ++i) {
+        busy += workers[i].busyTime;
+        idle += workers[i].idleTime;
+    }
+    return ratio(busy, idle);
+}
+
+WorkerMetrics::LatencyHistogram PoolMetrics::startLatency() const {
+    WorkerMetrics::LatencyHistogram total{};
+    for (const WorkerMetrics& worker : workers) {
+        for (size_t i = 0; i < total.size(); ++i) {
+            total[i] += worker.startLatency[i];
+        }
+    }
+    return total;
+}
+
+std::chrono::nanoseconds PoolMetrics::startLatencyQuantile(double quantile) const {
+    WorkerMetrics::LatencyHistogram histogram = startLatency();
+    uint64_t count = 0;
+    for (uint64_t bucketCount : histogram) {
+        count += bucketCount;
+    }
+    if (count == 0) {
+        return std::chrono::nanoseconds(0);
+    }
+    auto rank = static_cast<uint64_t>(std::ceil(std::clamp(quantile, 0.0, 1.0) * static_cast<double>(count)));
+    uint64_t seen = 0;
+    for (size_t i = 0; i < histogram.size(); ++i) {
+        seen += histogram[i];
+        if (seen >= std::max<uint64_t>(rank, 1)) {
+            return WorkerMetrics::latencyBucketUpperBound(i);
+        }
+    }
+    return WorkerMetrics::latencyBucketUpperBound(histogram.size() - 1);
+}
+
+namespace detail {
+int64_t metricsNow() {
+    return std::chrono::duration_cast<std::chrono::nanoseconds>(std::chrono::steady_clock::now().time_since_epoch())
+        .count();
+}
+
+void WorkerCounters::recordTask(int64_t postTime, int64_t beginTime, int64_t endTime) {
+    tasksExecuted.store(tasksExecuted.load(std::memory_order_relaxed) + 1, std::memory_order_relaxed);
+    busyNs.store(busyNs.load(std::memory_order_relaxed) + (endTime - beginTime), std::memory_order_relaxed);
+    auto& bucket = startLatency[latencyBucket(beginTime - postTime)];
+    bucket.store(bucket.load(std::memory_order_relaxed) + 1, std::memory_order_relaxed);
+}
+
+WorkerMetrics WorkerCounters::snapshot(int64_t now) const {
+    WorkerMetrics metrics;
+    metrics.tasksExecuted = tasksExecuted.load(std::memory_order_relaxed);
+    metrics.busyTime = std::chrono::nanoseconds(busyNs.load(std::memory_order_relaxed));
+    if (startTime != 0) {
+        metrics.idleTime = std::chrono::nanoseconds(std::max<int64_t>(now - startTime - metrics.busyTime.count(), 0));
+    }
+    for (size_t i = 0; i < startLatency.size(); ++i) {
+        metrics.startLatency[i] = startLatency[i].load(std::memory_order_relaxed);
+    }
+    return metrics;
+}
+} // namespace detail
+} // namespace cg
@@ -0,0 +1,111 @@
+#include "task/TaskArena.h"
+
+#include <algorithm>
+#include <cassert>
+#include <new>
+#include <thread>
+
+namespace cg {
+TaskArena::Chunk::Chunk(size_t size, size_t index)
+    : memory(static_cast<std::byte*>(::operator new(size, std::align_val_t(alignof(std::max_align_t))))), size(size),
+      index(index) {}
+
+TaskArena::Chunk::~Chunk() { ::operator delete(memory, size, std::align_val_t(alignof(std::max_align_t))); }
+
+TaskArena::TaskArena(size_t chunkSize) : chunkSize_(chunkSize) { assert(chunkSize_ > 0); }
+
+TaskArena::~TaskArena() {
+    [[maybe_unused]] bool deallocated = waitForDeallocations();
+    assert(deallocated && "TaskArena destroyed while its memory is still in use.");
+}
+
+void TaskArena::reset() {
+    [[maybe_unused]] bool deallocated = waitForDeallocations();
+    assert(deallocated && "TaskArena reset while its memory is still in use.");
+    std::scoped_lock lock(mtx_);
+    if (!chunks_.empty()) {
+        chunks_.front()->offset.store(0, std::memory_order_relaxed);
+        currChunk_.store(chunks_.front().get(), std::memory_order_release);
+    }
+    bytesAllocated_.store(0, std::memory_order_relaxed);
+}
+
+size_t TaskArena::chunkAllocationCount() const {
+    std::scoped_lock lock(mtx_);
+    return chunkAllocationCount_;
+}
+
+size_t TaskArena::bytesAllocated() const { return bytesAllocated_.load(std::memory_order_relaxed); }
+
+size_t TaskArena::capacity() const {
+    std::scoped_lock lock(mtx_);
+    size_t capacity = 0;
+    for (const auto& chunk : chunks_) {
+        capacity += chunk->size;
+    }
+    return capacity;
+}
+
+void* TaskArena::do_allocate(size_t bytes, size_t alignment) {
+    Chunk* chunk = currChunk_.load(std::memory_order_acquire);
+    void* ptr = chunk != nullptr ? allocateFromChunk(*chunk, bytes, alignment) : nullptr;
+    while (ptr == nullptr) {
+        advanceChunk(chunk, bytes, alignment);
+        chunk = currChunk_.load(std::memory_order_acquire);
+        ptr = allocateFromChunk(*chunk, bytes, alignment);
+    }
+    bytesAllocated_.fetch_add(bytes, std::memory_order_relaxed);
+    liveAllocationCount_.fetch_add(1);
+    return ptr;
+}
+
+void TaskArena::do_deallocate(void* ptr, size_t bytes, size_t alignment) { liveAllocationCount_.fetch_sub(1); }
+
+bool TaskArena::do_is_equal(const std::pmr::memory_resource& other) const noexcept { return this == &other; }
+
+bool TaskArena::waitForDeallocations() const {
+    // Workers may still be destroying the state of a graph that has just signaled it's done
+    auto deadline = std::chrono::steady_clock::now() + maxDeallocationWait;
+    while (liveAllocationCount_.load() > 0) {
+        if (std::chrono::steady_clock::now() > deadline) {
+            return false;
+        }
+        std::this_thread::yield();
+    }
+    return true;
+}
+
+void* TaskArena::allocateFromChunk(Chunk& chunk, size_t bytes, size_t alignment) {
+    size_t offset = chunk.offset.load(std::memory_order_relaxed);
+    while (true) {
+        void* ptr = chunk.memory + offset;
+        size_t space = chunk.size - offset;
+        if (std::align(alignment, bytes, ptr, space) == nullptr) {
+            return nullptr;
+        }
+        size_t newOffset = static_cast<std::byte*>(ptr) + bytes - chunk.memory;
+        if (chunk.offset.compare_exchange_weak(offset, newOffset, std::memory_order_relaxed)) {
+            return ptr;
+        }
+    }
+}
+
+void TaskArena::advanceChunk(const Chunk* full, size_t bytes, size_t alignment) {
+    std::scoped_lock lock(mtx_);
+    if (currChunk_.load(std::memory_order_relaxed) != full) {
+        // Another thread has already moved on, try the chunk it picked first
+        return;
+    }
+    // Move on through the chunks kept from previous frames, a chunk too small for this allocation is skipped by the
+    // next call
+    size_t next = full != nullptr ? full->index + 1 : 0;
+    if (next == chunks_.size()) {
+        size_t newChunkSize = std::max(chunkSize_, bytes + alignment);
+        chunks_.push_back(std::make_unique<Chunk>(newChunkSize, next));
+        ++chunkAllocationCount_;
+    }
+    Chunk& chunk = *chunks_[next];
+    chunk.offset.store(0, std::memory_order_relaxed);
+    currChunk_.store(&chunk, std::memory_order_release);
+}
+} // namespace cg
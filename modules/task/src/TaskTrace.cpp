@@ -0,0 +1,214 @@
+#include "task/TaskTrace.h"
+
+#include <array>
+#include <atomic>
+#include <chrono>
+#include <iomanip>
+#include <memory>
+#include <mutex>
+#include <string_view>
+#include <vector>
+
+namespace cg {
+namespace {
+struct Chunk {
+    static constexpr size_t capacity = 1024;
+
+    std::array<TraceEvent, capacity> events;
+    // Written only by the owning thread, published with release so readers see complete events
+    std::atomic<size_t> count = 0;
+    std::atomic<Chunk*> next = nullptr;
+};
+
+std::atomic<bool> recording_ = false;
+// Threads drop their events on the next append after the epoch changes, so clear() never touches other threads' buffers
+std::atomic<uint64_t> clearEpoch_ = 0;
+// Events that began before this are skipped by the export, in case their thread hasn't appended anything since
+std::atomic<int64_t> clearTime_ = 0;
+
+struct ThreadBuffer {
+    explicit ThreadBuffer(unsigned id_) : id(id_) {}
+
+    void append(const TraceEvent& event) {
+        uint64_t epoch = clearEpoch_.load(std::memory_order_acquire);
+        if (epoch != seenEpoch) {
+            reset(epoch);
+        }
+
+        size_t count = curr->count.load(std::memory_order_relaxed);
+        if (count == Chunk::capacity) {
+            // Chunks are kept on clear(), so reuse the next one if there is one
+            Chunk* next = curr->next.load(std::memory_order_relaxed);
+            if (next == nullptr) {
+                next = extraChunks.emplace_back(std::make_unique<Chunk>()).get();
+                curr->next.store(next, std::memory_order_release);
+            }
+            curr = next;
+            count = 0;
+        }
+        curr->events[count] = event;
+        curr->count.store(count + 1, std::memory_order_release);
+    }
+
+    void reset(uint64_t epoch) {
+        for (Chunk* chunk = &first; chunk != nullptr; chunk = chunk->next.load(std::memory_order_relaxed)) {
+            chunk->count.store(0, std::memory_order_relaxed);
+        }
+        curr = &first;
+        seenEpoch = epoch;
+    }
+
+    unsigned id;
+    std::string name;
+    Chunk first;
+    // Only used by the owning thread
+    Chunk* curr = &first;
+    uint64_t seenEpoch = 0;
+    std::vector<std::unique_ptr<Chunk>> extraChunks;
+    // Set when the thread exits. Its events stay until the next clear(), after that a new thread can take the buffer.
+    bool retired = false;
+};
+
+// Buffers are owned here rather than by their threads, so events survive threads that have exited
+struct Registry {
+    std::mutex mtx;
+    std::vector<std::unique_ptr<ThreadBuffer>> buffers;
+};
+
+Registry& registry() {
+    static Registry instance;
+    return instance;
+}
+
+ThreadBuffer* acquireBuffer() {
+    Registry& reg = registry();
+    std::scoped_lock lock(reg.mtx);
+    uint64_t epoch = clearEpoch_.load();
+    for (const auto& buffer : reg.buffers) {
+        if (buffer->retired && buffer->seenEpoch != epoch) {
+            buffer->reset(epoch);
+            buffer->name.clear();
+            buffer->retired = false;
+            return buffer.get();
+        }
+    }
+    auto& buffer = reg.buffers.emplace_back(std::make_unique<ThreadBuffer>(static_cast<unsigned>(reg.buffers.size())));
+    buffer->seenEpoch = epoch;
+    return buffer.get();
+}
+
+struct BufferOwner {
+    ~BufferOwner() {
+        if (buffer != nullptr) {
+            std::scoped_lock lock(registry().mtx);
+            buffer->retired = true;
+        }
+    }
+
+    ThreadBuffer* buffer = nullptr;
+};
+
+thread_local BufferOwner threadBuffer_;
+
+ThreadBuffer& currentThreadBuffer() {
+    if (threadBuffer_.buffer == nullptr) {
+        threadBuffer_.buffer = acquireBuffer();
+    }
+    return *threadBuffer_.buffer;
+}
+
+void writeJsonString(std::ostream& out, std::string_view str) {
+    out << '"';
+    for (char c : str) {
+        if (c == '"' || c == '\\') {
+            out << '\\' << c;
+        } else if (static_cast<unsigned char>(c) < 0x20) {
+            out << "\\u" << std::hex << std::setw(4) << std::setfill('0') << static_cast<unsigned>(c) << std::dec;
+        } else {
+            out << c;
+        }
+    }
+    out << '"';
+}
+
+// Chrome trace timestamps are in microseconds
+double toMicroseconds(int64_t nanoseconds) { return static_cast<double>(nanoseconds) / 1000.0; }
+} // namespace
+
+int64_t TaskTrace::now() {
+    return std::chrono::duration_cast<std::chrono::nanoseconds>(std::chrono::steady_clock::now().time_since_epoch())
+        .count();
+}
+
+void TaskTrace::setRecording(bool recording) { recording_.store(recording); }
+
+bool TaskTrace::isRecording() { return recording_.load(std::memory_order_relaxed); }
+
+void TaskTrace::record(const TraceEvent& event) {
+    if (isRecording()) {
+        currentThreadBuffer().append(event);
+    }
+}
+
+void TaskTrace::setThreadName(std::string name) {
+    ThreadBuffer& buffer = currentThreadBuffer();
+    std::scoped_lock lock(registry().mtx);
+    buffer.name = std::move(name);
+}
+
+void TaskTrace::writeChromeJson(std::ostream& out) {
+    Registry& reg = registry();
+    std::scoped_lock lock(reg.mtx);
+
+    std::ios_base::fmtflags prevFlags = out.flags();
+    std::streamsize prevPrecision = out.precision(3);
+    char prevFill = out.fill();
+    out << std::fixed << "{\"traceEvents\":[";
+    int64_t clearTime = clearTime_.load();
+    bool first = true;
+    auto separate = [&out, &first]() {
+        if (!first) {
+            out << ",\n";
+        }
+        first = false;
+    };
+
+    for (const auto& buffer : reg.buffers) {
+        if (!buffer->name.empty()) {
+            separate();
+            out << R"({"ph":"M","name":"thread_name","pid":1,"tid":)" << buffer->id << R"(,"args":{"name":)";
+            writeJsonString(out, buffer->name);
+            out << "}}";
+        }
+        for (const Chunk* chunk = &buffer->first; chunk != nullptr;
+             chunk = chunk->next.load(std::memory_order_acquire)) {
+            size_t count = chunk->count.load(std::memory_order_acquire);
+            for (size_t i = 0; i < count; ++i) {
+                const TraceEvent& event = chunk->events[i];
+                if (event.beginTime < clearTime) {
+                    continue;
+                }
+                separate();
+                out << R"({"ph":"X","name":)";
+                writeJsonString(out, event.label != nullptr ? event.label : "task");
+                out << R"(,"pid":1,"tid":)" << buffer->id << R"(,"ts":)" << toMicroseconds(event.beginTime)
+                    << R"(,"dur":)" << toMicroseconds(event.endTime - event.beginTime) << R"(,"args":{"thread":)"
+                    << event.threadIndex;
+                if (event.postTime != 0) {
+                    out << R"(,"queuedUs":)" << toMicroseconds(event.beginTime - event.postTime);
+                }
+                out << "}}";
+            }
+        }
+    }
+    out << "],\"displayTimeUnit\":\"ns\"}\n";
+    out.flags(prevFlags);
+    out.precision(prevPrecision);
+    out.fill(prevFill);
+}
+
+void TaskTrace::clear() {
+    clearTime_.store(now());
+    clearEpoch_.fetch_add(1, std::memory_order_release);
+}
+} // namespace cg
@@ -1,27 +1,109 @@
 #include "task/ThreadPool.h"
 
+#include <algorithm>
 #include <cassert>
 #include <latch>
+#include <string>
+
+#if defined(__x86_64__) || defined(__i386__) || defined(_M_X64) || defined(_M_IX86)
+#include <immintrin.h>
+#elif defined(_M_ARM64)
+#include <intrin.h>
+#endif
 
 namespace cg {
+namespace {
+// Tells the CPU this is a spin wait, which saves power and leaves more of the core to an SMT sibling
+void cpuRelax() {
+#if defined(__x86_64__) || defined(__i386__) || defined(_M_X64) || defined(_M_IX86)
+    _mm_pause();
+#elif defined(__aarch64__)
+    asm volatile("yield");
+#elif defined(_M_ARM64)
+    __yield();
+#endif
+}
+} // namespace
+
 thread_local ThreadPool::ThreadIndex ThreadPool::threadIndex_ = -1;
+thread_local const ThreadPool* ThreadPool::currentPool_ = nullptr;
+thread_local const ThreadPool* ThreadPool::outsideSlotPool_ = nullptr;
+thread_local unsigned ThreadPool::findTaskCount_ = 0;
+
+ThreadPool::ThreadPool(unsigned threadCount, Scheduling scheduling)
+    : ThreadPool(Options{.threadCount = threadCount, .scheduling = scheduling}) {}
+
+ThreadPool::ThreadPool(const Options& options)
+    : scheduling_(options.scheduling), threadName_(options.threadName), idlePolicy_(options.idlePolicy),
+      maxTaskBatch_(std::max(options.maxTaskBatch, 1u)), shrinkDelay_(options.shrinkDelay),
+      activeThreadCount_(options.threadCount), minActiveThreadCount_(options.threadCount),
+      maxActiveThreadCount_(options.threadCount),
+      taskQueues_{MessageQueue<Task>(options.queueOrder), MessageQueue<Task>(options.queueOrder),
+                  MessageQueue<Task>(options.queueOrder)} {
+    if (std::thread::hardware_concurrency() <= 1) {
+        idlePolicy_.spinCount = 0;
+    }
+    // Every worker the pool can have is started right away and parked if it's not needed yet, so per-thread state never
+    // has to be resized and thread indices stay valid
+    unsigned threadCount = options.maxThreadCount == 0 ? options.threadCount : options.maxThreadCount;
+    assert(threadCount >= options.threadCount && "maxThreadCount is below threadCount.");
+    if (options.elastic) {
+        maxActiveThreadCount_.store(threadCount);
+    }
+    workerCounters_ = std::make_unique<detail::WorkerCounters[]>(threadCount + 1);
+#if CG_TASK_METRICS
+    int64_t startTime = detail::metricsNow();
+    for (unsigned i = 0; i < threadCount; ++i) {
+        workerCounters_[i].startTime = startTime;
+    }
+#endif
+    if (scheduling_ == Scheduling::WorkStealing) {
+        for (unsigned i = 0; i < threadCount; ++i) {
+            workerQueues_.push_back(std::make_unique<WorkStealingQueue<Task>>());
+        }
+    }
+    for (unsigned i = 0; i < threadCount; ++i) {
+        mailboxes_.push_back(std::make_unique<Mailbox>());
+    }
+    if (maxTaskBatch_ > 1) {
+        for (unsigned i = 0; i < threadCount; ++i) {
+            takenTasks_.push_back(std::make_unique<TakenTasks>());
+            takenTasks_.back()->tasks.resize(maxTaskBatch_);
+        }
+    }
+
+    std::vector<LogicalCpu> cpus;
+    if (options.pinning != Pinning::None) {
+        cpus = CpuTopology::detect().pinningOrder(options.pinning == Pinning::LogicalCpus);
+    }
+    workerCpus_.resize(threadCount);
 
-ThreadPool::ThreadPool(unsigned threadCount) {
     for (unsigned i = 0; i < threadCount; ++i) {
         threads_.emplace_back(
             [this](const std::stop_token& stopToken, int threadIndex) {
                 threadTask(stopToken, threadIndex);
             },
             i);
+        // Done from here rather than by the worker itself, so workerCpus_ is complete once the constructor returns
+        if (!cpus.empty()) {
+            const LogicalCpu& cpu = cpus[i % cpus.size()];
+            if (pinThreadToCpu(threads_.back().native_handle(), cpu.id)) {
+                workerCpus_[i] = cpu;
+            }
+        }
+        if (!options.threadName.empty()) {
+            setThreadName(threads_.back().native_handle(), threadName_ + "-" + std::to_string(i));
+        }
     }
 }
 
 ThreadPool::~ThreadPool() {
     // We need to make sure all stop requests are sent before workers pass the latch, which is why this thread also
-    // needs to participate in the latch.
+    // needs to participate in the latch. The latch tasks go to the mailboxes, so one worker can't take several of them
+    // in one batch and wait for itself.
     std::latch latch(threads_.size() + 1);
     for (size_t i = 0; i < threads_.size(); ++i) {
-        taskQueue_.post([&latch]() {
+        postTaskToWorker(static_cast<ThreadIndex>(i), [&latch]() {
             latch.arrive_and_wait();
         });
     }
@@ -31,30 +113,552 @@ ThreadPool::~ThreadPool() {
     latch.count_down();
 }
 
-void ThreadPool::postTasks(std::vector<Task>& tasks) { taskQueue_.post(tasks); }
+ThreadPool& ThreadPool::defaultPool() {
+    static ThreadPool pool;
+    return pool;
+}
 
-unsigned ThreadPool::threadCount() const { return static_cast<unsigned>(threads_.size()); }
+void ThreadPool::postTasks(std::span<Task> tasks, Priority priority, const char* label) {
+    if (tasks.empty()) {
+        return;
+    }
+    markPosted(tasks, label);
+    updateQueueDepthHighWater(queuedTaskCount_.fetch_add(tasks.size()) + tasks.size());
+    if (goesToOwnQueue(priority)) {
+        workerQueues_[threadIndex_]->push(tasks);
+    } else {
+        sharedQueue(priority).post(tasks);
+    }
+    notifyTasksPosted(tasks.size());
+    growIfBacklogged();
+}
+
+unsigned ThreadPool::threadCount() const { return activeThreadCount_.load(std::memory_order_relaxed); }
+
+// Mailboxes are complete before the first worker starts, unlike threads_, so workers can use this while the pool is
+// still being constructed
+unsigned ThreadPool::maxThreadCount() const { return static_cast<unsigned>(mailboxes_.size()); }
+
+unsigned ThreadPool::participantCount() const { return maxThreadCount() + 1; }
+
+void ThreadPool::setThreadCount(unsigned count) { setThreadCountRange(count, count); }
+
+void ThreadPool::setThreadCountRange(unsigned minCount, unsigned maxCount) {
+    assert(minCount <= maxCount && maxCount <= maxThreadCount() && "Invalid thread count range.");
+    {
+        std::scoped_lock lock(sleepMtx_);
+        minActiveThreadCount_.store(minCount);
+        maxActiveThreadCount_.store(maxCount);
+        activeThreadCount_.store(std::clamp(activeThreadCount_.load(), minCount, maxCount));
+    }
+    notifyThreadCountChanged();
+}
+
+unsigned ThreadPool::idleThreadCount() const {
+    return spinningThreadCount_.load(std::memory_order_relaxed) + sleepingThreadCount_.load(std::memory_order_relaxed);
+}
+
+unsigned ThreadPool::sleepingThreadCount() const { return sleepingThreadCount_.load(std::memory_order_relaxed); }
+
+ThreadPool::Scheduling ThreadPool::scheduling() const { return scheduling_; }
 
 ThreadPool::ThreadIndex ThreadPool::threadIndex() {
     assert(threadIndex_ != ThreadPool::invalidIndex && "This thread is not part of a thread pool.");
     return threadIndex_;
 }
 
+std::optional<LogicalCpu> ThreadPool::workerCpu(ThreadIndex workerIndex) const {
+    assert(workerIndex >= 0 && static_cast<unsigned>(workerIndex) < maxThreadCount() && "Invalid worker index.");
+    return workerCpus_[workerIndex];
+}
+
+PoolMetrics ThreadPool::metrics() const {
+    PoolMetrics metrics;
+    metrics.queuedTaskCount = queuedTaskCount_.load(std::memory_order_relaxed);
+#if CG_TASK_METRICS
+    metrics.queueDepthHighWater = queueDepthHighWater_.load(std::memory_order_relaxed);
+    int64_t now = detail::metricsNow();
+    metrics.workers.reserve(participantCount());
+    for (unsigned i = 0; i < participantCount(); ++i) {
+        metrics.workers.push_back(workerCounters_[i].snapshot(now));
+    }
+#endif
+    return metrics;
+}
+
+void ThreadPool::resetQueueDepthHighWater() {
+    queueDepthHighWater_.store(queuedTaskCount_.load(std::memory_order_relaxed), std::memory_order_relaxed);
+}
+
+void ThreadPool::runTasksUntil(const std::atomic<bool>& done) {
+    if (isOwnWorkerThread()) {
+        runTasksAsParticipant(threadIndex_, done);
+        return;
+    }
+
+    while (!done.load()) {
+        if (!externalSlotTaken_.exchange(true)) {
+            // Tasks run on this thread need a valid index, so borrow the external slot for the duration of the wait
+            ThreadIndex prevIndex = threadIndex_;
+            const ThreadPool* prevOutsideSlotPool = outsideSlotPool_;
+            setThreadIndex(static_cast<ThreadIndex>(maxThreadCount()));
+            outsideSlotPool_ = this;
+            runTasksAsParticipant(threadIndex_, done);
+            outsideSlotPool_ = prevOutsideSlotPool;
+            setThreadIndex(prevIndex);
+            {
+                std::scoped_lock lock(sleepMtx_);
+                externalSlotTaken_.store(false);
+            }
+            // Let an external waiter take over the slot, the workers may not be able to finish its graph alone
+            doneCond_.notify_all();
+            return;
+        }
+
+        // Another external thread is participating, wait until the graph finishes or the slot is released
+        std::unique_lock lock(sleepMtx_);
+        doneCond_.wait(lock, [this, &done]() {
+            return done.load() || !externalSlotTaken_.load();
+        });
+    }
+}
+
+void ThreadPool::notifyDone(std::atomic<bool>& done) {
+    {
+        std::scoped_lock lock(sleepMtx_);
+        done.store(true);
+    }
+    // `done` may already be gone at this point, only the pool is safe to touch
+    participantCond_.notify_all();
+    doneCond_.notify_all();
+}
+
+void ThreadPool::runTasksAsParticipant(ThreadIndex threadIndex, const std::atomic<bool>& done) {
+    while (!done.load()) {
+        auto optTask = findTask(threadIndex);
+        if (optTask.has_value()) {
+            runTask(*optTask, threadIndex);
+            continue;
+        }
+        auto canContinue = [this, &done, threadIndex]() {
+            return done.load() || hasTasksFor(threadIndex);
+        };
+        if (spinUntil(canContinue)) {
+            continue;
+        }
+        std::unique_lock lock(sleepMtx_);
+        sleepingThreadCount_.fetch_add(1);
+        spinningThreadCount_.fetch_sub(1);
+        sleepingParticipantCount_.fetch_add(1);
+        participantCond_.wait(lock, canContinue);
+        sleepingParticipantCount_.fetch_sub(1);
+        sleepingThreadCount_.fetch_sub(1);
+    }
+}
+
+void ThreadPool::pushTask(Task&& task, Priority priority, const char* label) {
+    markPosted(std::span(&task, 1), label);
+    // Count the task before it's visible in any queue, so a worker that is about to sleep can't miss it
+    updateQueueDepthHighWater(queuedTaskCount_.fetch_add(1) + 1);
+    if (goesToOwnQueue(priority)) {
+        workerQueues_[threadIndex_]->push(std::move(task));
+    } else {
+        sharedQueue(priority).post(std::move(task));
+    }
+    notifyTasksPosted(1);
+    growIfBacklogged();
+}
+
+void ThreadPool::pushTaskToWorker(ThreadIndex workerIndex, Task&& task) {
+    assert(workerIndex >= 0 && static_cast<unsigned>(workerIndex) < maxThreadCount() && "Invalid worker index.");
+    markPosted(std::span(&task, 1), nullptr);
+    Mailbox& mailbox = *mailboxes_[workerIndex];
+    mailbox.taskCount.fetch_add(1);
+    mailbox.tasks.post(std::move(task));
+    {
+        std::scoped_lock lock(sleepMtx_);
+    }
+    // There's no way to wake a specific thread, so wake them all. Mailbox tasks are rare enough for this not to matter.
+    // Parked workers wake up for their mailbox too, and park again afterwards.
+    wakeUpCond_.notify_all();
+    participantCond_.notify_all();
+    parkCond_.notify_all();
+}
+
+void ThreadPool::markPosted([[maybe_unused]] std::span<Task> tasks, [[maybe_unused]] const char* label) {
+#if CG_TASK_TRACING || CG_TASK_METRICS
+    // Both use steady_clock nanoseconds, so trace and metrics timestamps are interchangeable
+    int64_t now = detail::metricsNow();
+    for (Task& task : tasks) {
+        task.postTime_ = now;
+#if CG_TASK_TRACING
+        if (label != nullptr) {
+            task.label_ = label;
+        }
+#endif
+    }
+#endif
+}
+
+void ThreadPool::runTask(Task& task, [[maybe_unused]] ThreadIndex threadIndex) {
+#if CG_TASK_METRICS
+    int64_t postTime = task.postTime_;
+    int64_t beginTime = detail::metricsNow();
+#endif
+    {
+#if CG_TASK_TRACING
+        TraceScope scope(task.label_, threadIndex, task.postTime_);
+#endif
+        task();
+    }
+#if CG_TASK_METRICS
+    workerCounters_[threadIndex].recordTask(postTime, beginTime, detail::metricsNow());
+#endif
+}
+
+void ThreadPool::updateQueueDepthHighWater([[maybe_unused]] size_t queueDepth) {
+#if CG_TASK_METRICS
+    size_t highWater = queueDepthHighWater_.load(std::memory_order_relaxed);
+    while (queueDepth > highWater &&
+           !queueDepthHighWater_.compare_exchange_weak(highWater, queueDepth, std::memory_order_relaxed)) {
+    }
+#endif
+}
+
+bool ThreadPool::hasTasksFor(ThreadIndex threadIndex) const {
+    if (queuedTaskCount_.load() > 0) {
+        return true;
+    }
+    return static_cast<unsigned>(threadIndex) < mailboxes_.size() && mailboxes_[threadIndex]->taskCount.load() > 0;
+}
+
+MessageQueue<Task>& ThreadPool::sharedQueue(Priority priority) { return taskQueues_[static_cast<size_t>(priority)]; }
+
+bool ThreadPool::goesToOwnQueue(Priority priority) const {
+    // Worker deques only hold normal priority tasks. High priority ones go to the shared queue, so any thread can pick
+    // them up first, and background ones shouldn't get ahead of normal work just because they were posted locally.
+    return priority == Priority::Normal && scheduling_ == Scheduling::WorkStealing && isOwnWorkerThread();
+}
+
+void ThreadPool::notifyTasksPosted(size_t taskCount) {
+    if (sleepingThreadCount_.load() == 0) {
+        return;
+    }
+    size_t sleepingWorkers = 0;
+    size_t sleepingParticipants = 0;
+    {
+        // Sleeping threads check their wake up condition under this lock, so taking it here guarantees they are
+        // either already waiting on a condition variable or will see the new tasks.
+        std::scoped_lock lock(sleepMtx_);
+        sleepingParticipants = sleepingParticipantCount_.load();
+        sleepingWorkers = sleepingThreadCount_.load() - sleepingParticipants;
+    }
+    // A woken thread that finds no task just goes back to sleep, so there's no point in waking more than one per task.
+    // Workers go first, participants only get the tasks left over.
+    size_t workerWakeUps = std::min(taskCount, sleepingWorkers);
+    notifyWakeUps(wakeUpCond_, workerWakeUps, sleepingWorkers);
+    notifyWakeUps(participantCond_, taskCount - workerWakeUps, sleepingParticipants);
+}
+
+void ThreadPool::notifyWakeUps(std::condition_variable& cond, size_t wakeUpCount, size_t sleepingCount) {
+    if (wakeUpCount == 0) {
+        return;
+    }
+    if (wakeUpCount >= sleepingCount) {
+        cond.notify_all();
+    } else {
+        for (size_t i = 0; i < wakeUpCount; ++i) {
+            cond.notify_one();
+        }
+    }
+}
+
+void ThreadPool::growIfBacklogged() {
+    unsigned active = activeThreadCount_.load(std::memory_order_relaxed);
+    if (active >= maxActiveThreadCount_.load(std::memory_order_relaxed)) {
+        return;
+    }
+    // Only when every active thread is busy and each has a few tasks waiting. A backlog that sleeping threads could
+    // take isn't a reason for more workers.
+    if (sleepingThreadCount_.load() > 0 || queuedTaskCount_.load() <= 2 * static_cast<size_t>(active)) {
+        return;
+    }
+    if (activeThreadCount_.compare_exchange_strong(active, active + 1)) {
+        notifyThreadCountChanged();
+    }
+}
+
+void ThreadPool::shrinkAfterIdle() {
+    unsigned active = activeThreadCount_.load();
+    while (active > minActiveThreadCount_.load()) {
+        if (activeThreadCount_.compare_exchange_weak(active, active - 1)) {
+            notifyThreadCountChanged();
+            return;
+        }
+    }
+}
+
+void ThreadPool::notifyThreadCountChanged() {
+    {
+        std::scoped_lock lock(sleepMtx_);
+    }
+    parkCond_.notify_all();
+    // Workers that were just parked may be sleeping on wakeUpCond_, where they would take a notify_one meant for others
+    wakeUpCond_.notify_all();
+}
+
+bool ThreadPool::isParked(ThreadIndex threadIndex) const {
+    return static_cast<unsigned>(threadIndex) < maxThreadCount() &&
+           static_cast<unsigned>(threadIndex) >= activeThreadCount_.load();
+}
+
+std::optional<Task> ThreadPool::findTask(ThreadIndex threadIndex) {
+    // Only workers have their own queue, the external participant can just take from the shared queue and steal
+    unsigned workerCount = static_cast<unsigned>(workerQueues_.size());
+    bool hasOwnQueue = threadIndex >= 0 && static_cast<unsigned>(threadIndex) < workerCount;
+
+    std::optional<Task> task = takeMailboxTask(threadIndex);
+    if (task.has_value()) {
+        return task;
+    }
+
+    if (++findTaskCount_ % starvationInterval == 0) {
+        // Give lower priorities a turn, so they make progress even when higher priority work keeps coming
+        task = sharedQueue(Priority::Background).tryTake();
+        if (!task.has_value()) {
+            std::optional<Task> normalTask = takeNormalTask(threadIndex);
+            if (normalTask.has_value()) {
+                return normalTask;
+            }
+        }
+    }
+    if (!task.has_value()) {
+        task = sharedQueue(Priority::High).tryTake();
+    }
+    if (!task.has_value() && hasOwnQueue) {
+        task = workerQueues_[threadIndex]->pop();
+    }
+    if (!task.has_value()) {
+        // Already uncounted from queuedTaskCount_
+        std::optional<Task> normalTask = takeNormalTask(threadIndex);
+        if (normalTask.has_value()) {
+            return normalTask;
+        }
+    }
+    for (unsigned i = 1; i <= workerCount && !task.has_value(); ++i) {
+        unsigned victim = (threadIndex + i) % workerCount;
+        if (!hasOwnQueue || victim != static_cast<unsigned>(threadIndex)) {
+            task = workerQueues_[victim]->steal();
+        }
+    }
+    if (!task.has_value()) {
+        std::optional<Task> batchedTask = stealBatchedTask(threadIndex);
+        if (batchedTask.has_value()) {
+            return batchedTask;
+        }
+    }
+    if (!task.has_value()) {
+        task = sharedQueue(Priority::Background).tryTake();
+    }
+    if (task.has_value()) {
+        queuedTaskCount_.fetch_sub(1);
+    }
+    return task;
+}
+
+std::optional<Task> ThreadPool::findOwnTask(ThreadIndex threadIndex) {
+    std::optional<Task> task = takeMailboxTask(threadIndex);
+    if (!task.has_value()) {
+        task = takeBatchedTask(threadIndex);
+    }
+    if (!task.has_value() && static_cast<unsigned>(threadIndex) < workerQueues_.size()) {
+        task = workerQueues_[threadIndex]->pop();
+        if (task.has_value()) {
+            queuedTaskCount_.fetch_sub(1);
+        }
+    }
+    return task;
+}
+
+std::optional<Task> ThreadPool::takeMailboxTask(ThreadIndex threadIndex) {
+    if (static_cast<unsigned>(threadIndex) >= mailboxes_.size()) {
+        return std::nullopt;
+    }
+    Mailbox& mailbox = *mailboxes_[threadIndex];
+    if (mailbox.taskCount.load() == 0) {
+        return std::nullopt;
+    }
+    std::optional<Task> task = mailbox.tasks.tryTake();
+    if (task.has_value()) {
+        mailbox.taskCount.fetch_sub(1);
+    }
+    return task;
+}
+
+std::optional<Task> ThreadPool::takeNormalTask(ThreadIndex threadIndex) {
+    // Tasks of an earlier batch come first, they were posted before anything still in the queue
+    std::optional<Task> task = takeBatchedTask(threadIndex);
+    if (task.has_value()) {
+        return task;
+    }
+
+    MessageQueue<Task>& queue = sharedQueue(Priority::Normal);
+    // Only worth it once the queue is long, otherwise one thread would take tasks other idle threads could run
+    size_t batchSize =
+        std::min<size_t>(maxTaskBatch_, queuedTaskCount_.load(std::memory_order_relaxed) / (2 * (threadCount() + 1)));
+    if (static_cast<unsigned>(threadIndex) >= takenTasks_.size() || batchSize <= 1) {
+        task = queue.tryTake();
+        if (task.has_value()) {
+            queuedTaskCount_.fetch_sub(1);
+        }
+        return task;
+    }
+    TakenTasks& taken = *takenTasks_[threadIndex];
+    std::scoped_lock lock(taken.mtx);
+    size_t count = queue.tryTakeMany(std::span(taken.tasks).first(batchSize));
+    if (count == 0) {
+        return std::nullopt;
+    }
+    // Only the task run now is uncounted, the rest waits for this worker or a thread that steals it
+    queuedTaskCount_.fetch_sub(1);
+    taken.next = 1;
+    taken.end = count;
+    taken.taskCount.store(count - 1);
+    return std::move(taken.tasks[0]);
+}
+
+std::optional<Task> ThreadPool::takeBatchedTask(ThreadIndex batchOwner) {
+    if (static_cast<unsigned>(batchOwner) >= takenTasks_.size()) {
+        return std::nullopt;
+    }
+    TakenTasks& taken = *takenTasks_[batchOwner];
+    if (taken.taskCount.load() == 0) {
+        return std::nullopt;
+    }
+    std::scoped_lock lock(taken.mtx);
+    if (taken.next == taken.end) {
+        return std::nullopt;
+    }
+    taken.taskCount.fetch_sub(1);
+    queuedTaskCount_.fetch_sub(1);
+    return std::move(taken.tasks[taken.next++]);
+}
+
+std::optional<Task> ThreadPool::stealBatchedTask(ThreadIndex threadIndex) {
+    // Only reached once the normal queue is empty, so a task of a batch would otherwise wait for its worker
+    unsigned batchCount = static_cast<unsigned>(takenTasks_.size());
+    for (unsigned i = 1; i <= batchCount; ++i) {
+        unsigned victim = (threadIndex + i) % batchCount;
+        if (victim != static_cast<unsigned>(threadIndex)) {
+            std::optional<Task> task = takeBatchedTask(static_cast<ThreadIndex>(victim));
+            if (task.has_value()) {
+                return task;
+            }
+        }
+    }
+    return std::nullopt;
+}
+
+template <typename Condition>
+bool ThreadPool::spinUntil(const Condition& condition) {
+    // Counted as idle while spinning, so work that gets split up for idle threads, like parallelFor chunks, is split
+    // for this one too and it doesn't have to go to sleep first
+    spinningThreadCount_.fetch_add(1);
+    for (unsigned i = 0; i < idlePolicy_.spinCount; ++i) {
+        if (condition()) {
+            spinningThreadCount_.fetch_sub(1);
+            return true;
+        }
+        cpuRelax();
+    }
+    for (unsigned i = 0; i < idlePolicy_.yieldCount; ++i) {
+        if (condition()) {
+            spinningThreadCount_.fetch_sub(1);
+            return true;
+        }
+        std::this_thread::yield();
+    }
+    // Still counted until the caller counts itself as sleeping, so the thread never drops out of the idle count
+    return false;
+}
+
+void ThreadPool::waitForTasks(const std::stop_token& stopToken) {
+    auto canContinue = [this, &stopToken]() {
+        return hasTasksFor(threadIndex_) || stopToken.stop_requested() || isParked(threadIndex_);
+    };
+    if (spinUntil(canContinue)) {
+        return;
+    }
+    std::unique_lock lock(sleepMtx_);
+    sleepingThreadCount_.fetch_add(1);
+    spinningThreadCount_.fetch_sub(1);
+    bool timedOut = false;
+    if (minActiveThreadCount_.load() < maxActiveThreadCount_.load()) {
+        timedOut = !wakeUpCond_.wait_for(lock, shrinkDelay_, canContinue);
+    } else {
+        wakeUpCond_.wait(lock, canContinue);
+    }
+    sleepingThreadCount_.fetch_sub(1);
+    lock.unlock();
+    if (timedOut) {
+        // This thread stayed idle, so there are more workers than work. The worker with the highest index is parked,
+        // which may not be this one, but keeps the active workers at the lowest indices.
+        shrinkAfterIdle();
+    }
+}
+
+void ThreadPool::park(ThreadIndex threadIndex) {
+    // The wake up that brought this worker here may have been meant for a task, so pass it on to a thread that can take
+    // it
+    if (queuedTaskCount_.load() > 0) {
+        notifyTasksPosted(1);
+    }
+    std::unique_lock lock(sleepMtx_);
+    // No stop check, the destructor reaches parked workers through their mailboxes
+    parkCond_.wait(lock, [this, threadIndex]() {
+        return !isParked(threadIndex) || mailboxes_[threadIndex]->taskCount.load() > 0;
+    });
+}
+
+bool ThreadPool::isOwnWorkerThread() const { return currentPool_ == this; }
+
+bool ThreadPool::isCurrentParticipant() const {
+    return outsideSlotPool_ != nullptr ? outsideSlotPool_ == this : isOwnWorkerThread();
+}
+
 void ThreadPool::setThreadIndex(ThreadIndex index) { threadIndex_ = index; }
 
 void ThreadPool::threadTask(const std::stop_token& stopToken, int threadIndex) {
     setThreadIndex(threadIndex);
+    currentPool_ = this;
+#if CG_TASK_TRACING
+    TaskTrace::setThreadName((threadName_.empty() ? "worker" : threadName_) + "-" + std::to_string(threadIndex));
+#endif
 
     while (!stopToken.stop_requested()) {
-        Task task = taskQueue_.take();
-        task();
+        if (isParked(threadIndex)) {
+            // Work only this worker can run is finished first, so parking never strands a task
+            auto optTask = findOwnTask(threadIndex);
+            if (optTask.has_value()) {
+                runTask(*optTask, threadIndex);
+            } else {
+                park(threadIndex);
+            }
+            continue;
+        }
+        auto optTask = findTask(threadIndex);
+        if (optTask.has_value()) {
+            runTask(*optTask, threadIndex);
+        } else {
+            waitForTasks(stopToken);
+        }
     }
 
-    // Drain the queue
+    // Drain the queues
     while (true) {
-        auto optTask = taskQueue_.tryTake();
+        auto optTask = findTask(threadIndex);
         if (optTask.has_value()) {
-            optTask.value()();
+            runTask(*optTask, threadIndex);
         } else {
             break;
         }
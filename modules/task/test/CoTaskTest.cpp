@@ -0,0 +1,157 @@
+#include "task/CoTask.h"
+
+#include "gtest/gtest.h"
+
+#include <atomic>
+#include <stdexcept>
+#include <tuple>
+#include <vector>
+
+using namespace cg;
+
+namespace {
+CoTask<int> addOne(int value) { co_return value + 1; }
+
+CoTask<int> addTwo(int value) {
+    int first = co_await addOne(value);
+    co_return co_await addOne(first);
+}
+
+CoTask<> throwError() {
+    throw std::runtime_error("error");
+    co_return;
+}
+} // namespace
+
+TEST(CoTaskTest, startAndWait_shouldReturnResult) {
+    ThreadPool threadPool(2);
+
+    EXPECT_EQ(addOne(1).startAndWait(threadPool), 2);
+}
+
+TEST(CoTaskTest, awaitCoTask_shouldContinueWithResult) {
+    ThreadPool threadPool(2);
+
+    EXPECT_EQ(addTwo(1).startAndWait(threadPool), 3);
+}
+
+TEST(CoTaskTest, awaitCoTask_throws_shouldRethrowToAwaiting) {
+    ThreadPool threadPool(2);
+    auto catchError = []() -> CoTask<bool> {
+        try {
+            co_await throwError();
+        } catch (const std::runtime_error&) {
+            co_return true;
+        }
+        co_return false;
+    };
+
+    EXPECT_TRUE(catchError().startAndWait(threadPool));
+    EXPECT_THROW(throwError().startAndWait(threadPool), std::runtime_error);
+}
+
+TEST(CoTaskTest, awaitGraphs_shouldContinueAfterGraphsAreDone) {
+    ThreadPool threadPool(2);
+    auto pipeline = []() -> CoTask<std::vector<int>> {
+        std::vector<int> values(4, 0);
+        TaskBatch batch;
+        for (int i = 0; i < 4; ++i) {
+            batch.addWork([i, &values]() {
+                values[i] = i;
+            });
+        }
+        co_await std::move(batch);
+
+        TaskSequence sequence;
+        for (int i = 0; i < 4; ++i) {
+            sequence.addWork([&values]() {
+                values.push_back(static_cast<int>(values.size()));
+            });
+        }
+        co_await std::move(sequence);
+        co_return values;
+    };
+
+    EXPECT_EQ(pipeline().startAndWait(threadPool), std::vector<int>({0, 1, 2, 3, 4, 5, 6, 7}));
+}
+
+TEST(CoTaskTest, whenAll_coTasks_shouldReturnAllResults) {
+    ThreadPool threadPool(2);
+    auto sum = []() -> CoTask<int> {
+        auto [a, b, c] = co_await whenAll(addOne(1), addTwo(1), addOne(10));
+        co_return a + b + c;
+    };
+
+    EXPECT_EQ(sum().startAndWait(threadPool), 2 + 3 + 11);
+}
+
+TEST(CoTaskTest, whenAll_mixedGraphs_shouldWaitForAll) {
+    ThreadPool threadPool(2);
+    std::atomic<int> doneCount = 0;
+    auto run = [&doneCount]() -> CoTask<int> {
+        TaskBatch batch;
+        for (int i = 0; i < 8; ++i) {
+            batch.addWork([&doneCount]() {
+                ++doneCount;
+            });
+        }
+        auto count = [&doneCount]() -> CoTask<> {
+            ++doneCount;
+            co_return;
+        };
+        auto loop = parallelFor(IndexRange(0, 8), [&doneCount](IndexRange<int> range) {
+            doneCount += range.end - range.begin;
+        });
+        co_await whenAll(std::move(batch), count(), std::move(loop));
+        co_return doneCount.load();
+    };
+
+    EXPECT_EQ(run().startAndWait(threadPool), 17);
+}
+
+TEST(CoTaskTest, addToGraph_shouldRunAsPartOfGraph) {
+    ThreadPool threadPool(2);
+    int sum = 0;
+    auto add = [&sum](int value) -> CoTask<> {
+        sum += co_await addOne(value);
+    };
+    TaskSequence sequence;
+    sequence.addWork(add(1));
+    sequence.addWork(add(2));
+    sequence.addWork([&sum]() {
+        sum *= 10;
+    });
+
+    sequence.startAndWait(threadPool);
+
+    EXPECT_EQ(sum, 50);
+}
+
+TEST(CoTaskTest, start_shouldCallContinuationWhenDone) {
+    int result = 0;
+    {
+        ThreadPool threadPool(2);
+        auto store = [&result]() -> CoTask<> {
+            result = co_await addTwo(5);
+        };
+        store().start(threadPool, [&result]() {
+            result *= 2;
+        });
+    }
+
+    EXPECT_EQ(result, 14);
+}
+
+TEST(CoTaskTest, await_singleWorker_shouldNotBlockWorker) {
+    // Awaiting suspends instead of blocking, so nested awaits can't run out of workers
+    ThreadPool threadPool(1);
+    auto nested = [](auto& self, int depth) -> CoTask<int> {
+        if (depth == 0) {
+            co_return 0;
+        }
+        auto [a, b] = co_await whenAll(self(self, depth - 1), self(self, depth - 1));
+        co_return a + b + 1;
+    };
+
+    EXPECT_EQ(nested(nested, 4).startAndWait(threadPool), 15);
+}
@@ -0,0 +1,61 @@
+#include "task/CpuTopology.h"
+
+#include "gtest/gtest.h"
+
+#include <vector>
+
+using namespace cg;
+
+namespace {
+// Two nodes with two cores each, every core has two SMT siblings numbered like on Linux (siblings are id + 8)
+CpuTopology makeTwoNodeTopology() {
+    std::vector<LogicalCpu> cpus;
+    for (unsigned core = 0; core < 4; ++core) {
+        cpus.push_back({.id = core, .core = core, .node = core / 2});
+        cpus.push_back({.id = core + 8, .core = core, .node = core / 2});
+    }
+    return CpuTopology(std::move(cpus));
+}
+
+std::vector<unsigned> ids(const std::vector<LogicalCpu>& cpus) {
+    std::vector<unsigned> result;
+    for (const LogicalCpu& cpu : cpus) {
+        result.push_back(cpu.id);
+    }
+    return result;
+}
+} // namespace
+
+TEST(CpuTopologyTest, parseCpuList_shouldExpandRanges) {
+    EXPECT_EQ(CpuTopology::parseCpuList("0-3,8,10-11"), (std::vector<unsigned>{0, 1, 2, 3, 8, 10, 11}));
+    EXPECT_EQ(CpuTopology::parseCpuList("5"), (std::vector<unsigned>{5}));
+    EXPECT_TRUE(CpuTopology::parseCpuList("").empty());
+}
+
+TEST(CpuTopologyTest, counts_shouldReturnExpected) {
+    CpuTopology topology = makeTwoNodeTopology();
+
+    EXPECT_EQ(topology.logicalCpus().size(), 8);
+    EXPECT_EQ(topology.physicalCoreCount(), 4);
+    EXPECT_EQ(topology.nodeCount(), 2);
+}
+
+TEST(CpuTopologyTest, pinningOrder_physicalCoresOnly_shouldSkipSiblings) {
+    CpuTopology topology = makeTwoNodeTopology();
+
+    EXPECT_EQ(ids(topology.pinningOrder(false)), (std::vector<unsigned>{0, 1, 2, 3}));
+}
+
+TEST(CpuTopologyTest, pinningOrder_withSiblings_shouldUseSiblingsAfterAllCores) {
+    CpuTopology topology = makeTwoNodeTopology();
+
+    EXPECT_EQ(ids(topology.pinningOrder(true)), (std::vector<unsigned>{0, 1, 2, 3, 8, 9, 10, 11}));
+}
+
+TEST(CpuTopologyTest, detect_shouldFindAtLeastOneCpu) {
+    CpuTopology topology = CpuTopology::detect();
+
+    EXPECT_FALSE(topology.logicalCpus().empty());
+    EXPECT_GE(topology.physicalCoreCount(), 1);
+    EXPECT_LE(topology.physicalCoreCount(), topology.logicalCpus().size());
+}
@@ -0,0 +1,112 @@
+#include "task/LockFreeMessageQueue.h"
+
+#include "gtest/gtest.h"
+
+#include <atomic>
+#include <chrono>
+#include <memory>
+#include <thread>
+#include <vector>
+
+using namespace cg;
+
+TEST(LockFreeMessageQueueTest, submitTakeSize_shouldReturnExpected) {
+    LockFreeMessageQueue<int> messageQueue;
+    constexpr int val = 10;
+
+    EXPECT_EQ(messageQueue.size(), 0);
+    messageQueue.post(val);
+    messageQueue.post(val + 1);
+    EXPECT_EQ(messageQueue.size(), 2);
+    int taken = messageQueue.take();
+    EXPECT_EQ(taken, val);
+    taken = messageQueue.take();
+    EXPECT_EQ(taken, val + 1);
+    EXPECT_EQ(messageQueue.size(), 0);
+}
+
+TEST(LockFreeMessageQueueTest, tryTake_emptyQueue_shouldReturnEmpty) {
+    LockFreeMessageQueue<int> messageQueue;
+    auto optMsg = messageQueue.tryTake();
+    EXPECT_FALSE(optMsg.has_value());
+}
+
+TEST(LockFreeMessageQueueTest, tryTake_hasMessage_shouldReturnMessage) {
+    LockFreeMessageQueue<int> messageQueue;
+    constexpr int val = 10;
+    messageQueue.post(val);
+    auto optMsg = messageQueue.tryTake();
+    ASSERT_TRUE(optMsg.has_value());
+    EXPECT_EQ(optMsg.value(), val);
+}
+
+TEST(LockFreeMessageQueueTest, capacity_shouldRoundUpToPowerOf2) {
+    LockFreeMessageQueue<int> messageQueue(5);
+    EXPECT_EQ(messageQueue.capacity(), 8);
+}
+
+TEST(LockFreeMessageQueueTest, tryPost_fullQueue_shouldFail) {
+    LockFreeMessageQueue<int> messageQueue(2);
+    EXPECT_TRUE(messageQueue.tryPost(1));
+    EXPECT_TRUE(messageQueue.tryPost(2));
+    EXPECT_FALSE(messageQueue.tryPost(3));
+    EXPECT_EQ(messageQueue.take(), 1);
+    EXPECT_TRUE(messageQueue.tryPost(3));
+    EXPECT_EQ(messageQueue.take(), 2);
+    EXPECT_EQ(messageQueue.take(), 3);
+}
+
+TEST(LockFreeMessageQueueTest, postVector_shouldPreserveOrder) {
+    LockFreeMessageQueue<std::unique_ptr<int>> messageQueue;
+    std::vector<std::unique_ptr<int>> msgs;
+    for (int i = 0; i < 3; ++i) {
+        msgs.push_back(std::make_unique<int>(i));
+    }
+    messageQueue.post(msgs);
+    for (int i = 0; i < 3; ++i) {
+        EXPECT_EQ(*messageQueue.take(), i);
+    }
+}
+
+TEST(LockFreeMessageQueueTest, take_messagePostedLater_shouldWakeUp) {
+    LockFreeMessageQueue<int> messageQueue;
+    constexpr int val = 10;
+    std::jthread producer([&messageQueue, val]() {
+        std::this_thread::sleep_for(std::chrono::milliseconds(10));
+        messageQueue.post(val);
+    });
+    EXPECT_EQ(messageQueue.take(), val);
+}
+
+TEST(LockFreeMessageQueueTest, stress_multipleProducersAndConsumers_allMessagesTakenOnce) {
+    constexpr int producerCount = 4;
+    constexpr int consumerCount = 4;
+    constexpr int msgsPerProducer = 20000;
+    constexpr int msgsPerConsumer = producerCount * msgsPerProducer / consumerCount;
+    // Small capacity, so producers regularly run into a full queue
+    LockFreeMessageQueue<int> messageQueue(64);
+
+    std::vector<std::atomic<int>> timesTaken(producerCount * msgsPerProducer);
+    {
+        std::vector<std::jthread> threads;
+        for (int p = 0; p < producerCount; ++p) {
+            threads.emplace_back([&messageQueue, p]() {
+                for (int i = 0; i < msgsPerProducer; ++i) {
+                    messageQueue.post(p * msgsPerProducer + i);
+                }
+            });
+        }
+        for (int c = 0; c < consumerCount; ++c) {
+            threads.emplace_back([&messageQueue, &timesTaken]() {
+                for (int i = 0; i < msgsPerConsumer; ++i) {
+                    ++timesTaken[messageQueue.take()];
+                }
+            });
+        }
+    }
+
+    EXPECT_EQ(messageQueue.size(), 0);
+    for (size_t i = 0; i < timesTaken.size(); ++i) {
+        ASSERT_EQ(timesTaken[i], 1) << "i: " << i;
+    }
+}
@@ -2,6 +2,8 @@
 
 #include "gtest/gtest.h"
 
+#include <array>
+
 using namespace cg;
 
 TEST(MessageQueueTest, submitTakeSize_shouldReturnExpected) {
@@ -33,3 +35,46 @@ TEST(MessageQueueTest, tryTake_hasMessage_shouldReturnMessage) {
     ASSERT_TRUE(optMsg.has_value());
     EXPECT_EQ(optMsg.value(), val);
 }
+
+TEST(MessageQueueTest, lifo_take_shouldReturnMostRecentFirst) {
+    MessageQueue<int> messageQueue(QueueOrder::Lifo);
+    messageQueue.post(1);
+    messageQueue.post(2);
+    messageQueue.post(3);
+
+    EXPECT_EQ(messageQueue.take(), 3);
+    EXPECT_EQ(messageQueue.tryTake(), 2);
+    EXPECT_EQ(messageQueue.take(), 1);
+}
+
+TEST(MessageQueueTest, takeUpTo_moreMessagesThanSpace_shouldFillOutputInOrder) {
+    MessageQueue<int> messageQueue;
+    for (int i = 0; i < 5; ++i) {
+        messageQueue.post(i);
+    }
+    std::array<int, 3> out{};
+
+    EXPECT_EQ(messageQueue.takeUpTo(out), 3);
+    EXPECT_EQ(out, (std::array<int, 3>{0, 1, 2}));
+    EXPECT_EQ(messageQueue.size(), 2);
+}
+
+TEST(MessageQueueTest, tryTakeMany_fewerMessagesThanSpace_shouldTakeAll) {
+    MessageQueue<int> messageQueue(QueueOrder::Lifo);
+    messageQueue.post(1);
+    messageQueue.post(2);
+    std::array<int, 4> out{};
+
+    EXPECT_EQ(messageQueue.tryTakeMany(out), 2);
+    EXPECT_EQ(out[0], 2);
+    EXPECT_EQ(out[1], 1);
+    EXPECT_EQ(messageQueue.size(), 0);
+}
+
+TEST(MessageQueueTest, tryTakeMany_emptyQueue_shouldTakeNothing) {
+    MessageQueue<int> messageQueue;
+    std::array<int, 4> out{};
+
+    EXPECT_EQ(messageQueue.tryTakeMany(out), 0);
+}
+
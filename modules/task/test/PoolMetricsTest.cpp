@@ -0,0 +1,50 @@
+#include "task/PoolMetrics.h"
+
+#include "gtest/gtest.h"
+
+#include <chrono>
+
+using namespace cg;
+using namespace std::chrono_literals;
+
+TEST(PoolMetricsTest, latencyBucketUpperBound_shouldDoubleEveryBucket) {
+    EXPECT_EQ(WorkerMetrics::latencyBucketUpperBound(0), 1us);
+    EXPECT_EQ(WorkerMetrics::latencyBucketUpperBound(1), 2us);
+    EXPECT_EQ(WorkerMetrics::latencyBucketUpperBound(10), 1024us);
+    EXPECT_EQ(WorkerMetrics::latencyBucketUpperBound(WorkerMetrics::latencyBucketCount - 1),
+              std::chrono::nanoseconds::max());
+}
+
+TEST(PoolMetricsTest, startLatencyQuantile_shouldReturnBoundOfBucketContainingQuantile) {
+    PoolMetrics metrics;
+    metrics.workers.resize(2);
+    metrics.workers[0].startLatency[0] = 50;
+    metrics.workers[1].startLatency[0] = 40;
+    metrics.workers[1].startLatency[5] = 10;
+
+    EXPECT_EQ(metrics.startLatencyQuantile(0.5), 1us);
+    EXPECT_EQ(metrics.startLatencyQuantile(0.9), 1us);
+    EXPECT_EQ(metrics.startLatencyQuantile(0.95), 32us);
+    EXPECT_EQ(metrics.startLatencyQuantile(1.0), 32us);
+}
+
+TEST(PoolMetricsTest, startLatencyQuantile_noTasks_shouldReturnZero) {
+    PoolMetrics metrics;
+    metrics.workers.resize(3);
+
+    EXPECT_EQ(metrics.startLatencyQuantile(0.99), 0ns);
+}
+
+TEST(PoolMetricsTest, busyRatio_shouldIgnoreOutsideParticipant) {
+    PoolMetrics metrics;
+    metrics.workers.resize(3);
+    metrics.workers[0].busyTime = 30ms;
+    metrics.workers[0].idleTime = 10ms;
+    metrics.workers[1].busyTime = 10ms;
+    metrics.workers[1].idleTime = 30ms;
+    metrics.workers[2].busyTime = 100ms;
+
+    EXPECT_DOUBLE_EQ(metrics.busyRatio(), 0.5);
+    EXPECT_DOUBLE_EQ(metrics.workers[0].busyRatio(), 0.75);
+    EXPECT_EQ(metrics.tasksExecuted(), 0u);
+}
@@ -0,0 +1,147 @@
+#include "task/RecordedGraph.h"
+
+#include "gtest/gtest.h"
+
+#include <atomic>
+#include <vector>
+
+using namespace cg;
+
+namespace {
+struct RunParams {
+    int multiplier;
+};
+} // namespace
+
+TEST(RecordedBatchTest, startAndWait_multipleRuns_allTasksShouldExecuteEachRun) {
+    constexpr int taskCount = 20;
+    constexpr int runCount = 5;
+    std::atomic<int> executed = 0;
+
+    RecordedBatch batch;
+    for (int i = 0; i < taskCount; ++i) {
+        batch.addWork([&executed]() {
+            ++executed;
+        });
+    }
+    ThreadPool threadPool(4);
+    for (int run = 1; run <= runCount; ++run) {
+        batch.startAndWait(threadPool, {});
+        EXPECT_EQ(executed, run * taskCount);
+    }
+}
+
+TEST(RecordedBatchTest, startAndWait_params_shouldBePassedToTasks) {
+    std::atomic<int> sum = 0;
+
+    RecordedBatch<RunParams> batch;
+    for (int i = 1; i <= 3; ++i) {
+        batch.addWork([&sum, i](const RunParams& params) {
+            sum += i * params.multiplier;
+        });
+    }
+    ThreadPool threadPool(2);
+    batch.startAndWait(threadPool, RunParams{1});
+    EXPECT_EQ(sum, 6);
+    batch.startAndWait(threadPool, RunParams{10});
+    EXPECT_EQ(sum, 66);
+}
+
+TEST(RecordedBatchTest, start_empty_shouldTriggerContinuation) {
+    RecordedBatch batch;
+    ThreadPool threadPool(2);
+    bool continuationCalled = false;
+    batch.start(threadPool, {}, [&continuationCalled]() {
+        continuationCalled = true;
+    });
+    EXPECT_TRUE(continuationCalled);
+}
+
+TEST(RecordedBatchTest, start_continuationRestartsGraph_shouldRunAgain) {
+    std::atomic<int> executed = 0;
+    RecordedBatch batch;
+    batch.addWork([&executed]() {
+        ++executed;
+    });
+
+    ThreadPool threadPool(2);
+    std::atomic<bool> done = false;
+    batch.start(threadPool, {}, [&]() {
+        batch.start(threadPool, {}, [&]() {
+            threadPool.notifyDone(done);
+        });
+    });
+    threadPool.runTasksUntil(done);
+    EXPECT_EQ(executed, 2);
+}
+
+TEST(RecordedSequenceTest, startAndWait_multipleRuns_shouldExecuteInOrderEachRun) {
+    constexpr int taskCount = 10;
+    std::vector<int> order;
+
+    RecordedSequence seq;
+    for (int i = 0; i < taskCount; ++i) {
+        seq.addWork([&order, i]() {
+            order.push_back(i);
+        });
+    }
+    ThreadPool threadPool(4);
+    for (int run = 0; run < 3; ++run) {
+        order.clear();
+        seq.startAndWait(threadPool, {});
+        ASSERT_EQ(order.size(), taskCount);
+        for (int i = 0; i < taskCount; ++i) {
+            EXPECT_EQ(order[i], i);
+        }
+    }
+}
+
+TEST(RecordedSequenceTest, startAndWait_nestedBatches_shouldFinishBatchBeforeNextStep) {
+    constexpr int batchSize = 10;
+    std::atomic<int> batchExecuted = 0;
+    std::vector<int> seenAfterBatch;
+
+    RecordedSequence<RunParams> seq;
+    RecordedBatch<RunParams> batch;
+    for (int i = 0; i < batchSize; ++i) {
+        batch.addWork([&batchExecuted](const RunParams& params) {
+            batchExecuted += params.multiplier;
+        });
+    }
+    seq.addWork(std::move(batch));
+    seq.addWork([&batchExecuted, &seenAfterBatch]() {
+        seenAfterBatch.push_back(batchExecuted);
+    });
+
+    ThreadPool threadPool(4);
+    seq.startAndWait(threadPool, RunParams{1});
+    seq.startAndWait(threadPool, RunParams{2});
+
+    ASSERT_EQ(seenAfterBatch.size(), 2);
+    EXPECT_EQ(seenAfterBatch[0], batchSize);
+    EXPECT_EQ(seenAfterBatch[1], 3 * batchSize);
+}
+
+TEST(RecordedSequenceTest, addDynamicWork_shouldRegenerateEachRun) {
+    std::atomic<int> generated = 0;
+    std::atomic<int> executed = 0;
+
+    RecordedSequence<RunParams> seq;
+    seq.addDynamicWork([&generated, &executed](const RunParams& params) {
+        ++generated;
+        TaskBatch batch;
+        for (int i = 0; i < params.multiplier; ++i) {
+            batch.addWork([&executed]() {
+                ++executed;
+            });
+        }
+        return batch;
+    });
+
+    ThreadPool threadPool(4);
+    seq.startAndWait(threadPool, RunParams{2});
+    seq.startAndWait(threadPool, RunParams{5});
+
+    EXPECT_EQ(generated, 2);
+    EXPECT_EQ(executed, 7);
+}
@@ -0,0 +1,105 @@
+#include "task/TaskArena.h"
+
+#include "gtest/gtest.h"
+
+#include <algorithm>
+#include <cstdint>
+#include <memory_resource>
+#include <thread>
+#include <vector>
+
+using namespace cg;
+
+TEST(TaskArenaTest, allocate_shouldReturnAlignedNonOverlappingMemory) {
+    TaskArena arena(256);
+    void* first = arena.allocate(10, 1);
+    void* second = arena.allocate(8, 64);
+
+    EXPECT_EQ(reinterpret_cast<uintptr_t>(second) % 64, 0);
+    EXPECT_GE(static_cast<std::byte*>(second), static_cast<std::byte*>(first) + 10);
+    arena.deallocate(first, 10, 1);
+    arena.deallocate(second, 8, 64);
+}
+
+TEST(TaskArenaTest, allocate_largerThanChunk_shouldAllocateBigEnoughChunk) {
+    TaskArena arena(64);
+    void* ptr = arena.allocate(1000, 8);
+
+    EXPECT_NE(ptr, nullptr);
+    EXPECT_GE(arena.capacity(), 1000);
+    arena.deallocate(ptr, 1000, 8);
+}
+
+TEST(TaskArenaTest, reset_sameAllocationsAfterReset_shouldNotAllocateChunks) {
+    TaskArena arena(128);
+    auto allocateFrame = [&arena]() {
+        std::pmr::vector<int> values(&arena);
+        for (int i = 0; i < 100; ++i) {
+            values.push_back(i);
+        }
+    };
+
+    allocateFrame();
+    size_t chunksAfterFirstFrame = arena.chunkAllocationCount();
+    EXPECT_GT(chunksAfterFirstFrame, 0);
+    for (int frame = 0; frame < 3; ++frame) {
+        arena.reset();
+        allocateFrame();
+    }
+    EXPECT_EQ(arena.chunkAllocationCount(), chunksAfterFirstFrame);
+}
+
+TEST(TaskArenaTest, reset_shouldReuseMemory) {
+    TaskArena arena;
+    void* first = arena.allocate(16, 8);
+    arena.deallocate(first, 16, 8);
+    arena.reset();
+    void* second = arena.allocate(16, 8);
+
+    EXPECT_EQ(first, second);
+    EXPECT_EQ(arena.bytesAllocated(), 16);
+    arena.deallocate(second, 16, 8);
+}
+
+TEST(TaskArenaTest, allocate_fromSeveralThreads_shouldReturnNonOverlappingMemory) {
+    TaskArena arena(256);
+    constexpr int threadCount = 4;
+    constexpr int allocationCount = 200;
+    constexpr size_t allocationSize = 24;
+    std::vector<std::vector<std::byte*>> allocations(threadCount);
+    {
+        std::vector<std::jthread> threads;
+        for (int t = 0; t < threadCount; ++t) {
+            threads.emplace_back([&arena, &allocations, t]() {
+                for (int i = 0; i < allocationCount; ++i) {
+                    allocations[t].push_back(static_cast<std::byte*>(arena.allocate(allocationSize, 8)));
+                }
+            });
+        }
+    }
+
+    std::vector<std::byte*> all;
+    for (const auto& threadAllocations : allocations) {
+        all.insert(all.end(), threadAllocations.begin(), threadAllocations.end());
+    }
+    std::ranges::sort(all);
+    for (size_t i = 1; i < all.size(); ++i) {
+        EXPECT_GE(all[i], all[i - 1] + allocationSize);
+    }
+    EXPECT_EQ(arena.bytesAllocated(), threadCount * allocationCount * allocationSize);
+    for (std::byte* ptr : all) {
+        arena.deallocate(ptr, allocationSize, 8);
+    }
+}
+
+#ifndef NDEBUG
+TEST(TaskArenaTest, reset_allocationStillInUse_shouldTriggerAssert) {
+    ASSERT_DEATH(
+        {
+            TaskArena arena;
+            [[maybe_unused]] void* ptr = arena.allocate(16, 8);
+            arena.reset();
+        },
+        ".*");
+}
+#endif
@@ -1,8 +1,17 @@
 #include "task/TaskGraph.h"
+#include "task/TaskArena.h"
 
 #include "gtest/gtest.h"
 
+#include <algorithm>
 #include <array>
+#include <atomic>
+#include <chrono>
+#include <latch>
+#include <mutex>
+#include <set>
+#include <stop_token>
+#include <thread>
 #include <vector>
 
 using namespace cg;
@@ -335,3 +344,611 @@ TEST(TaskSequenceTest, addDynamicWork_generateSubGraph_allShouldExecuteBeforeWai
     mainSeq.startAndWait(threadPool);
     EXPECT_EQ(results, std::vector<int>({1, 2, 3, 4, 5, 6}));
 }
+
+TEST(TaskBatchTest, workStealingPool_sequenceSubGraphs_allShouldExecuteBeforeWaitEnds) {
+    constexpr int batchCount = 3;
+    std::vector<std::vector<int>> results(batchCount);
+    constexpr std::array<int, batchCount> taskCount = {2, 4, 3};
+
+    TaskBatch batch;
+
+    for (int i = 0; i < results.size(); ++i) {
+        results[i].resize(taskCount[i], 0);
+        TaskSequence subSequence;
+        for (int j = 0; j < results[i].size(); ++j) {
+            subSequence.addWork([&results, i, j]() {
+                results[i][j] = i + j + 1;
+            });
+        }
+        batch.addWork(std::move(subSequence));
+    }
+    ThreadPool threadPool(4, ThreadPool::Scheduling::WorkStealing);
+    batch.startAndWait(threadPool);
+
+    EXPECT_EQ(results[0], std::vector<int>({1, 2}));
+    EXPECT_EQ(results[1], std::vector<int>({2, 3, 4, 5}));
+    EXPECT_EQ(results[2], std::vector<int>({3, 4, 5}));
+}
+
+TEST(TaskSequenceTest, workStealingPool_batchSubGraphs_allShouldExecuteBeforeWaitEnds) {
+    TaskSequence seq;
+
+    std::vector<int> results;
+    constexpr int taskCount = 3;
+    results.resize(2 * taskCount, 0);
+    std::vector<int> expected = {1, 2, 3, 0, 0, 0};
+
+    TaskBatch subBatch1;
+    for (int i = 0; i < taskCount; ++i) {
+        subBatch1.addWork([i, &results]() {
+            results[i] = i + 1;
+        });
+    }
+    seq.addWork(std::move(subBatch1));
+
+    seq.addWork([&results, &expected]() {
+        EXPECT_EQ(results, expected);
+    });
+
+    TaskBatch subBatch2;
+    for (int i = 0; i < taskCount; ++i) {
+        subBatch2.addWork([index = taskCount + i, &results]() {
+            results[index] = index + 1;
+        });
+    }
+    seq.addWork(std::move(subBatch2));
+
+    ThreadPool threadPool(4, ThreadPool::Scheduling::WorkStealing);
+    seq.startAndWait(threadPool);
+
+    EXPECT_EQ(results, std::vector<int>({1, 2, 3, 4, 5, 6}));
+}
+
+TEST(TaskBatchTest, startAndWait_noWorkers_callerShouldRunAllTasks) {
+    TaskBatch batch;
+
+    std::vector<int> results;
+    constexpr int taskCount = 3;
+    results.resize(taskCount, 0);
+    ThreadPool threadPool(0);
+    for (int i = 0; i < taskCount; ++i) {
+        batch.addWork([i, &results, &threadPool]() {
+            EXPECT_EQ(ThreadPool::threadIndex(), threadPool.threadCount());
+            results[i] = i + 1;
+        });
+    }
+    batch.startAndWait(threadPool);
+    EXPECT_EQ(results, std::vector<int>({1, 2, 3}));
+}
+
+TEST(TaskBatchTest, startAndWait_twoOutsideThreadsNoWorkers_bothShouldFinish) {
+    ThreadPool threadPool(0);
+    std::latch firstStarted(1);
+    std::atomic<int> firstRuns = 0;
+    std::atomic<int> secondRuns = 0;
+
+    std::jthread first([&]() {
+        TaskBatch batch;
+        batch.addWork([&]() {
+            firstStarted.count_down();
+            // Keep the outside slot busy so the second thread has to wait for it
+            std::this_thread::sleep_for(std::chrono::milliseconds(20));
+            ++firstRuns;
+        });
+        batch.startAndWait(threadPool);
+    });
+    std::jthread second([&]() {
+        firstStarted.wait();
+        TaskBatch batch;
+        batch.addWork([&]() {
+            ++secondRuns;
+        });
+        // Nobody else runs these tasks, so this thread has to take over the slot once the first thread releases it
+        batch.startAndWait(threadPool);
+    });
+    first.join();
+    second.join();
+
+    EXPECT_EQ(firstRuns, 1);
+    EXPECT_EQ(secondRuns, 1);
+}
+
+TEST(TaskBatchTest, startAndWait_calledFromPoolTask_shouldNotDeadlock) {
+    std::vector<int> results;
+    constexpr int taskCount = 3;
+    results.resize(taskCount, 0);
+    ThreadPool threadPool(1);
+
+    TaskBatch outerBatch;
+    outerBatch.addWork([&results, &threadPool]() {
+        TaskBatch innerBatch;
+        for (int i = 0; i < taskCount; ++i) {
+            innerBatch.addWork([i, &results]() {
+                results[i] = i + 1;
+            });
+        }
+        // The only worker is busy running this task, so it has to run the inner tasks itself
+        innerBatch.startAndWait(threadPool);
+        EXPECT_EQ(results, std::vector<int>({1, 2, 3}));
+    });
+    outerBatch.startAndWait(threadPool);
+
+    EXPECT_EQ(results, std::vector<int>({1, 2, 3}));
+}
+
+TEST(TaskSequenceTest, startAndWait_calledFromPoolTask_shouldNotDeadlock) {
+    std::vector<int> results;
+    constexpr int taskCount = 3;
+    results.resize(taskCount, 0);
+    std::vector<std::vector<int>> expected = {{0, 0, 0}, {1, 0, 0}, {1, 2, 0}};
+    ThreadPool threadPool(1);
+
+    std::latch outerDone(1);
+    threadPool.postTask([&]() {
+        TaskSequence innerSeq;
+        for (int i = 0; i < taskCount; ++i) {
+            innerSeq.addWork([i, &results, &expected]() {
+                EXPECT_EQ(results, expected[i]);
+                results[i] = i + 1;
+            });
+        }
+        innerSeq.startAndWait(threadPool);
+        outerDone.count_down();
+    });
+    outerDone.wait();
+
+    EXPECT_EQ(results, std::vector<int>({1, 2, 3}));
+}
+
+TEST(ParallelForTest, startAndWait_shouldVisitEveryIndexOnce) {
+    constexpr int indexCount = 10000;
+    std::vector<std::atomic<int>> visits(indexCount);
+
+    auto loop = parallelFor(IndexRange(0, indexCount), [&visits](IndexRange<int> range) {
+        for (int i = range.begin; i < range.end; ++i) {
+            ++visits[i];
+        }
+    });
+    ThreadPool threadPool(4);
+    loop.startAndWait(threadPool);
+
+    for (int i = 0; i < indexCount; ++i) {
+        ASSERT_EQ(visits[i], 1) << "i: " << i;
+    }
+}
+
+TEST(ParallelForTest, emptyRange_shouldTriggerContinuation) {
+    bool bodyCalled = false;
+    auto loop = parallelFor(IndexRange(5, 5), [&bodyCalled](IndexRange<int>) {
+        bodyCalled = true;
+    });
+    ThreadPool threadPool(2);
+    loop.startAndWait(threadPool);
+    EXPECT_FALSE(bodyCalled);
+}
+
+TEST(ParallelForTest, minGrainSize_shouldNotRunSmallerSteps) {
+    constexpr size_t indexCount = 1000;
+    constexpr size_t minGrainSize = 100;
+    std::atomic<size_t> smallestStep = indexCount;
+
+    auto loop = parallelFor(IndexRange<size_t>(0, indexCount), [&smallestStep](IndexRange<size_t> range) {
+        size_t prev = smallestStep.load();
+        while (range.size() < prev && !smallestStep.compare_exchange_weak(prev, range.size())) {
+        }
+    });
+    loop.setMinGrainSize(minGrainSize);
+    ThreadPool threadPool(4);
+    loop.startAndWait(threadPool);
+
+    EXPECT_GE(smallestStep, minGrainSize);
+}
+
+TEST(ParallelForTest, minGrainSize_shouldOnlyRunShorterStepForShorterRange) {
+    constexpr int minGrainSize = 64;
+    ThreadPool threadPool(4);
+    // Neither is a multiple of the grain size, so splits and the last step of a chunk have remainders to deal with
+    for (int indexCount : {10007, 37}) {
+        std::atomic<int> smallestStep = indexCount;
+        std::atomic<int> visited = 0;
+        auto loop = parallelFor(IndexRange(0, indexCount), [&smallestStep, &visited](IndexRange<int> range) {
+            int prev = smallestStep.load();
+            while (range.size() < prev && !smallestStep.compare_exchange_weak(prev, range.size())) {
+            }
+            visited += range.size();
+        });
+        loop.setMinGrainSize(minGrainSize);
+        // Short steps, so chunks take many of them and split often
+        loop.setTargetChunkDuration(std::chrono::nanoseconds(1));
+        loop.startAndWait(threadPool);
+
+        EXPECT_EQ(visited, indexCount);
+        EXPECT_GE(smallestStep, std::min(minGrainSize, indexCount)) << "indexCount: " << indexCount;
+    }
+}
+
+TEST(ParallelForTest, addedToSequence_shouldRunBetweenNeighbouringSteps) {
+    constexpr int indexCount = 1000;
+    std::vector<int> values(indexCount, 0);
+    int sum = 0;
+
+    TaskSequence seq;
+    seq.addWork(parallelFor(IndexRange(0, indexCount), [&values](IndexRange<int> range) {
+        for (int i = range.begin; i < range.end; ++i) {
+            values[i] = i;
+        }
+    }));
+    seq.addWork([&values, &sum]() {
+        for (int value : values) {
+            sum += value;
+        }
+    });
+    ThreadPool threadPool(4);
+    seq.startAndWait(threadPool);
+
+    EXPECT_EQ(sum, indexCount * (indexCount - 1) / 2);
+}
+
+TEST(ParallelForTest, afterSequenceStep_shouldSplitForSpinningWorkers) {
+    constexpr int workerCount = 3;
+    // Workers keep spinning for the whole test instead of going to sleep
+    ThreadPool threadPool(ThreadPool::Options{
+        .threadCount = workerCount, .idlePolicy = {.spinCount = 1'000'000, .yieldCount = 1'000'000}});
+    std::mutex mtx;
+    std::set<ThreadPool::ThreadIndex> loopThreads;
+    std::atomic<unsigned> maxSleepingThreads = 0;
+
+    TaskSequence seq;
+    TaskBatch batch;
+    for (int i = 0; i < workerCount; ++i) {
+        batch.addWork([]() {
+            std::this_thread::sleep_for(std::chrono::milliseconds(1));
+        });
+    }
+    seq.addWork(std::move(batch));
+    seq.addWork(parallelFor(IndexRange(0, 64), [&](IndexRange<int>) {
+        {
+            std::scoped_lock lock(mtx);
+            loopThreads.insert(ThreadPool::threadIndex());
+        }
+        unsigned sleeping = threadPool.sleepingThreadCount();
+        unsigned prev = maxSleepingThreads.load();
+        while (sleeping > prev && !maxSleepingThreads.compare_exchange_weak(prev, sleeping)) {
+        }
+        // Gives the other threads the CPU on machines with fewer cores than threads
+        std::this_thread::sleep_for(std::chrono::microseconds(200));
+    }));
+    seq.startAndWait(threadPool);
+
+    EXPECT_EQ(maxSleepingThreads, 0u);
+    EXPECT_GT(loopThreads.size(), 1u);
+}
+
+TEST(ParallelReduceTest, startAndWait_shouldReduceWholeRange) {
+    constexpr int64_t indexCount = 100000;
+    int64_t result = -1;
+
+    auto reduce = parallelReduce(
+        IndexRange<int64_t>(0, indexCount), int64_t(0),
+        [](IndexRange<int64_t> range, int64_t sum) {
+            for (int64_t i = range.begin; i < range.end; ++i) {
+                sum += i;
+            }
+            return sum;
+        },
+        [](int64_t left, int64_t right) { return left + right; }, result);
+    ThreadPool threadPool(4);
+    reduce.startAndWait(threadPool);
+
+    EXPECT_EQ(result, indexCount * (indexCount - 1) / 2);
+}
+
+TEST(ParallelReduceTest, singleChunk_shouldJoinOnce) {
+    constexpr int indexCount = 1000;
+    int result = -1;
+    int bodyCalls = 0;
+    int joinCalls = 0;
+
+    auto reduce = parallelReduce(
+        IndexRange(0, indexCount), 0,
+        [&bodyCalls](IndexRange<int> range, int sum) {
+            ++bodyCalls;
+            return sum + range.size();
+        },
+        [&joinCalls](int left, int right) {
+            ++joinCalls;
+            return left + right;
+        },
+        result);
+    reduce.setTargetChunkDuration(std::chrono::nanoseconds(1));
+    // Only the waiting thread runs tasks, so the range is never split and its one chunk takes many steps
+    ThreadPool threadPool(0);
+    reduce.startAndWait(threadPool);
+
+    EXPECT_EQ(result, indexCount);
+    EXPECT_GT(bodyCalls, 1);
+    EXPECT_EQ(joinCalls, 1);
+}
+
+TEST(ParallelReduceTest, emptyRange_shouldResultInIdentity) {
+    int result = -1;
+    auto reduce = parallelReduce(
+        IndexRange(0, 0), 7, [](IndexRange<int>, int value) { return value + 1; },
+        [](int left, int right) { return left + right; }, result);
+    ThreadPool threadPool(2);
+    reduce.startAndWait(threadPool);
+
+    EXPECT_EQ(result, 7);
+}
+
+TEST(TaskSequenceTest, startAndWait_withArena_steadyStateFramesShouldNotAllocate) {
+    constexpr int taskCount = 1000;
+    constexpr int frameCount = 5;
+    std::atomic<int> executed = 0;
+    std::array<int, Task::inlineSize> largeCapture{};
+    TaskArena arena(1024);
+    ThreadPool threadPool(4);
+
+    auto runFrame = [&]() {
+        arena.reset();
+        TaskSequence frame(arena);
+        TaskBatch batch(arena);
+        for (int i = 0; i < taskCount; ++i) {
+            batch.addWork([&executed]() {
+                ++executed;
+            });
+        }
+        // Too big to be stored inline
+        batch.addWork([&executed, largeCapture]() {
+            executed += largeCapture[0] + 1;
+        });
+        frame.addWork(std::move(batch));
+        frame.addWork(parallelFor(
+            IndexRange(0, taskCount),
+            [&executed](IndexRange<int> range) {
+                executed += range.size();
+            },
+            arena));
+        frame.startAndWait(threadPool);
+    };
+
+    runFrame();
+    size_t chunkAllocs = arena.chunkAllocationCount();
+    size_t heapTaskAllocs = Task::heapAllocationCount();
+    for (int frame = 1; frame < frameCount; ++frame) {
+        runFrame();
+    }
+
+    EXPECT_EQ(executed, frameCount * (2 * taskCount + 1));
+    EXPECT_EQ(arena.chunkAllocationCount(), chunkAllocs);
+    EXPECT_EQ(Task::heapAllocationCount(), heapTaskAllocs);
+}
+
+TEST(TaskDagTest, startAndWait_diamond_shouldRespectDependencies) {
+    std::atomic<int> step = 0;
+    int topStep = -1;
+    int leftStep = -1;
+    int rightStep = -1;
+    int bottomStep = -1;
+
+    TaskDag dag;
+    auto top = dag.addNode([&]() {
+        topStep = step++;
+    });
+    auto left = dag.addNode([&]() {
+        leftStep = step++;
+    });
+    auto right = dag.addNode([&]() {
+        rightStep = step++;
+    });
+    auto bottom = dag.addNode([&]() {
+        bottomStep = step++;
+    });
+    dag.precede(top, left);
+    dag.precede(top, right);
+    dag.precede(left, bottom);
+    dag.precede(right, bottom);
+    ThreadPool threadPool(4);
+    dag.startAndWait(threadPool);
+
+    EXPECT_EQ(topStep, 0);
+    EXPECT_LT(leftStep, bottomStep);
+    EXPECT_LT(rightStep, bottomStep);
+    EXPECT_EQ(bottomStep, 3);
+}
+
+TEST(TaskDagTest, start_readyNode_shouldNotWaitForUnrelatedNodes) {
+    std::latch independentDone(1);
+    std::atomic<bool> slowFinished = false;
+    bool dependentRanBeforeSlow = false;
+
+    TaskDag dag;
+    dag.addNode([&]() {
+        // Only finishes once the independent chain has run
+        independentDone.wait();
+        slowFinished = true;
+    });
+    auto first = dag.addNode([]() {});
+    auto second = dag.addNode([&]() {
+        dependentRanBeforeSlow = !slowFinished;
+        independentDone.count_down();
+    });
+    dag.precede(first, second);
+    ThreadPool threadPool(2);
+    dag.startAndWait(threadPool);
+
+    EXPECT_TRUE(dependentRanBeforeSlow);
+}
+
+TEST(TaskDagTest, addNode_subGraphs_shouldFinishBeforeSuccessors) {
+    constexpr int batchSize = 10;
+    std::atomic<int> batchExecuted = 0;
+    int seenByAfter = -1;
+
+    TaskBatch batch;
+    for (int i = 0; i < batchSize; ++i) {
+        batch.addWork([&batchExecuted]() {
+            ++batchExecuted;
+        });
+    }
+    TaskDag dag;
+    auto batchNode = dag.addNode(std::move(batch));
+    auto dynamicNode = dag.addDynamicNode([&batchExecuted]() {
+        TaskSequence seq;
+        seq.addWork([&batchExecuted]() {
+            ++batchExecuted;
+        });
+        return seq;
+    });
+    auto after = dag.addNode([&]() {
+        seenByAfter = batchExecuted;
+    });
+    dag.precede(batchNode, after);
+    dag.precede(dynamicNode, after);
+    ThreadPool threadPool(4);
+    dag.startAndWait(threadPool);
+
+    EXPECT_EQ(seenByAfter, batchSize + 1);
+}
+
+TEST(TaskDagTest, startAndWait_empty_shouldTriggerContinuation) {
+    TaskDag dag;
+    ThreadPool threadPool(2);
+    dag.startAndWait(threadPool);
+}
+
+#ifndef NDEBUG
+TEST(TaskDagTest, start_cycle_shouldTriggerAssert) {
+    TaskDag dag;
+    auto first = dag.addNode([]() {});
+    auto second = dag.addNode([]() {});
+    dag.precede(first, second);
+    dag.precede(second, first);
+    ThreadPool threadPool(1);
+    ASSERT_DEATH(dag.start(threadPool), ".*");
+}
+#endif
+
+TEST(TaskBatchTest, setPriority_highPriorityBatch_shouldRunBeforeBackgroundBatch) {
+    constexpr int batchSize = 5;
+    std::vector<ThreadPool::Priority> order;
+    std::latch release(1);
+    ThreadPool threadPool(1);
+    threadPool.postTask([&release]() {
+        release.wait();
+    });
+
+    TaskBatch backgroundBatch;
+    TaskBatch highBatch;
+    for (int i = 0; i < batchSize; ++i) {
+        backgroundBatch.addWork([&order]() {
+            order.push_back(ThreadPool::Priority::Background);
+        });
+        highBatch.addWork([&order]() {
+            order.push_back(ThreadPool::Priority::High);
+        });
+    }
+    backgroundBatch.setPriority(ThreadPool::Priority::Background);
+    highBatch.setPriority(ThreadPool::Priority::High);
+    // Wait without running tasks on this thread, so the worker runs them all in priority order
+    std::latch batchesDone(2);
+    backgroundBatch.start(threadPool, [&batchesDone]() {
+        batchesDone.count_down();
+    });
+    highBatch.start(threadPool, [&batchesDone]() {
+        batchesDone.count_down();
+    });
+    release.count_down();
+    batchesDone.wait();
+
+    ASSERT_EQ(order.size(), 2 * batchSize);
+    for (int i = 0; i < batchSize; ++i) {
+        EXPECT_EQ(order[i], ThreadPool::Priority::High) << "i: " << i;
+    }
+}
+
+TEST(TaskBatchTest, setStopToken_stopRequestedBeforeStart_shouldSkipTasksAndTriggerContinuation) {
+    std::stop_source stopSource;
+    std::atomic<int> tasksRun = 0;
+    TaskBatch batch;
+    batch.setStopToken(stopSource.get_token());
+    for (int i = 0; i < 4; ++i) {
+        batch.addWork([&tasksRun]() {
+            ++tasksRun;
+        });
+    }
+    TaskSequence subGraph;
+    subGraph.addWork([&tasksRun]() {
+        ++tasksRun;
+    });
+    batch.addWork(std::move(subGraph));
+
+    stopSource.request_stop();
+    ThreadPool threadPool(2);
+    batch.startAndWait(threadPool);
+
+    EXPECT_EQ(tasksRun, 0);
+}
+
+TEST(TaskSequenceTest, setStopToken_stopRequestedByTask_shouldSkipRemainingTasks) {
+    std::stop_source stopSource;
+    std::vector<int> executed;
+    TaskSequence sequence;
+    sequence.setStopToken(stopSource.get_token());
+    sequence.addWork([&executed]() {
+        executed.push_back(0);
+    });
+    sequence.addWork([&executed, &stopSource]() {
+        executed.push_back(1);
+        stopSource.request_stop();
+    });
+    sequence.addWork([&executed]() {
+        executed.push_back(2);
+    });
+    sequence.addDynamicWork([&executed]() {
+        executed.push_back(3);
+        return TaskBatch();
+    });
+
+    ThreadPool threadPool(2);
+    sequence.startAndWait(threadPool);
+
+    EXPECT_EQ(executed, std::vector<int>({0, 1}));
+}
+
+TEST(TaskDagTest, setStopToken_stopRequestedByNode_shouldSkipSuccessors) {
+    std::stop_source stopSource;
+    std::atomic<bool> successorRan = false;
+    TaskDag dag;
+    dag.setStopToken(stopSource.get_token());
+    TaskDag::NodeId first = dag.addNode([&stopSource]() {
+        stopSource.request_stop();
+    });
+    TaskDag::NodeId second = dag.addNode([&successorRan]() {
+        successorRan = true;
+    });
+    dag.precede(first, second);
+
+    ThreadPool threadPool(2);
+    dag.startAndWait(threadPool);
+
+    EXPECT_FALSE(successorRan);
+}
+
+TEST(ParallelForTest, setStopToken_stopRequestedByBody_shouldStopTakingSteps) {
+    std::stop_source stopSource;
+    std::atomic<int> stepsRun = 0;
+    auto loop = parallelFor(IndexRange(0, 1000), [&stepsRun, &stopSource](IndexRange<int>) {
+        ++stepsRun;
+        stopSource.request_stop();
+    });
+    loop.setMinGrainSize(1);
+    loop.setStopToken(stopSource.get_token());
+
+    // No workers, so the only chunk runs on this thread and has to notice the stop after its first step
+    ThreadPool threadPool(0);
+    loop.startAndWait(threadPool);
+
+    EXPECT_EQ(stepsRun, 1);
+}
+
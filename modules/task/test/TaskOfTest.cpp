@@ -0,0 +1,182 @@
+#include "task/TaskOf.h"
+#include "task/TaskArena.h"
+
+#include "gtest/gtest.h"
+
+#include <atomic>
+#include <memory>
+#include <numeric>
+#include <string>
+#include <vector>
+
+using namespace cg;
+
+TEST(TaskOfTest, startAndWait_shouldReturnProducedValue) {
+    ThreadPool threadPool(2);
+    TaskOf<int> task([]() {
+        return 42;
+    });
+
+    EXPECT_EQ(task.startAndWait(threadPool), 42);
+}
+
+TEST(TaskOfTest, then_multipleStages_shouldPassResultsAlong) {
+    ThreadPool threadPool(2);
+    auto task = TaskOf<int>([]() {
+                    return 12;
+                })
+                    .then([](int value) {
+                        return std::to_string(value);
+                    })
+                    .then([](std::string&& str) {
+                        return str + str;
+                    })
+                    .then([](std::string&& str) {
+                        return str.size();
+                    });
+
+    EXPECT_EQ(task.startAndWait(threadPool), 4u);
+}
+
+TEST(TaskOfTest, then_moveOnlyValue_shouldBeMovedBetweenStages) {
+    ThreadPool threadPool(2);
+    auto task = TaskOf<std::unique_ptr<int>>([]() {
+                    return std::make_unique<int>(3);
+                })
+                    .then([](std::unique_ptr<int>&& value) {
+                        *value *= 2;
+                        return std::move(value);
+                    });
+
+    EXPECT_EQ(*task.startAndWait(threadPool), 6);
+}
+
+TEST(TaskOfTest, then_returningTaskOf_shouldContinueWithItsResult) {
+    ThreadPool threadPool(2);
+    auto task = TaskOf<int>([]() {
+                    return 2;
+                })
+                    .then([](int value) {
+                        return TaskOf<int>([value]() {
+                                   return value + 1;
+                               })
+                            .then([](int inner) {
+                                return inner * 10;
+                            });
+                    })
+                    .then([](int value) {
+                        return value + 1;
+                    });
+
+    EXPECT_EQ(task.startAndWait(threadPool), 31);
+}
+
+TEST(TaskOfTest, consume_returningGraph_shouldKeepValueUntilGraphIsDone) {
+    ThreadPool threadPool(2);
+    std::atomic<int> sum = 0;
+    auto task = TaskOf<std::vector<int>>([]() {
+        std::vector<int> values(100);
+        std::iota(values.begin(), values.end(), 0);
+        return values;
+    });
+    TaskSequence sequence = std::move(task).consume([&sum](std::vector<int>& values) {
+        return parallelFor(IndexRange<size_t>(0, values.size()), [&sum, &values](IndexRange<size_t> range) {
+            for (size_t i = range.begin; i < range.end; ++i) {
+                sum += values[i];
+            }
+        });
+    });
+
+    sequence.startAndWait(threadPool);
+
+    EXPECT_EQ(sum.load(), 4950);
+}
+
+TEST(TaskOfTest, consume_addedToBatch_shouldRunAsPartOfBatch) {
+    ThreadPool threadPool(2);
+    std::vector<int> results(3, 0);
+    TaskBatch batch;
+    for (int i = 0; i < 3; ++i) {
+        batch.addWork(TaskOf<int>([i]() {
+                          return i * i;
+                      }).consume([&results, i](int& value) {
+            results[i] = value;
+        }));
+    }
+
+    batch.startAndWait(threadPool);
+
+    EXPECT_EQ(results, std::vector<int>({0, 1, 4}));
+}
+
+TEST(TaskOfTest, start_shouldPassValueToContinuation) {
+    int result = 0;
+    {
+        ThreadPool threadPool(2);
+        TaskOf<int>([]() {
+            return 5;
+        }).start(threadPool, [&result](int value) {
+            result = value;
+        });
+    }
+
+    EXPECT_EQ(result, 5);
+}
+
+TEST(TaskOfTest, collectAll_shouldKeepOrderOfTasks) {
+    ThreadPool threadPool(2);
+    std::vector<TaskOf<int>> tasks;
+    for (int i = 0; i < 10; ++i) {
+        tasks.emplace_back([i]() {
+            return i;
+        });
+    }
+
+    std::vector<int> values = collectAll(std::move(tasks)).startAndWait(threadPool);
+
+    EXPECT_EQ(values, std::vector<int>({0, 1, 2, 3, 4, 5, 6, 7, 8, 9}));
+}
+
+TEST(TaskOfTest, collectAll_noTasks_shouldResultInEmptyVector) {
+    ThreadPool threadPool(2);
+
+    EXPECT_TRUE(collectAll(std::vector<TaskOf<int>>()).startAndWait(threadPool).empty());
+}
+
+TEST(TaskOfTest, reduceAll_shouldFoldInOrderOfTasks) {
+    ThreadPool threadPool(2);
+    std::vector<TaskOf<std::string>> tasks;
+    for (char c : std::string("abcd")) {
+        tasks.emplace_back([c]() {
+            return std::string(1, c);
+        });
+    }
+
+    std::string result = reduceAll(std::move(tasks), std::string(">"), [](std::string lhs, std::string rhs) {
+                             return lhs + rhs;
+                         }).startAndWait(threadPool);
+
+    EXPECT_EQ(result, ">abcd");
+}
+
+TEST(TaskOfTest, withResource_shouldAllocateStagesAndValuesFromResource) {
+    ThreadPool threadPool(2);
+    TaskArena arena;
+    size_t heapAllocationsBefore = Task::heapAllocationCount();
+    {
+        std::vector<TaskOf<int>> tasks;
+        for (int i = 0; i < 4; ++i) {
+            tasks.emplace_back(
+                [i]() {
+                    return i;
+                },
+                arena);
+        }
+        auto task = reduceAll(std::move(tasks), 0, std::plus<>(), arena);
+
+        EXPECT_EQ(task.startAndWait(threadPool), 6);
+    }
+
+    EXPECT_GT(arena.bytesAllocated(), 0u);
+    EXPECT_EQ(Task::heapAllocationCount(), heapAllocationsBefore);
+}
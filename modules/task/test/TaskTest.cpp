@@ -0,0 +1,89 @@
+#include "task/Task.h"
+#include "task/TaskArena.h"
+
+#include "gtest/gtest.h"
+
+#include <array>
+#include <memory>
+
+using namespace cg;
+
+TEST(TaskTest, call_smallCallable_shouldBeInlineAndExecute) {
+    int calls = 0;
+    size_t heapAllocsBefore = Task::heapAllocationCount();
+    Task task([&calls]() {
+        ++calls;
+    });
+    task();
+
+    EXPECT_EQ(calls, 1);
+    EXPECT_TRUE(task.isInline());
+    EXPECT_EQ(Task::heapAllocationCount(), heapAllocsBefore);
+}
+
+TEST(TaskTest, call_capturesUpToInlineSize_shouldBeInline) {
+    std::array<std::byte, Task::inlineSize> capture{};
+    Task task([capture]() {});
+    EXPECT_TRUE(task.isInline());
+}
+
+TEST(TaskTest, call_largeCallable_shouldBeAllocatedOnHeap) {
+    std::array<int, Task::inlineSize> capture{};
+    capture.back() = 5;
+    int result = 0;
+    size_t heapAllocsBefore = Task::heapAllocationCount();
+    Task task([capture, &result]() {
+        result = capture.back();
+    });
+    task();
+
+    EXPECT_EQ(result, 5);
+    EXPECT_FALSE(task.isInline());
+    EXPECT_EQ(Task::heapAllocationCount(), heapAllocsBefore + 1);
+}
+
+TEST(TaskTest, call_largeCallableWithResource_shouldUseResource) {
+    std::array<int, Task::inlineSize> capture{};
+    TaskArena arena;
+    size_t heapAllocsBefore = Task::heapAllocationCount();
+    {
+        Task task(std::allocator_arg, &arena, [capture]() {});
+        EXPECT_FALSE(task.isInline());
+        EXPECT_GE(arena.bytesAllocated(), sizeof(capture));
+    }
+    EXPECT_EQ(Task::heapAllocationCount(), heapAllocsBefore);
+}
+
+TEST(TaskTest, move_shouldTransferCallableAndDestroyItOnce) {
+    auto counter = std::make_shared<int>(0);
+    {
+        Task task([counter]() {
+            ++*counter;
+        });
+        Task moved(std::move(task));
+        EXPECT_FALSE(task);
+        EXPECT_EQ(counter.use_count(), 2);
+
+        Task assigned;
+        assigned = std::move(moved);
+        assigned();
+        EXPECT_EQ(counter.use_count(), 2);
+    }
+    EXPECT_EQ(*counter, 1);
+    EXPECT_EQ(counter.use_count(), 1);
+}
+
+TEST(TaskTest, move_largeCallable_shouldTransferCallableAndDestroyItOnce) {
+    auto counter = std::make_shared<int>(0);
+    std::array<int, Task::inlineSize> capture{};
+    {
+        Task task([counter, capture]() {
+            ++*counter;
+        });
+        Task moved(std::move(task));
+        moved();
+        EXPECT_EQ(counter.use_count(), 2);
+    }
+    EXPECT_EQ(*counter, 1);
+    EXPECT_EQ(counter.use_count(), 1);
+}
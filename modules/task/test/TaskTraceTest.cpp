@@ -0,0 +1,101 @@
+#include "task/TaskTrace.h"
+
+#include "task/TaskGraph.h"
+#include "task/ThreadPool.h"
+
+#include "gtest/gtest.h"
+
+#include <sstream>
+#include <string>
+
+using namespace cg;
+
+namespace {
+std::string exportTrace() {
+    std::ostringstream out;
+    TaskTrace::writeChromeJson(out);
+    return out.str();
+}
+
+// Recording is global, so every test starts from an empty trace and leaves recording off
+class TaskTraceTest : public testing::Test {
+protected:
+    void SetUp() override {
+        TaskTrace::clear();
+        TaskTrace::setRecording(true);
+    }
+    void TearDown() override { TaskTrace::setRecording(false); }
+};
+} // namespace
+
+TEST_F(TaskTraceTest, record_shouldBeExportedAsCompleteEvent) {
+    int64_t begin = TaskTrace::now();
+    TaskTrace::record({"recorded \"event\"", 3, 0, begin, begin + 5000});
+
+    std::string json = exportTrace();
+
+    EXPECT_TRUE(json.starts_with("{\"traceEvents\":["));
+    EXPECT_NE(json.find(R"("name":"recorded \"event\"")"), std::string::npos);
+    EXPECT_NE(json.find(R"("dur":5.000)"), std::string::npos);
+    EXPECT_NE(json.find(R"("thread":3)"), std::string::npos);
+}
+
+TEST_F(TaskTraceTest, record_notRecording_shouldBeIgnored) {
+    TaskTrace::setRecording(false);
+    int64_t begin = TaskTrace::now();
+    TaskTrace::record({"ignored", 0, 0, begin, begin + 1});
+
+    EXPECT_EQ(exportTrace().find("ignored"), std::string::npos);
+}
+
+TEST_F(TaskTraceTest, clear_shouldDropRecordedEvents) {
+    int64_t begin = TaskTrace::now();
+    TaskTrace::record({"before clear", 0, 0, begin, begin + 1});
+    TaskTrace::clear();
+    begin = TaskTrace::now();
+    TaskTrace::record({"after clear", 0, 0, begin, begin + 1});
+
+    std::string json = exportTrace();
+
+    EXPECT_EQ(json.find("before clear"), std::string::npos);
+    EXPECT_NE(json.find("after clear"), std::string::npos);
+}
+
+TEST_F(TaskTraceTest, record_manyEvents_shouldKeepAll) {
+    constexpr int eventCount = 3000;
+    int64_t begin = TaskTrace::now();
+    for (int i = 0; i < eventCount; ++i) {
+        TaskTrace::record({"many", 0, 0, begin + i, begin + i + 1});
+    }
+
+    std::string json = exportTrace();
+
+    size_t count = 0;
+    for (size_t pos = json.find("\"many\""); pos != std::string::npos; pos = json.find("\"many\"", pos + 1)) {
+        ++count;
+    }
+    EXPECT_EQ(count, eventCount);
+}
+
+TEST_F(TaskTraceTest, labelledGraph_shouldRecordTasksWithLabelAndWorkerName) {
+    if (!TaskTrace::enabled) {
+        GTEST_SKIP() << "Built without CG_TASK_TRACING.";
+    }
+    {
+        ThreadPool threadPool(ThreadPool::Options{.threadCount = 2, .threadName = "tracer"});
+        TaskBatch batch;
+        batch.setLabel("labelled batch");
+        for (int i = 0; i < 4; ++i) {
+            batch.addWork([]() {});
+        }
+        batch.startAndWait(threadPool);
+    }
+    // Workers have named themselves by the time the pool is destroyed
+    TaskTrace::setRecording(false);
+
+    std::string json = exportTrace();
+
+    EXPECT_NE(json.find(R"("name":"labelled batch")"), std::string::npos);
+    EXPECT_NE(json.find("queuedUs"), std::string::npos);
+    EXPECT_NE(json.find(R"("name":"tracer-)"), std::string::npos);
+}
@@ -2,6 +2,14 @@
 
 #include "gtest/gtest.h"
 
+#include <array>
+#include <atomic>
+#include <chrono>
+#include <latch>
+#include <stop_token>
+#include <thread>
+#include <vector>
+
 using namespace cg;
 
 TEST(ThreadPoolTest, post_shouldExecuteTask) {
@@ -27,3 +35,613 @@ TEST(ThreadPoolTest, threadIndex_threadNotInThreadPool_shouldTriggerAssert) {
     ASSERT_DEATH(ThreadPool::threadIndex(), ".*");
 }
 #endif
+
+TEST(ThreadPoolTest, workStealing_post_shouldExecuteTask) {
+    bool taskDone = false;
+    {
+        ThreadPool tp(4, ThreadPool::Scheduling::WorkStealing);
+        tp.postTask([&taskDone]() {
+            taskDone = true;
+        });
+    }
+    EXPECT_TRUE(taskDone);
+}
+
+TEST(ThreadPoolTest, workStealing_postFromWorker_shouldBeStolenByOtherWorkers) {
+    constexpr unsigned threadCount = 4;
+    constexpr int taskCount = 40;
+    std::array<std::atomic<int>, threadCount> tasksPerThread{};
+    std::latch tasksDone(taskCount);
+    ThreadPool tp(threadCount, ThreadPool::Scheduling::WorkStealing);
+    tp.postTask([&]() {
+        std::vector<Task> tasks;
+        for (int i = 0; i < taskCount; ++i) {
+            tasks.emplace_back([&]() {
+                std::this_thread::sleep_for(std::chrono::milliseconds(1));
+                ++tasksPerThread[ThreadPool::threadIndex()];
+                tasksDone.count_down();
+            });
+        }
+        // Posted from a worker, so these go to this worker's deque and the others have to steal them
+        tp.postTasks(tasks);
+    });
+    tasksDone.wait();
+
+    int threadsUsed = 0;
+    for (const auto& count : tasksPerThread) {
+        threadsUsed += count > 0 ? 1 : 0;
+    }
+    EXPECT_GT(threadsUsed, 1);
+}
+
+TEST(ThreadPoolTest, workStealing_threadIndex_shouldBeUniquePerWorker) {
+    constexpr unsigned threadCount = 4;
+    std::array<std::atomic<int>, threadCount> hits{};
+    {
+        ThreadPool tp(threadCount, ThreadPool::Scheduling::WorkStealing);
+        std::latch allStarted(threadCount);
+        for (unsigned i = 0; i < threadCount; ++i) {
+            tp.postTask([&]() {
+                ++hits[ThreadPool::threadIndex()];
+                allStarted.arrive_and_wait();
+            });
+        }
+    }
+    for (const auto& hit : hits) {
+        EXPECT_EQ(hit, 1);
+    }
+}
+
+TEST(ThreadPoolTest, postTask_priorities_higherPriorityShouldRunFirst) {
+    std::vector<ThreadPool::Priority> order;
+    std::latch release(1);
+    {
+        ThreadPool tp(1);
+        // Keep the only worker busy until all tasks are queued
+        tp.postTask([&release]() {
+            release.wait();
+        });
+        for (auto priority : {ThreadPool::Priority::Background, ThreadPool::Priority::Normal,
+                              ThreadPool::Priority::High}) {
+            tp.postTask(
+                [&order, priority]() {
+                    order.push_back(priority);
+                },
+                priority);
+        }
+        release.count_down();
+    }
+    ASSERT_EQ(order.size(), 3);
+    EXPECT_EQ(order[0], ThreadPool::Priority::High);
+    EXPECT_EQ(order[1], ThreadPool::Priority::Normal);
+    EXPECT_EQ(order[2], ThreadPool::Priority::Background);
+}
+
+TEST(ThreadPoolTest, postTask_sustainedHighPriority_backgroundShouldNotStarve) {
+    constexpr int highTaskCount = 10 * ThreadPool::starvationInterval;
+    std::atomic<int> highTasksDone = 0;
+    int highTasksDoneBeforeBackground = -1;
+    std::latch release(1);
+    std::latch allDone(highTaskCount + 1);
+    ThreadPool tp(1);
+    tp.postTask([&release]() {
+        release.wait();
+    });
+    tp.postTask(
+        [&]() {
+            highTasksDoneBeforeBackground = highTasksDone;
+            allDone.count_down();
+        },
+        ThreadPool::Priority::Background);
+    for (int i = 0; i < highTaskCount; ++i) {
+        tp.postTask(
+            [&]() {
+                ++highTasksDone;
+                allDone.count_down();
+            },
+            ThreadPool::Priority::High);
+    }
+    release.count_down();
+    allDone.wait();
+
+    EXPECT_LE(highTasksDoneBeforeBackground, ThreadPool::starvationInterval);
+}
+
+TEST(ThreadPoolTest, workStealing_postTasks_backgroundFromWorker_shouldRunAfterNormal) {
+    std::vector<ThreadPool::Priority> order;
+    std::latch tasksDone(2);
+    ThreadPool tp(1, ThreadPool::Scheduling::WorkStealing);
+    tp.postTask([&]() {
+        tp.postTask(
+            [&]() {
+                order.push_back(ThreadPool::Priority::Background);
+                tasksDone.count_down();
+            },
+            ThreadPool::Priority::Background);
+        tp.postTask([&]() {
+            order.push_back(ThreadPool::Priority::Normal);
+            tasksDone.count_down();
+        });
+    });
+    tasksDone.wait();
+
+    ASSERT_EQ(order.size(), 2);
+    EXPECT_EQ(order[0], ThreadPool::Priority::Normal);
+    EXPECT_EQ(order[1], ThreadPool::Priority::Background);
+}
+
+TEST(ThreadPoolTest, postTaskToWorker_shouldRunOnThatWorker) {
+    constexpr unsigned threadCount = 4;
+    std::array<ThreadPool::ThreadIndex, threadCount> ranOn{};
+    std::latch tasksDone(threadCount);
+    ThreadPool tp(threadCount, ThreadPool::Scheduling::WorkStealing);
+    for (unsigned i = 0; i < threadCount; ++i) {
+        tp.postTaskToWorker(static_cast<ThreadPool::ThreadIndex>(i), [&, i]() {
+            ranOn[i] = ThreadPool::threadIndex();
+            tasksDone.count_down();
+        });
+    }
+    tasksDone.wait();
+
+    for (unsigned i = 0; i < threadCount; ++i) {
+        EXPECT_EQ(ranOn[i], static_cast<ThreadPool::ThreadIndex>(i));
+    }
+}
+
+TEST(ThreadPoolTest, options_pinning_shouldRunTasksAndReportPinnedCpus) {
+    ThreadPool::Options options;
+    options.threadCount = 2;
+    options.pinning = ThreadPool::Pinning::LogicalCpus;
+    ThreadPool tp(options);
+
+    std::vector<LogicalCpu> cpus = CpuTopology::detect().pinningOrder(true);
+    for (ThreadPool::ThreadIndex i = 0; i < 2; ++i) {
+        // The OS may refuse pinning (e.g. restricted containers), in which case there is nothing to check
+        std::optional<LogicalCpu> cpu = tp.workerCpu(i);
+        if (cpu.has_value()) {
+            EXPECT_EQ(cpu->id, cpus[i % cpus.size()].id);
+        }
+    }
+
+    std::latch taskDone(1);
+    tp.postTask([&taskDone]() {
+        taskDone.count_down();
+    });
+    taskDone.wait();
+}
+
+TEST(ThreadPoolTest, options_pinningOff_shouldNotReportCpus) {
+    ThreadPool tp(ThreadPool::Options{.threadCount = 1});
+
+    EXPECT_FALSE(tp.workerCpu(0).has_value());
+}
+
+TEST(ThreadPoolTest, postTask_stopRequestedBeforeRun_shouldDropTask) {
+    std::stop_source stopSource;
+    std::atomic<bool> droppedTaskRan = false;
+    std::latch release(1);
+    std::latch tasksDone(1);
+    {
+        ThreadPool tp(1);
+        // Keep the only worker busy, so the stop is requested while the task is still queued
+        tp.postTask([&release]() {
+            release.wait();
+        });
+        tp.postTask(
+            [&droppedTaskRan]() {
+                droppedTaskRan = true;
+            },
+            stopSource.get_token());
+        tp.postTask([&tasksDone]() {
+            tasksDone.count_down();
+        });
+        stopSource.request_stop();
+        release.count_down();
+        tasksDone.wait();
+    }
+
+    EXPECT_FALSE(droppedTaskRan);
+}
+
+namespace {
+// Each task posts the next one, like the steps of a sequence, so workers keep running out of tasks in between
+void runTaskChain(ThreadPool& tp, int length) {
+    std::atomic<int> ranCount = 0;
+    std::latch chainDone(1);
+    auto step = [&tp, &ranCount, &chainDone, length](auto& self) -> void {
+        if (++ranCount == length) {
+            chainDone.count_down();
+            return;
+        }
+        tp.postTask([&self]() {
+            self(self);
+        });
+    };
+    tp.postTask([&step]() {
+        step(step);
+    });
+    chainDone.wait();
+    EXPECT_EQ(ranCount.load(), length);
+}
+
+bool waitForSleepingThreads(const ThreadPool& tp, unsigned count) {
+    auto deadline = std::chrono::steady_clock::now() + std::chrono::seconds(1);
+    while (tp.sleepingThreadCount() != count) {
+        if (std::chrono::steady_clock::now() > deadline) {
+            return false;
+        }
+        std::this_thread::yield();
+    }
+    return true;
+}
+} // namespace
+
+TEST(ThreadPoolTest, idlePolicy_noSpinning_shouldRunTaskChain) {
+    ThreadPool tp(ThreadPool::Options{.threadCount = 2, .idlePolicy = {.spinCount = 0, .yieldCount = 0}});
+
+    runTaskChain(tp, 100);
+}
+
+TEST(ThreadPoolTest, idlePolicy_spinning_shouldRunTaskChainAndThenSleep) {
+    ThreadPool tp(ThreadPool::Options{.threadCount = 2, .idlePolicy = {.spinCount = 10000, .yieldCount = 100}});
+
+    runTaskChain(tp, 100);
+
+    EXPECT_TRUE(waitForSleepingThreads(tp, 2));
+}
+
+TEST(ThreadPoolTest, postTasks_fewerTasksThanSleepingThreads_shouldRunAll) {
+    ThreadPool tp(4);
+    ASSERT_TRUE(waitForSleepingThreads(tp, 4));
+
+    std::latch tasksDone(2);
+    std::array<Task, 2> tasks;
+    for (Task& task : tasks) {
+        task = [&tasksDone]() {
+            tasksDone.count_down();
+        };
+    }
+    tp.postTasks(tasks);
+    tasksDone.wait();
+}
+
+TEST(ThreadPoolTest, metrics_shouldCountTasksAndTheirStartLatency) {
+    if (!PoolMetrics::enabled) {
+        GTEST_SKIP() << "Built without CG_TASK_METRICS.";
+    }
+    ThreadPool tp(2);
+    constexpr int taskCount = 10;
+    std::latch tasksDone(taskCount);
+    for (int i = 0; i < taskCount; ++i) {
+        tp.postTask([&tasksDone]() {
+            tasksDone.count_down();
+        });
+    }
+    tasksDone.wait();
+    // The last task may still be finishing after counting down
+    auto deadline = std::chrono::steady_clock::now() + std::chrono::seconds(1);
+    while (tp.metrics().tasksExecuted() < taskCount && std::chrono::steady_clock::now() < deadline) {
+        std::this_thread::yield();
+    }
+
+    PoolMetrics metrics = tp.metrics();
+
+    EXPECT_EQ(metrics.workers.size(), tp.participantCount());
+    EXPECT_EQ(metrics.tasksExecuted(), taskCount);
+    uint64_t latencyCount = 0;
+    for (uint64_t bucketCount : metrics.startLatency()) {
+        latencyCount += bucketCount;
+    }
+    EXPECT_EQ(latencyCount, taskCount);
+    EXPECT_GE(metrics.queueDepthHighWater, 1u);
+}
+
+TEST(ThreadPoolTest, metrics_longTask_shouldCountAsBusyTime) {
+    if (!PoolMetrics::enabled) {
+        GTEST_SKIP() << "Built without CG_TASK_METRICS.";
+    }
+    ThreadPool tp(1);
+    std::latch taskDone(1);
+    // Not waiting with runTasksUntil, so the worker runs the task
+    tp.postTask([&taskDone]() {
+        std::this_thread::sleep_for(std::chrono::milliseconds(5));
+        taskDone.count_down();
+    });
+    taskDone.wait();
+    auto deadline = std::chrono::steady_clock::now() + std::chrono::seconds(1);
+    while (tp.metrics().tasksExecuted() < 1 && std::chrono::steady_clock::now() < deadline) {
+        std::this_thread::yield();
+    }
+
+    PoolMetrics metrics = tp.metrics();
+
+    EXPECT_GE(metrics.workers[0].busyTime, std::chrono::milliseconds(5));
+    EXPECT_GT(metrics.busyRatio(), 0.0);
+}
+
+TEST(ThreadPoolTest, resetQueueDepthHighWater_shouldStartFromCurrentDepth) {
+    if (!PoolMetrics::enabled) {
+        GTEST_SKIP() << "Built without CG_TASK_METRICS.";
+    }
+    ThreadPool tp(1);
+    std::latch release(1);
+    std::latch tasksDone(8);
+    // Block the only worker, so the other tasks pile up in the queue
+    tp.postTask([&release]() {
+        release.wait();
+    });
+    for (int i = 0; i < 8; ++i) {
+        tp.postTask([&tasksDone]() {
+            tasksDone.count_down();
+        });
+    }
+    EXPECT_GE(tp.metrics().queueDepthHighWater, 8u);
+    release.count_down();
+    tasksDone.wait();
+
+    tp.resetQueueDepthHighWater();
+
+    EXPECT_LE(tp.metrics().queueDepthHighWater, 1u);
+}
+
+TEST(ThreadPoolTest, maxTaskBatch_longQueue_shouldRunAllTasksInPostingOrder) {
+    constexpr int taskCount = 100;
+    std::vector<int> order;
+    std::latch release(1);
+    std::latch tasksDone(taskCount);
+    ThreadPool::Options options;
+    options.threadCount = 1;
+    options.maxTaskBatch = 8;
+    ThreadPool tp(options);
+    // Let the queue grow long enough for the worker to take batches
+    tp.postTask([&release]() {
+        release.wait();
+    });
+    for (int i = 0; i < taskCount; ++i) {
+        tp.postTask([&order, &tasksDone, i]() {
+            order.push_back(i);
+            tasksDone.count_down();
+        });
+    }
+    release.count_down();
+    tasksDone.wait();
+
+    ASSERT_EQ(order.size(), taskCount);
+    for (int i = 0; i < taskCount; ++i) {
+        EXPECT_EQ(order[i], i);
+    }
+}
+
+TEST(ThreadPoolTest, maxTaskBatch_highPriorityPostedDuringBatch_shouldRunBeforeRestOfBatch) {
+    std::vector<ThreadPool::Priority> order;
+    std::latch release(1);
+    std::latch tasksDone(9);
+    ThreadPool::Options options;
+    options.threadCount = 1;
+    options.maxTaskBatch = 8;
+    ThreadPool tp(options);
+    tp.postTask([&release]() {
+        release.wait();
+    });
+    for (int i = 0; i < 8; ++i) {
+        tp.postTask([&]() {
+            if (order.empty()) {
+                tp.postTask(
+                    [&]() {
+                        order.push_back(ThreadPool::Priority::High);
+                        tasksDone.count_down();
+                    },
+                    ThreadPool::Priority::High);
+            }
+            order.push_back(ThreadPool::Priority::Normal);
+            tasksDone.count_down();
+        });
+    }
+    release.count_down();
+    tasksDone.wait();
+
+    ASSERT_EQ(order.size(), 9);
+    EXPECT_EQ(order[1], ThreadPool::Priority::High);
+}
+
+TEST(ThreadPoolTest, maxTaskBatch_taskWaitingForLaterTaskOfItsBatch_shouldNotDeadlock) {
+    constexpr int taskCount = 64;
+    std::latch blockersStarted(2);
+    std::latch release(1);
+    std::latch secondDone(1);
+    std::latch tasksDone(taskCount);
+    ThreadPool::Options options;
+    options.threadCount = 2;
+    options.maxTaskBatch = 8;
+    ThreadPool tp(options);
+    // Keep both workers busy until the queue is long enough for batches
+    for (int i = 0; i < 2; ++i) {
+        tp.postTask([&blockersStarted, &release]() {
+            blockersStarted.count_down();
+            release.wait();
+        });
+    }
+    blockersStarted.wait();
+    for (int i = 0; i < taskCount; ++i) {
+        tp.postTask([&secondDone, &tasksDone, i]() {
+            // The second task is in the same batch, so the other worker has to steal it
+            if (i == 0) {
+                secondDone.wait();
+            } else if (i == 1) {
+                secondDone.count_down();
+            }
+            tasksDone.count_down();
+        });
+    }
+    release.count_down();
+    tasksDone.wait();
+}
+
+TEST(ThreadPoolTest, queueOrder_lifo_shouldRunMostRecentTaskFirst) {
+    std::vector<int> order;
+    std::latch release(1);
+    std::latch tasksDone(3);
+    ThreadPool::Options options;
+    options.threadCount = 1;
+    options.queueOrder = QueueOrder::Lifo;
+    ThreadPool tp(options);
+    tp.postTask([&release]() {
+        release.wait();
+    });
+    for (int i = 0; i < 3; ++i) {
+        tp.postTask([&order, &tasksDone, i]() {
+            order.push_back(i);
+            tasksDone.count_down();
+        });
+    }
+    release.count_down();
+    tasksDone.wait();
+
+    EXPECT_EQ(order, std::vector<int>({2, 1, 0}));
+}
+
+TEST(ThreadPoolTest, defaultPool_shouldBeSharedAndRunTasks) {
+    ThreadPool& pool = ThreadPool::defaultPool();
+    std::latch taskDone(1);
+    pool.postTask([&taskDone]() {
+        taskDone.count_down();
+    });
+    taskDone.wait();
+
+    EXPECT_EQ(&ThreadPool::defaultPool(), &pool);
+    EXPECT_GT(pool.threadCount(), 0u);
+}
+
+TEST(ThreadPoolTest, maxThreadCount_shouldKeepIndicesStableAndOnlyUseActiveWorkers) {
+    ThreadPool::Options options;
+    options.threadCount = 1;
+    options.maxThreadCount = 4;
+    ThreadPool tp(options);
+    EXPECT_EQ(tp.threadCount(), 1u);
+    EXPECT_EQ(tp.maxThreadCount(), 4u);
+    EXPECT_EQ(tp.participantCount(), 5u);
+
+    constexpr int taskCount = 20;
+    std::array<std::atomic<ThreadPool::ThreadIndex>, taskCount> ranOn{};
+    std::latch tasksDone(taskCount);
+    for (int i = 0; i < taskCount; ++i) {
+        tp.postTask([&, i]() {
+            ranOn[i] = ThreadPool::threadIndex();
+            tasksDone.count_down();
+        });
+    }
+    tasksDone.wait();
+    for (const auto& index : ranOn) {
+        EXPECT_EQ(index, 0);
+    }
+
+    // The thread waiting outside the pool gets the index after the last parked worker
+    std::atomic<bool> done = false;
+    std::atomic<ThreadPool::ThreadIndex> ranOnIndex = ThreadPool::invalidIndex;
+    tp.postTask([&]() {
+        ranOnIndex = ThreadPool::threadIndex();
+        tp.notifyDone(done);
+    });
+    tp.runTasksUntil(done);
+    EXPECT_TRUE(ranOnIndex == 0 || ranOnIndex == 4);
+}
+
+TEST(ThreadPoolTest, setThreadCount_grow_shouldRunTasksOnNewWorkersConcurrently) {
+    ThreadPool::Options options;
+    options.threadCount = 1;
+    options.maxThreadCount = 3;
+    ThreadPool tp(options);
+    tp.setThreadCount(3);
+    EXPECT_EQ(tp.threadCount(), 3u);
+
+    // Only finishes if three workers run these at the same time
+    std::latch allRunning(3);
+    std::latch tasksDone(3);
+    for (int i = 0; i < 3; ++i) {
+        tp.postTask([&]() {
+            allRunning.arrive_and_wait();
+            tasksDone.count_down();
+        });
+    }
+    tasksDone.wait();
+}
+
+TEST(ThreadPoolTest, setThreadCount_shrinkWithTasksInFlight_shouldRunAllTasks) {
+    ThreadPool::Options options;
+    options.threadCount = 4;
+    options.scheduling = ThreadPool::Scheduling::WorkStealing;
+    ThreadPool tp(options);
+    constexpr int taskCount = 200;
+    std::atomic<int> tasksRun = 0;
+    std::latch tasksDone(taskCount);
+    // Posted from a worker, so they sit in its deque while it may get parked
+    tp.postTask([&]() {
+        for (int i = 0; i < taskCount; ++i) {
+            tp.postTask([&]() {
+                ++tasksRun;
+                tasksDone.count_down();
+            });
+        }
+    });
+    tp.setThreadCount(1);
+    tasksDone.wait();
+
+    EXPECT_EQ(tasksRun, taskCount);
+    EXPECT_EQ(tp.threadCount(), 1u);
+}
+
+TEST(ThreadPoolTest, postTaskToWorker_parkedWorker_shouldRunOnThatWorker) {
+    ThreadPool::Options options;
+    options.threadCount = 1;
+    options.maxThreadCount = 3;
+    ThreadPool tp(options);
+    std::atomic<ThreadPool::ThreadIndex> ranOn = ThreadPool::invalidIndex;
+    std::latch taskDone(1);
+    tp.postTaskToWorker(2, [&]() {
+        ranOn = ThreadPool::threadIndex();
+        taskDone.count_down();
+    });
+    taskDone.wait();
+
+    EXPECT_EQ(ranOn, 2);
+    EXPECT_EQ(tp.threadCount(), 1u);
+}
+
+TEST(ThreadPoolTest, elastic_backlog_shouldGrowAndThenShrinkWhenIdle) {
+    ThreadPool::Options options;
+    options.threadCount = 1;
+    options.maxThreadCount = 3;
+    options.elastic = true;
+    options.shrinkDelay = std::chrono::milliseconds(5);
+    // Batching could hand two of the blocking tasks to one worker
+    options.maxTaskBatch = 1;
+    ThreadPool tp(options);
+
+    // The three blocking tasks only finish once the pool grew to three workers, which the fillers queued behind them
+    // make it do
+    std::latch allRunning(3);
+    std::latch firstStarted(1);
+    constexpr int fillerCount = 20;
+    std::latch tasksDone(3 + fillerCount);
+    auto blockingTask = [&]() {
+        firstStarted.count_down();
+        allRunning.arrive_and_wait();
+        tasksDone.count_down();
+    };
+    tp.postTask(blockingTask);
+    firstStarted.wait();
+    tp.postTask(blockingTask);
+    tp.postTask(blockingTask);
+    for (int i = 0; i < fillerCount; ++i) {
+        tp.postTask([&]() {
+            tasksDone.count_down();
+        });
+    }
+    tasksDone.wait();
+
+    auto deadline = std::chrono::steady_clock::now() + std::chrono::seconds(2);
+    while (tp.threadCount() > 1 && std::chrono::steady_clock::now() < deadline) {
+        std::this_thread::sleep_for(std::chrono::milliseconds(1));
+    }
+    EXPECT_EQ(tp.threadCount(), 1u);
+}
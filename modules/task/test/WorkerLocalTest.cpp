@@ -0,0 +1,137 @@
+#include "task/WorkerLocal.h"
+#include "task/TaskGraph.h"
+
+#include "gtest/gtest.h"
+
+#include <atomic>
+#include <cstdint>
+#include <latch>
+#include <vector>
+
+using namespace cg;
+
+TEST(WorkerLocalTest, local_shouldCreateValuesOnlyForThreadsUsingThem) {
+    ThreadPool threadPool(2);
+    WorkerLocal<int> counters(threadPool);
+    EXPECT_EQ(counters.createdCount(), 0u);
+
+    TaskBatch batch;
+    batch.addWork([&counters]() {
+        ++counters.local();
+    });
+    batch.startAndWait(threadPool);
+
+    EXPECT_EQ(counters.createdCount(), 1u);
+    int total = 0;
+    counters.forEach([&total](int& value) {
+        total += value;
+    });
+    EXPECT_EQ(total, 1);
+}
+
+TEST(WorkerLocalTest, combine_shouldJoinValuesOfAllThreads) {
+    ThreadPool threadPool(4);
+    WorkerLocal<std::vector<int>> partials(threadPool);
+    constexpr int count = 1000;
+
+    auto loop = parallelFor(IndexRange(0, count), [&partials](IndexRange<int> range) {
+        std::vector<int>& partial = partials.local();
+        for (int i = range.begin; i < range.end; ++i) {
+            partial.push_back(i);
+        }
+    });
+    loop.startAndWait(threadPool);
+    std::vector<int> all = partials.combine(std::vector<int>(), [](std::vector<int> lhs, std::vector<int> rhs) {
+        lhs.insert(lhs.end(), rhs.begin(), rhs.end());
+        return lhs;
+    });
+
+    EXPECT_EQ(all.size(), static_cast<size_t>(count));
+    int64_t sum = 0;
+    for (int value : all) {
+        sum += value;
+    }
+    EXPECT_EQ(sum, count * (count - 1) / 2);
+    EXPECT_EQ(partials.createdCount(), 0u);
+}
+
+TEST(WorkerLocalTest, createOnWorkers_shouldCreateEachValueOnItsOwnThread) {
+    constexpr unsigned threadCount = 3;
+    ThreadPool threadPool(threadCount);
+    struct CreatedOn {
+        ThreadPool::ThreadIndex index;
+        bool onOwnThread;
+    };
+    WorkerLocal<CreatedOn> values(threadPool, [](ThreadPool::ThreadIndex index) {
+        bool isWorker = static_cast<unsigned>(index) < threadCount;
+        return CreatedOn{index, !isWorker || ThreadPool::threadIndex() == index};
+    });
+
+    values.createOnWorkers();
+
+    ASSERT_EQ(values.createdCount(), threadPool.participantCount());
+    for (unsigned i = 0; i < threadPool.participantCount(); ++i) {
+        CreatedOn* value = values.get(static_cast<ThreadPool::ThreadIndex>(i));
+        ASSERT_NE(value, nullptr);
+        EXPECT_EQ(value->index, static_cast<ThreadPool::ThreadIndex>(i));
+        EXPECT_TRUE(value->onOwnThread) << "i: " << i;
+    }
+}
+
+TEST(WorkerLocalTest, createOnWorkers_calledFromWorker_shouldCreateEveryValue) {
+    constexpr unsigned threadCount = 2;
+    ThreadPool threadPool(threadCount);
+    WorkerLocal<ThreadPool::ThreadIndex> values(threadPool, [](ThreadPool::ThreadIndex index) {
+        return index;
+    });
+
+    std::latch created(1);
+    threadPool.postTask([&values, &created]() {
+        values.createOnWorkers();
+        created.count_down();
+    });
+    created.wait();
+
+    // No thread outside the pool took part, so its value is left for first use
+    EXPECT_EQ(values.createdCount(), threadCount);
+    for (unsigned i = 0; i < threadCount; ++i) {
+        ThreadPool::ThreadIndex* value = values.get(static_cast<ThreadPool::ThreadIndex>(i));
+        ASSERT_NE(value, nullptr);
+        EXPECT_EQ(*value, static_cast<ThreadPool::ThreadIndex>(i));
+    }
+    EXPECT_EQ(values.get(static_cast<ThreadPool::ThreadIndex>(threadCount)), nullptr);
+}
+
+#ifndef NDEBUG
+TEST(WorkerLocalTest, local_workerOfOtherPool_shouldTriggerAssert) {
+    ASSERT_DEATH(
+        {
+            ThreadPool threadPool(1);
+            ThreadPool otherPool(1);
+            WorkerLocal<int> values(threadPool);
+            std::latch used(1);
+            otherPool.postTask([&values, &used]() {
+                ++values.local();
+                used.count_down();
+            });
+            used.wait();
+        },
+        ".*");
+}
+#endif
+
+TEST(WorkerLocalTest, clear_shouldRecreateValuesOnNextUse) {
+    ThreadPool threadPool(1);
+    std::atomic<int> creations = 0;
+    WorkerLocal<int> values(threadPool, [&creations]() {
+        return ++creations;
+    });
+    values.createOnWorkers();
+    EXPECT_EQ(creations, 2);
+
+    values.clear();
+
+    EXPECT_EQ(values.get(0), nullptr);
+    values.createOnWorkers();
+    EXPECT_EQ(creations, 4);
+}